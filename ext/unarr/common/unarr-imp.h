@@ -70,6 +70,7 @@ struct ar_archive_s {
     off64_t entry_offset;
     off64_t entry_offset_first;
     off64_t entry_offset_next;
+    off64_t entry_solid_offset;
     size_t entry_size_uncompressed;
     time64_t entry_filetime;
 };
@@ -40,8 +40,14 @@ bool ar_parse_entry(ar_archive *ar)
 }
 
 bool ar_parse_entry_at(ar_archive *ar, off64_t offset)
+{
+    return ar_parse_entry_at_solid(ar, offset, 0);
+}
+
+bool ar_parse_entry_at_solid(ar_archive *ar, off64_t offset, off64_t solid_offset)
 {
     ar->at_eof = false;
+    ar->entry_solid_offset = solid_offset;
     return ar->parse_entry(ar, offset ? offset : ar->entry_offset_first);
 }
 
@@ -70,6 +76,11 @@ off64_t ar_entry_get_offset(ar_archive *ar)
     return ar->entry_offset;
 }
 
+off64_t ar_entry_get_solid_offset(ar_archive *ar)
+{
+    return ar->entry_solid_offset;
+}
+
 size_t ar_entry_get_size(ar_archive *ar)
 {
     return ar->entry_size_uncompressed;
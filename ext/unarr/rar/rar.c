@@ -79,6 +79,11 @@ static bool rar_parse_entry(ar_archive *ar, off64_t offset)
                 br_clear_leftover_bits(&rar->uncomp);
             }
 
+            /* remember where the current solid block starts so that decompression doesn't have to restart at the first entry */
+            if (!rar->entry.solid)
+                ar->entry_solid_offset = ar->entry_offset;
+            else if (!ar->entry_solid_offset || ar->entry_solid_offset > ar->entry_offset)
+                ar->entry_solid_offset = ar->entry_offset_first;
             rar->solid.restart = rar->entry.solid && (out_of_order || !rar->solid.part_done);
             rar->solid.part_done = !ar->entry_size_uncompressed;
             rar->progress.data_left = (size_t)header.datasize;
@@ -136,9 +141,15 @@ static bool rar_restart_solid(ar_archive *ar)
 {
     ar_archive_rar *rar = (ar_archive_rar *)ar;
     off64_t current_offset = ar->entry_offset;
+    off64_t solid_offset = ar->entry_solid_offset;
     log("Restarting decompression for solid entry");
-    if (!ar_parse_entry_at(ar, ar->entry_offset_first)) {
-        ar_parse_entry_at(ar, current_offset);
+    if (!ar_parse_entry_at(ar, solid_offset)) {
+        ar_parse_entry_at_solid(ar, current_offset, solid_offset);
+        return false;
+    }
+    /* if solid_offset doesn't point to the start of a solid block, start over at the first entry */
+    if (rar->entry.solid && ar->entry_offset != ar->entry_offset_first && !ar_parse_entry_at(ar, ar->entry_offset_first)) {
+        ar_parse_entry_at_solid(ar, current_offset, solid_offset);
         return false;
     }
     while (ar->entry_offset < current_offset) {
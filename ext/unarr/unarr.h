@@ -50,6 +50,8 @@ void ar_close_archive(ar_archive *ar);
 bool ar_parse_entry(ar_archive *ar);
 /* reads the archive entry at the given offset as returned by ar_entry_get_offset (offset 0 always restarts at the first entry); should always succeed */
 bool ar_parse_entry_at(ar_archive *ar, off64_t offset);
+/* same as ar_parse_entry_at, but solid decompression restarts at solid_offset as returned by ar_entry_get_solid_offset (if known) */
+bool ar_parse_entry_at_solid(ar_archive *ar, off64_t offset, off64_t solid_offset);
 /* reads the (first) archive entry associated with the given name; returns false if the entry couldn't be found */
 bool ar_parse_entry_for(ar_archive *ar, const char *entry_name);
 /* returns whether the last ar_parse_entry call has reached the file's expected end */
@@ -59,6 +61,8 @@ bool ar_at_eof(ar_archive *ar);
 const char *ar_entry_get_name(ar_archive *ar);
 /* returns the stream offset of the current entry for use with ar_parse_entry_at */
 off64_t ar_entry_get_offset(ar_archive *ar);
+/* returns the stream offset of the entry at which decompression has to start for the current entry (or 0 if not applicable) */
+off64_t ar_entry_get_solid_offset(ar_archive *ar);
 /* returns the total size of uncompressed data of the current entry; read exactly that many bytes using ar_entry_uncompress */
 size_t ar_entry_get_size(ar_archive *ar);
 /* returns the stored modification date of the current entry in 100ns since 1601/01/01 */
@@ -295,6 +295,13 @@ typedef struct fz_scale_cache_s fz_scale_cache;
 fz_scale_cache *fz_new_scale_cache(fz_context *ctx);
 void fz_free_scale_cache(fz_context *ctx, fz_scale_cache *cache);
 fz_pixmap *fz_scale_pixmap_cached(fz_context *ctx, fz_pixmap *src, float x, float y, float w, float h, const fz_irect *clip, fz_scale_cache *cache_x, fz_scale_cache *cache_y);
+/*
+	SumatraPDF: fz_scale_pixmap_tuned: Like fz_scale_pixmap_cached but with
+	the SIMD level (see fz_paint_simd_level) and the maximum number of
+	threads (0 for one per CPU) to use for large images. The result is the
+	same for all settings (for comparison tests and benchmarks).
+*/
+fz_pixmap *fz_scale_pixmap_tuned(fz_context *ctx, fz_pixmap *src, float x, float y, float w, float h, const fz_irect *clip, fz_scale_cache *cache_x, fz_scale_cache *cache_y, int simd, int max_bands);
 
 void fz_subsample_pixmap(fz_context *ctx, fz_pixmap *tile, int factor);
 
@@ -312,4 +319,27 @@ void fz_md5_pixmap(fz_pixmap *pixmap, unsigned char digest[16]);
 fz_pixmap *fz_new_pixmap_from_8bpp_data(fz_context *ctx, int x, int y, int w, int h, unsigned char *sp, int span);
 fz_pixmap *fz_new_pixmap_from_1bpp_data(fz_context *ctx, int x, int y, int w, int h, unsigned char *sp, int span);
 
+/*
+	SumatraPDF: the span painters used for drawing have SSE2 and AVX2 versions
+	for n == 2 and n == 4, selected at runtime.
+
+	fz_paint_simd_level: Returns the best SIMD level supported by the CPU
+	(0 for plain C, 1 for SSE2, 2 for AVX2).
+
+	fz_paint_kernels: Returns the span painters, each callable at any SIMD
+	level up to fz_paint_simd_level (for comparison tests and benchmarks).
+	Only the arguments used by the respective painter are read (e.g. sp
+	and mp are ignored for solid_color, color for span_with_mask).
+*/
+typedef void (fz_paint_kernel_fn)(unsigned char *dp, unsigned char *sp, unsigned char *mp, int n, int w, unsigned char *color, int alpha, int simd);
+
+typedef struct fz_paint_kernel_s
+{
+	const char *name;
+	fz_paint_kernel_fn *paint;
+} fz_paint_kernel;
+
+int fz_paint_simd_level(void);
+const fz_paint_kernel *fz_paint_kernels(int *count);
+
 #endif
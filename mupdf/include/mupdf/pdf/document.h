@@ -280,6 +280,9 @@ struct pdf_document_s
 
 	/* cf. http://bugs.ghostscript.com/show_bug.cgi?id=695761 */
 	pdf_obj **page_objs;
+	/* SumatraPDF: set when a link destination's page couldn't be found through
+	   its /Parent chain, so that callers can retry after setting page_objs */
+	int page_lookup_failed;
 };
 
 /*
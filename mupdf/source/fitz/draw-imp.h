@@ -46,4 +46,23 @@ void fz_blend_pixel(unsigned char dp[3], unsigned char bp[3], unsigned char sp[3
 
 void fz_paint_glyph(unsigned char *colorbv, fz_pixmap *dst, unsigned char *dp, fz_glyph *glyph, int w, int h, int skip_x, int skip_y);
 
+/*
+ * SumatraPDF: SSE2/AVX2 versions of drawing functions (selected at runtime
+ * through fz_paint_simd_level); FZ_TARGET_* allow using the intrinsics
+ * without compiling the whole file for that instruction set.
+ */
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#include <immintrin.h>
+#define FZ_DRAW_SIMD
+#define FZ_TARGET_SSE2
+#define FZ_TARGET_AVX2
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <immintrin.h>
+#define FZ_DRAW_SIMD
+#define FZ_TARGET_SSE2 __attribute__((target("sse2")))
+#define FZ_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
 #endif
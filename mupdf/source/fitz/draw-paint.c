@@ -73,6 +73,502 @@ and stick to using the premultiplied form.
 
 typedef unsigned char byte;
 
+/* SumatraPDF: SSE2/AVX2 versions of the n == 2 and n == 4 span painters */
+
+/*
+The vectorized painters below operate on 16-bit lanes, one per color
+component, and compute exactly the same values as the scalar code:
+
+	FZ_BLEND(S, D, A)	= (D.256 + (S-D).A) >> 8
+
+stays within [0, 65535] for all A in [0, 256], so it can be evaluated
+modulo 2^16 with _mm_mullo_epi16. FZ_COMBINE(A, B) = (A.B) >> 8 is evaluated
+the same way, since A.B <= 255.256 for all operands used here.
+
+Each of these functions paints as many whole vectors as fit into w and
+returns the number of pixels painted; the scalar code does the rest.
+*/
+
+/* returns 0 for plain C, 1 for SSE2 and 2 for AVX2 */
+int
+fz_paint_simd_level(void)
+{
+	static int level = -1;
+	if (level < 0)
+	{
+		int simd = 0;
+#if defined(FZ_DRAW_SIMD) && defined(_MSC_VER)
+		int info[4], max_leaf;
+		__cpuid(info, 0);
+		max_leaf = info[0];
+		__cpuid(info, 1);
+		if (info[3] & (1 << 26))
+			simd = 1;
+		/* AVX2 also requires the OS to save the YMM registers (OSXSAVE, AVX, XCR0) */
+		if (simd && max_leaf >= 7 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6)
+		{
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5))
+				simd = 2;
+		}
+#elif defined(FZ_DRAW_SIMD)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse2"))
+			simd = 1;
+		if (simd && __builtin_cpu_supports("avx2"))
+			simd = 2;
+#endif
+		level = simd;
+	}
+	return level;
+}
+
+#ifdef FZ_DRAW_SIMD
+
+static inline __m128i FZ_TARGET_SSE2
+fz_expand_sse2(__m128i a)
+{
+	return _mm_add_epi16(a, _mm_srli_epi16(a, 7));
+}
+
+static inline __m128i FZ_TARGET_SSE2
+fz_combine_sse2(__m128i a, __m128i b)
+{
+	return _mm_srli_epi16(_mm_mullo_epi16(a, b), 8);
+}
+
+static inline __m128i FZ_TARGET_SSE2
+fz_blend_sse2(__m128i src, __m128i dst, __m128i amount)
+{
+	return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(src, dst), amount), _mm_slli_epi16(dst, 8)), 8);
+}
+
+/* broadcast the alpha of each pixel to all its components */
+static inline __m128i FZ_TARGET_SSE2
+fz_alpha_sse2(__m128i a, int n)
+{
+	if (n == 4)
+		return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, 0xFF), 0xFF);
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, 0xF5), 0xF5);
+}
+
+/* loads the 16 / n mask values for one vector (the remaining bytes are 0) */
+static inline __m128i FZ_TARGET_SSE2
+fz_load_mask_sse2(const byte *mp, int n)
+{
+	if (n == 4)
+	{
+		int m;
+		memcpy(&m, mp, 4);
+		return _mm_cvtsi32_si128(m);
+	}
+	return _mm_loadl_epi64((const __m128i *)mp);
+}
+
+/* expands the mask values to one 16-bit lane per component */
+static inline void FZ_TARGET_SSE2
+fz_unpack_mask_sse2(__m128i m, int n, __m128i *lo, __m128i *hi)
+{
+	m = _mm_unpacklo_epi8(m, _mm_setzero_si128());
+	if (n == 4)
+	{
+		m = _mm_unpacklo_epi16(m, m);
+		*lo = _mm_unpacklo_epi32(m, m);
+		*hi = _mm_unpackhi_epi32(m, m);
+	}
+	else
+	{
+		*lo = _mm_unpacklo_epi16(m, m);
+		*hi = _mm_unpackhi_epi16(m, m);
+	}
+}
+
+static inline __m128i FZ_TARGET_SSE2
+fz_solid_color_sse2(const byte *color, int n)
+{
+	if (n == 4)
+		return _mm_set1_epi32((int)(color[0] | (color[1] << 8) | (color[2] << 16) | 0xFF000000));
+	return _mm_set1_epi16((short)(color[0] | 0xFF00));
+}
+
+static inline int FZ_TARGET_SSE2
+fz_paint_solid_color_sse2(byte * restrict dp, int n, int w, byte *color)
+{
+	int sa = FZ_EXPAND(color[n-1]);
+	int px = 16 / n, i = 0;
+	__m128i zero = _mm_setzero_si128();
+	__m128i c = fz_solid_color_sse2(color, n);
+	__m128i c16 = _mm_unpacklo_epi8(c, zero);
+	__m128i a = _mm_set1_epi16((short)sa);
+	if (sa == 0)
+		return w;
+	if (sa == 256)
+	{
+		for (; i + px <= w; i += px, dp += 16)
+			_mm_storeu_si128((__m128i *)dp, c);
+		return i;
+	}
+	for (; i + px <= w; i += px, dp += 16)
+	{
+		__m128i d = _mm_loadu_si128((__m128i *)dp);
+		__m128i lo = fz_blend_sse2(c16, _mm_unpacklo_epi8(d, zero), a);
+		__m128i hi = fz_blend_sse2(c16, _mm_unpackhi_epi8(d, zero), a);
+		_mm_storeu_si128((__m128i *)dp, _mm_packus_epi16(lo, hi));
+	}
+	return i;
+}
+
+static inline int FZ_TARGET_SSE2
+fz_paint_span_with_color_sse2(byte * restrict dp, byte * restrict mp, int n, int w, byte *color)
+{
+	int sa = FZ_EXPAND(color[n-1]);
+	int px = 16 / n, i = 0;
+	int opaque = n == 4 ? 0x000F : 0x00FF;
+	__m128i zero = _mm_setzero_si128();
+	__m128i ones = _mm_cmpeq_epi8(zero, zero);
+	__m128i c = fz_solid_color_sse2(color, n);
+	__m128i c16 = _mm_unpacklo_epi8(c, zero);
+	__m128i a = _mm_set1_epi16((short)sa);
+	if (sa == 0)
+		return w;
+	for (; i + px <= w; i += px, dp += 16, mp += px)
+	{
+		__m128i m = fz_load_mask_sse2(mp, n);
+		__m128i d, mlo, mhi;
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(m, zero)) == 0xFFFF)
+			continue;
+		if (sa == 256 && (_mm_movemask_epi8(_mm_cmpeq_epi8(m, ones)) & opaque) == opaque)
+		{
+			_mm_storeu_si128((__m128i *)dp, c);
+			continue;
+		}
+		fz_unpack_mask_sse2(m, n, &mlo, &mhi);
+		mlo = fz_expand_sse2(mlo);
+		mhi = fz_expand_sse2(mhi);
+		if (sa != 256)
+		{
+			mlo = fz_combine_sse2(mlo, a);
+			mhi = fz_combine_sse2(mhi, a);
+		}
+		d = _mm_loadu_si128((__m128i *)dp);
+		mlo = fz_blend_sse2(c16, _mm_unpacklo_epi8(d, zero), mlo);
+		mhi = fz_blend_sse2(c16, _mm_unpackhi_epi8(d, zero), mhi);
+		_mm_storeu_si128((__m128i *)dp, _mm_packus_epi16(mlo, mhi));
+	}
+	return i;
+}
+
+/* FZ_COMBINE2(S, MA, D, FZ_EXPAND(255 - FZ_COMBINE(SA, MA))) truncated to a byte */
+static inline __m128i FZ_TARGET_SSE2
+fz_mask_over_sse2(__m128i s, __m128i d, __m128i ma, int n)
+{
+	__m128i masa = fz_expand_sse2(_mm_sub_epi16(_mm_set1_epi16(255), fz_combine_sse2(fz_alpha_sse2(s, n), ma)));
+	return _mm_and_si128(_mm_add_epi16(fz_combine_sse2(s, ma), fz_combine_sse2(d, masa)), _mm_set1_epi16(0xFF));
+}
+
+static inline int FZ_TARGET_SSE2
+fz_paint_span_with_mask_sse2(byte * restrict dp, byte * restrict sp, byte * restrict mp, int n, int w)
+{
+	int px = 16 / n, i = 0;
+	__m128i zero = _mm_setzero_si128();
+	for (; i + px <= w; i += px, dp += 16, sp += 16, mp += px)
+	{
+		__m128i m = fz_load_mask_sse2(mp, n);
+		__m128i s, d, mlo, mhi;
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(m, zero)) == 0xFFFF)
+			continue;
+		fz_unpack_mask_sse2(m, n, &mlo, &mhi);
+		s = _mm_loadu_si128((__m128i *)sp);
+		d = _mm_loadu_si128((__m128i *)dp);
+		mlo = fz_mask_over_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), fz_expand_sse2(mlo), n);
+		mhi = fz_mask_over_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), fz_expand_sse2(mhi), n);
+		_mm_storeu_si128((__m128i *)dp, _mm_packus_epi16(mlo, mhi));
+	}
+	return i;
+}
+
+static inline int FZ_TARGET_SSE2
+fz_paint_span_with_alpha_sse2(byte * restrict dp, byte * restrict sp, int n, int w, int alpha)
+{
+	int px = 16 / n, i = 0;
+	__m128i zero = _mm_setzero_si128();
+	__m128i a = _mm_set1_epi16((short)FZ_EXPAND(alpha));
+	for (; i + px <= w; i += px, dp += 16, sp += 16)
+	{
+		__m128i s = _mm_loadu_si128((__m128i *)sp);
+		__m128i d = _mm_loadu_si128((__m128i *)dp);
+		__m128i slo = _mm_unpacklo_epi8(s, zero);
+		__m128i shi = _mm_unpackhi_epi8(s, zero);
+		__m128i lo = fz_blend_sse2(slo, _mm_unpacklo_epi8(d, zero), fz_combine_sse2(fz_alpha_sse2(slo, n), a));
+		__m128i hi = fz_blend_sse2(shi, _mm_unpackhi_epi8(d, zero), fz_combine_sse2(fz_alpha_sse2(shi, n), a));
+		_mm_storeu_si128((__m128i *)dp, _mm_packus_epi16(lo, hi));
+	}
+	return i;
+}
+
+/* The AVX2 versions paint 32 bytes at once, widening each 16 byte half
+into one register of 16-bit lanes */
+
+static inline __m256i FZ_TARGET_AVX2
+fz_expand_avx2(__m256i a)
+{
+	return _mm256_add_epi16(a, _mm256_srli_epi16(a, 7));
+}
+
+static inline __m256i FZ_TARGET_AVX2
+fz_combine_avx2(__m256i a, __m256i b)
+{
+	return _mm256_srli_epi16(_mm256_mullo_epi16(a, b), 8);
+}
+
+static inline __m256i FZ_TARGET_AVX2
+fz_blend_avx2(__m256i src, __m256i dst, __m256i amount)
+{
+	return _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(src, dst), amount), _mm256_slli_epi16(dst, 8)), 8);
+}
+
+static inline __m256i FZ_TARGET_AVX2
+fz_alpha_avx2(__m256i a, int n)
+{
+	if (n == 4)
+		return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(a, 0xFF), 0xFF);
+	return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(a, 0xF5), 0xF5);
+}
+
+static inline __m256i FZ_TARGET_AVX2
+fz_load_lo_avx2(const byte *p)
+{
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+
+static inline __m256i FZ_TARGET_AVX2
+fz_load_hi_avx2(const byte *p)
+{
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p + 16)));
+}
+
+static inline void FZ_TARGET_AVX2
+fz_store_avx2(byte *p, __m256i lo, __m256i hi)
+{
+	/* _mm256_packus_epi16 packs within 128-bit lanes */
+	_mm256_storeu_si256((__m256i *)p, _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8));
+}
+
+/* loads the 32 / n mask values for one vector (the remaining bytes are 0) */
+static inline __m128i FZ_TARGET_AVX2
+fz_load_mask_avx2(const byte *mp, int n)
+{
+	if (n == 4)
+		return _mm_loadl_epi64((const __m128i *)mp);
+	return _mm_loadu_si128((const __m128i *)mp);
+}
+
+static inline void FZ_TARGET_AVX2
+fz_unpack_mask_avx2(__m128i m, int n, __m256i *lo, __m256i *hi)
+{
+	__m256i mm = _mm256_inserti128_si256(_mm256_castsi128_si256(m), m, 1);
+	if (n == 4)
+	{
+		*lo = _mm256_shuffle_epi8(mm, _mm256_setr_epi8(
+			0, -1, 0, -1, 0, -1, 0, -1, 1, -1, 1, -1, 1, -1, 1, -1,
+			2, -1, 2, -1, 2, -1, 2, -1, 3, -1, 3, -1, 3, -1, 3, -1));
+		*hi = _mm256_shuffle_epi8(mm, _mm256_setr_epi8(
+			4, -1, 4, -1, 4, -1, 4, -1, 5, -1, 5, -1, 5, -1, 5, -1,
+			6, -1, 6, -1, 6, -1, 6, -1, 7, -1, 7, -1, 7, -1, 7, -1));
+	}
+	else
+	{
+		*lo = _mm256_shuffle_epi8(mm, _mm256_setr_epi8(
+			0, -1, 0, -1, 1, -1, 1, -1, 2, -1, 2, -1, 3, -1, 3, -1,
+			4, -1, 4, -1, 5, -1, 5, -1, 6, -1, 6, -1, 7, -1, 7, -1));
+		*hi = _mm256_shuffle_epi8(mm, _mm256_setr_epi8(
+			8, -1, 8, -1, 9, -1, 9, -1, 10, -1, 10, -1, 11, -1, 11, -1,
+			12, -1, 12, -1, 13, -1, 13, -1, 14, -1, 14, -1, 15, -1, 15, -1));
+	}
+}
+
+static inline int FZ_TARGET_AVX2
+fz_paint_solid_color_avx2(byte * restrict dp, int n, int w, byte *color)
+{
+	int sa = FZ_EXPAND(color[n-1]);
+	int px = 32 / n, i = 0;
+	__m128i c = fz_solid_color_sse2(color, n);
+	__m256i c16 = _mm256_cvtepu8_epi16(c);
+	__m256i a = _mm256_set1_epi16((short)sa);
+	if (sa == 0)
+		return w;
+	if (sa == 256)
+	{
+		__m256i cc = _mm256_inserti128_si256(_mm256_castsi128_si256(c), c, 1);
+		for (; i + px <= w; i += px, dp += 32)
+			_mm256_storeu_si256((__m256i *)dp, cc);
+	}
+	else
+	{
+		for (; i + px <= w; i += px, dp += 32)
+		{
+			__m256i lo = fz_blend_avx2(c16, fz_load_lo_avx2(dp), a);
+			__m256i hi = fz_blend_avx2(c16, fz_load_hi_avx2(dp), a);
+			fz_store_avx2(dp, lo, hi);
+		}
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+static inline int FZ_TARGET_AVX2
+fz_paint_span_with_color_avx2(byte * restrict dp, byte * restrict mp, int n, int w, byte *color)
+{
+	int sa = FZ_EXPAND(color[n-1]);
+	int px = 32 / n, i = 0;
+	int opaque = n == 4 ? 0x00FF : 0xFFFF;
+	__m128i zero = _mm_setzero_si128();
+	__m128i ones = _mm_cmpeq_epi8(zero, zero);
+	__m128i c = fz_solid_color_sse2(color, n);
+	__m256i cc = _mm256_inserti128_si256(_mm256_castsi128_si256(c), c, 1);
+	__m256i c16 = _mm256_cvtepu8_epi16(c);
+	__m256i a = _mm256_set1_epi16((short)sa);
+	if (sa == 0)
+		return w;
+	for (; i + px <= w; i += px, dp += 32, mp += px)
+	{
+		__m128i m = fz_load_mask_avx2(mp, n);
+		__m256i mlo, mhi;
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(m, zero)) == 0xFFFF)
+			continue;
+		if (sa == 256 && (_mm_movemask_epi8(_mm_cmpeq_epi8(m, ones)) & opaque) == opaque)
+		{
+			_mm256_storeu_si256((__m256i *)dp, cc);
+			continue;
+		}
+		fz_unpack_mask_avx2(m, n, &mlo, &mhi);
+		mlo = fz_expand_avx2(mlo);
+		mhi = fz_expand_avx2(mhi);
+		if (sa != 256)
+		{
+			mlo = fz_combine_avx2(mlo, a);
+			mhi = fz_combine_avx2(mhi, a);
+		}
+		mlo = fz_blend_avx2(c16, fz_load_lo_avx2(dp), mlo);
+		mhi = fz_blend_avx2(c16, fz_load_hi_avx2(dp), mhi);
+		fz_store_avx2(dp, mlo, mhi);
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+static inline __m256i FZ_TARGET_AVX2
+fz_mask_over_avx2(__m256i s, __m256i d, __m256i ma, int n)
+{
+	__m256i masa = fz_expand_avx2(_mm256_sub_epi16(_mm256_set1_epi16(255), fz_combine_avx2(fz_alpha_avx2(s, n), ma)));
+	return _mm256_and_si256(_mm256_add_epi16(fz_combine_avx2(s, ma), fz_combine_avx2(d, masa)), _mm256_set1_epi16(0xFF));
+}
+
+static inline int FZ_TARGET_AVX2
+fz_paint_span_with_mask_avx2(byte * restrict dp, byte * restrict sp, byte * restrict mp, int n, int w)
+{
+	int px = 32 / n, i = 0;
+	__m128i zero = _mm_setzero_si128();
+	for (; i + px <= w; i += px, dp += 32, sp += 32, mp += px)
+	{
+		__m128i m = fz_load_mask_avx2(mp, n);
+		__m256i mlo, mhi;
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(m, zero)) == 0xFFFF)
+			continue;
+		fz_unpack_mask_avx2(m, n, &mlo, &mhi);
+		mlo = fz_mask_over_avx2(fz_load_lo_avx2(sp), fz_load_lo_avx2(dp), fz_expand_avx2(mlo), n);
+		mhi = fz_mask_over_avx2(fz_load_hi_avx2(sp), fz_load_hi_avx2(dp), fz_expand_avx2(mhi), n);
+		fz_store_avx2(dp, mlo, mhi);
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+static inline int FZ_TARGET_AVX2
+fz_paint_span_with_alpha_avx2(byte * restrict dp, byte * restrict sp, int n, int w, int alpha)
+{
+	int px = 32 / n, i = 0;
+	__m256i a = _mm256_set1_epi16((short)FZ_EXPAND(alpha));
+	for (; i + px <= w; i += px, dp += 32, sp += 32)
+	{
+		__m256i slo = fz_load_lo_avx2(sp);
+		__m256i shi = fz_load_hi_avx2(sp);
+		__m256i lo = fz_blend_avx2(slo, fz_load_lo_avx2(dp), fz_combine_avx2(fz_alpha_avx2(slo, n), a));
+		__m256i hi = fz_blend_avx2(shi, fz_load_hi_avx2(dp), fz_combine_avx2(fz_alpha_avx2(shi, n), a));
+		fz_store_avx2(dp, lo, hi);
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+#endif
+
+/* Each of these returns the number of pixels painted with the given SIMD level */
+
+static int
+fz_paint_solid_color_simd(byte * restrict dp, int n, int w, byte *color, int simd)
+{
+#ifdef FZ_DRAW_SIMD
+	if (n == 4 && simd == 2)
+		return fz_paint_solid_color_avx2(dp, 4, w, color);
+	if (n == 2 && simd == 2)
+		return fz_paint_solid_color_avx2(dp, 2, w, color);
+	if (n == 4 && simd == 1)
+		return fz_paint_solid_color_sse2(dp, 4, w, color);
+	if (n == 2 && simd == 1)
+		return fz_paint_solid_color_sse2(dp, 2, w, color);
+#endif
+	return 0;
+}
+
+static int
+fz_paint_span_with_color_simd(byte * restrict dp, byte * restrict mp, int n, int w, byte *color, int simd)
+{
+#ifdef FZ_DRAW_SIMD
+	if (n == 4 && simd == 2)
+		return fz_paint_span_with_color_avx2(dp, mp, 4, w, color);
+	if (n == 2 && simd == 2)
+		return fz_paint_span_with_color_avx2(dp, mp, 2, w, color);
+	if (n == 4 && simd == 1)
+		return fz_paint_span_with_color_sse2(dp, mp, 4, w, color);
+	if (n == 2 && simd == 1)
+		return fz_paint_span_with_color_sse2(dp, mp, 2, w, color);
+#endif
+	return 0;
+}
+
+static int
+fz_paint_span_with_mask_simd(byte * restrict dp, byte * restrict sp, byte * restrict mp, int n, int w, int simd)
+{
+#ifdef FZ_DRAW_SIMD
+	if (n == 4 && simd == 2)
+		return fz_paint_span_with_mask_avx2(dp, sp, mp, 4, w);
+	if (n == 2 && simd == 2)
+		return fz_paint_span_with_mask_avx2(dp, sp, mp, 2, w);
+	if (n == 4 && simd == 1)
+		return fz_paint_span_with_mask_sse2(dp, sp, mp, 4, w);
+	if (n == 2 && simd == 1)
+		return fz_paint_span_with_mask_sse2(dp, sp, mp, 2, w);
+#endif
+	return 0;
+}
+
+static int
+fz_paint_span_with_alpha_simd(byte * restrict dp, byte * restrict sp, int n, int w, int alpha, int simd)
+{
+#ifdef FZ_DRAW_SIMD
+	if (n == 4 && simd == 2)
+		return fz_paint_span_with_alpha_avx2(dp, sp, 4, w, alpha);
+	if (n == 2 && simd == 2)
+		return fz_paint_span_with_alpha_avx2(dp, sp, 2, w, alpha);
+	if (n == 4 && simd == 1)
+		return fz_paint_span_with_alpha_sse2(dp, sp, 4, w, alpha);
+	if (n == 2 && simd == 1)
+		return fz_paint_span_with_alpha_sse2(dp, sp, 2, w, alpha);
+#endif
+	return 0;
+}
+
 /* These are used by the non-aa scan converter */
 
 void
@@ -187,9 +683,12 @@ fz_paint_solid_color_N(byte * restrict dp, int n, int w, byte *color)
 	}
 }
 
-void
-fz_paint_solid_color(byte * restrict dp, int n, int w, byte *color)
+static void
+fz_paint_solid_color_imp(byte * restrict dp, int n, int w, byte *color, int simd)
 {
+	int done = fz_paint_solid_color_simd(dp, n, w, color, simd);
+	dp += done * n;
+	w -= done;
 	switch (n)
 	{
 	case 2: fz_paint_solid_color_2(dp, w, color); break;
@@ -198,6 +697,12 @@ fz_paint_solid_color(byte * restrict dp, int n, int w, byte *color)
 	}
 }
 
+void
+fz_paint_solid_color(byte * restrict dp, int n, int w, byte *color)
+{
+	fz_paint_solid_color_imp(dp, n, w, color, fz_paint_simd_level());
+}
+
 /* Blend a non-premultiplied color in mask over destination */
 
 static inline void
@@ -357,9 +862,13 @@ fz_paint_span_with_color_N(byte * restrict dp, byte * restrict mp, int n, int w,
 	}
 }
 
-void
-fz_paint_span_with_color(byte * restrict dp, byte * restrict mp, int n, int w, byte *color)
+static void
+fz_paint_span_with_color_imp(byte * restrict dp, byte * restrict mp, int n, int w, byte *color, int simd)
 {
+	int done = fz_paint_span_with_color_simd(dp, mp, n, w, color, simd);
+	dp += done * n;
+	mp += done;
+	w -= done;
 	switch (n)
 	{
 	case 2: fz_paint_span_with_color_2(dp, mp, w, color); break;
@@ -368,6 +877,12 @@ fz_paint_span_with_color(byte * restrict dp, byte * restrict mp, int n, int w, b
 	}
 }
 
+void
+fz_paint_span_with_color(byte * restrict dp, byte * restrict mp, int n, int w, byte *color)
+{
+	fz_paint_span_with_color_imp(dp, mp, n, w, color, fz_paint_simd_level());
+}
+
 /* Blend source in mask over destination */
 
 /* FIXME: There is potential for SWAR optimisation here */
@@ -516,8 +1031,13 @@ fz_paint_span_with_mask_N(byte * restrict dp, byte * restrict sp, byte * restric
 }
 
 static void
-fz_paint_span_with_mask(byte * restrict dp, byte * restrict sp, byte * restrict mp, int n, int w)
+fz_paint_span_with_mask_imp(byte * restrict dp, byte * restrict sp, byte * restrict mp, int n, int w, int simd)
 {
+	int done = fz_paint_span_with_mask_simd(dp, sp, mp, n, w, simd);
+	dp += done * n;
+	sp += done * n;
+	mp += done;
+	w -= done;
 	switch (n)
 	{
 	case 2: fz_paint_span_with_mask_2(dp, sp, mp, w); break;
@@ -526,6 +1046,12 @@ fz_paint_span_with_mask(byte * restrict dp, byte * restrict sp, byte * restrict
 	}
 }
 
+static void
+fz_paint_span_with_mask(byte * restrict dp, byte * restrict sp, byte * restrict mp, int n, int w)
+{
+	fz_paint_span_with_mask_imp(dp, sp, mp, n, w, fz_paint_simd_level());
+}
+
 /* Blend source in constant alpha over destination */
 
 static inline void
@@ -685,8 +1211,8 @@ fz_paint_span_N(byte * restrict dp, byte * restrict sp, int n, int w)
 	}
 }
 
-void
-fz_paint_span(byte * restrict dp, byte * restrict sp, int n, int w, int alpha)
+static void
+fz_paint_span_imp(byte * restrict dp, byte * restrict sp, int n, int w, int alpha, int simd)
 {
 	if (alpha == 255)
 	{
@@ -700,6 +1226,10 @@ fz_paint_span(byte * restrict dp, byte * restrict sp, int n, int w, int alpha)
 	}
 	else if (alpha > 0)
 	{
+		int done = fz_paint_span_with_alpha_simd(dp, sp, n, w, alpha, simd);
+		dp += done * n;
+		sp += done * n;
+		w -= done;
 		switch (n)
 		{
 		case 2: fz_paint_span_2_with_alpha(dp, sp, w, alpha); break;
@@ -709,6 +1239,53 @@ fz_paint_span(byte * restrict dp, byte * restrict sp, int n, int w, int alpha)
 	}
 }
 
+void
+fz_paint_span(byte * restrict dp, byte * restrict sp, int n, int w, int alpha)
+{
+	fz_paint_span_imp(dp, sp, n, w, alpha, fz_paint_simd_level());
+}
+
+/* SumatraPDF: allow comparing and benchmarking the SIMD span painters */
+
+static void
+fz_paint_kernel_solid_color(byte *dp, byte *sp, byte *mp, int n, int w, byte *color, int alpha, int simd)
+{
+	fz_paint_solid_color_imp(dp, n, w, color, simd);
+}
+
+static void
+fz_paint_kernel_span_with_color(byte *dp, byte *sp, byte *mp, int n, int w, byte *color, int alpha, int simd)
+{
+	fz_paint_span_with_color_imp(dp, mp, n, w, color, simd);
+}
+
+static void
+fz_paint_kernel_span_with_mask(byte *dp, byte *sp, byte *mp, int n, int w, byte *color, int alpha, int simd)
+{
+	fz_paint_span_with_mask_imp(dp, sp, mp, n, w, simd);
+}
+
+static void
+fz_paint_kernel_span_with_alpha(byte *dp, byte *sp, byte *mp, int n, int w, byte *color, int alpha, int simd)
+{
+	fz_paint_span_imp(dp, sp, n, w, alpha, simd);
+}
+
+static const fz_paint_kernel fz_paint_kernel_list[] =
+{
+	{ "solid_color", fz_paint_kernel_solid_color },
+	{ "span_with_color", fz_paint_kernel_span_with_color },
+	{ "span_with_mask", fz_paint_kernel_span_with_mask },
+	{ "span_with_alpha", fz_paint_kernel_span_with_alpha },
+};
+
+const fz_paint_kernel *
+fz_paint_kernels(int *count)
+{
+	*count = nelem(fz_paint_kernel_list);
+	return fz_paint_kernel_list;
+}
+
 /*
  * Pixmap blending functions
  */
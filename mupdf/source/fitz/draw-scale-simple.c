@@ -21,6 +21,11 @@ intermediate results rather than ints.
  */
 #define SINGLE_PIXEL_SPECIALS
 
+/* SumatraPDF: scale large images on several threads */
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
 #ifdef DEBUG_SCALING
 #ifdef WIN32
 #include <windows.h>
@@ -1059,6 +1064,199 @@ scale_row_from_temp(unsigned char *dst, unsigned char *src, fz_weights *weights,
 }
 #endif
 
+/* SumatraPDF: SSE2 versions of the horizontal (n == 2 and n == 4) and
+ * vertical filter passes. _mm_madd_epi16 multiplies pairs of samples with
+ * pairs of weights and adds them up in 32 bits, which gives exactly the
+ * same sums as the scalar code as long as all weights fit into 16 bits
+ * (see weights_fit_16bit). */
+#ifdef FZ_DRAW_SIMD
+
+static int
+weights_fit_16bit(fz_weights *weights)
+{
+	int j, k;
+
+	for (j = 0; j < weights->count; j++)
+	{
+		int *contrib = &weights->index[weights->index[j]];
+		int len = contrib[1];
+		for (k = 0; k < len; k++)
+		{
+			if (contrib[2+k] < -32768 || contrib[2+k] > 32767)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/* Returns w0 and w1 as alternating 16-bit lanes */
+static inline __m128i FZ_TARGET_SSE2
+weight_pair_sse2(int w0, int w1)
+{
+	return _mm_set1_epi32((int)(((unsigned int)w1 << 16) | ((unsigned int)w0 & 0xFFFF)));
+}
+
+/* (unsigned char)(val >> 8) for four 32-bit sums, in the lowest four bytes */
+static inline __m128i FZ_TARGET_SSE2
+pack_sums_sse2(__m128i val)
+{
+	val = _mm_and_si128(_mm_srai_epi32(val, 8), _mm_set1_epi32(0xFF));
+	val = _mm_packs_epi32(val, val);
+	return _mm_packus_epi16(val, val);
+}
+
+static void FZ_TARGET_SSE2
+scale_row_to_temp2_sse2(unsigned char *dst, unsigned char *src, fz_weights *weights)
+{
+	int *contrib = &weights->index[weights->index[0]];
+	int len, i, k, step = 2;
+	unsigned char *min;
+	__m128i zero = _mm_setzero_si128();
+
+	assert(weights->n == 2);
+	if (weights->flip)
+	{
+		dst += 2*(weights->count-1);
+		step = -2;
+	}
+	for (i=weights->count; i > 0; i--)
+	{
+		__m128i val = _mm_setzero_si128();
+		__m128i v;
+		int px;
+		min = &src[2 * *contrib++];
+		len = *contrib++;
+		/* 4 pixels g0 a0 g1 a1 g2 a2 g3 a3 become g0 g1 a0 a1 g2 g3 a2 a3 */
+		for (k = 0; k + 4 <= len; k += 4, min += 8, contrib += 4)
+		{
+			v = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)min), zero);
+			v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xD8), 0xD8);
+			v = _mm_madd_epi16(v, _mm_unpacklo_epi64(weight_pair_sse2(contrib[0], contrib[1]), weight_pair_sse2(contrib[2], contrib[3])));
+			val = _mm_add_epi32(val, v);
+		}
+		val = _mm_add_epi32(val, _mm_srli_si128(val, 8));
+		for (; k + 2 <= len; k += 2, min += 4, contrib += 2)
+		{
+			memcpy(&px, min, 4);
+			v = _mm_shufflelo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(px), zero), 0xD8);
+			val = _mm_add_epi32(val, _mm_madd_epi16(v, weight_pair_sse2(contrib[0], contrib[1])));
+		}
+		if (k < len)
+		{
+			v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(min[0] | (min[1] << 8)), zero);
+			v = _mm_shufflelo_epi16(v, 0xD8);
+			val = _mm_add_epi32(val, _mm_madd_epi16(v, weight_pair_sse2(contrib[0], 0)));
+			contrib++;
+		}
+		val = _mm_add_epi32(val, _mm_set1_epi32(128));
+		px = _mm_cvtsi128_si32(pack_sums_sse2(val));
+		dst[0] = (unsigned char)px;
+		dst[1] = (unsigned char)(px >> 8);
+		dst += step;
+	}
+}
+
+static void FZ_TARGET_SSE2
+scale_row_to_temp4_sse2(unsigned char *dst, unsigned char *src, fz_weights *weights)
+{
+	int *contrib = &weights->index[weights->index[0]];
+	int len, i, k, step = 4;
+	unsigned char *min;
+	__m128i zero = _mm_setzero_si128();
+
+	assert(weights->n == 4);
+	if (weights->flip)
+	{
+		dst += 4*(weights->count-1);
+		step = -4;
+	}
+	for (i=weights->count; i > 0; i--)
+	{
+		__m128i val = _mm_set1_epi32(128);
+		__m128i v;
+		int rgba;
+		min = &src[4 * *contrib++];
+		len = *contrib++;
+		/* 2 pixels r0 g0 b0 a0 r1 g1 b1 a1 become r0 r1 g0 g1 b0 b1 a0 a1 */
+		for (k = 0; k + 2 <= len; k += 2, min += 8, contrib += 2)
+		{
+			v = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)min), zero);
+			v = _mm_unpacklo_epi16(v, _mm_srli_si128(v, 8));
+			val = _mm_add_epi32(val, _mm_madd_epi16(v, weight_pair_sse2(contrib[0], contrib[1])));
+		}
+		if (k < len)
+		{
+			memcpy(&rgba, min, 4);
+			v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(rgba), zero);
+			v = _mm_unpacklo_epi16(v, zero);
+			val = _mm_add_epi32(val, _mm_madd_epi16(v, weight_pair_sse2(contrib[0], 0)));
+			contrib++;
+		}
+		rgba = _mm_cvtsi128_si32(pack_sums_sse2(val));
+		memcpy(dst, &rgba, 4);
+		dst += step;
+	}
+}
+
+static void FZ_TARGET_SSE2
+scale_row_from_temp_sse2(unsigned char *dst, unsigned char *src, fz_weights *weights, int width, int row)
+{
+	int *contrib = &weights->index[weights->index[row]];
+	int len, x, k;
+	__m128i zero = _mm_setzero_si128();
+	__m128i round = _mm_set1_epi32(128);
+	__m128i mask = _mm_set1_epi32(0xFF);
+
+	contrib++; /* Skip min */
+	len = *contrib++;
+	/* 16 columns at a time, interleaving two rows for _mm_madd_epi16 */
+	for (x = width; x >= 16; x -= 16)
+	{
+		__m128i v0 = round, v1 = round, v2 = round, v3 = round;
+		unsigned char *min = src;
+		for (k = 0; k < len; k += 2, min += 2*width)
+		{
+			__m128i row0 = _mm_loadu_si128((__m128i *)min);
+			__m128i row1 = zero;
+			__m128i w, lo, hi;
+			int w1 = 0;
+			if (k + 1 < len)
+			{
+				row1 = _mm_loadu_si128((__m128i *)(min + width));
+				w1 = contrib[k+1];
+			}
+			w = weight_pair_sse2(contrib[k], w1);
+			lo = _mm_unpacklo_epi8(row0, row1);
+			hi = _mm_unpackhi_epi8(row0, row1);
+			v0 = _mm_add_epi32(v0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w));
+			v1 = _mm_add_epi32(v1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w));
+			v2 = _mm_add_epi32(v2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w));
+			v3 = _mm_add_epi32(v3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w));
+		}
+		v0 = _mm_and_si128(_mm_srai_epi32(v0, 8), mask);
+		v1 = _mm_and_si128(_mm_srai_epi32(v1, 8), mask);
+		v2 = _mm_and_si128(_mm_srai_epi32(v2, 8), mask);
+		v3 = _mm_and_si128(_mm_srai_epi32(v3, 8), mask);
+		_mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3)));
+		dst += 16;
+		src += 16;
+	}
+	for (; x > 0; x--)
+	{
+		unsigned char *min = src;
+		int val = 128;
+		for (k = 0; k < len; k++)
+		{
+			val += *min * contrib[k];
+			min += width;
+		}
+		*dst++ = (unsigned char)(val>>8);
+		src++;
+	}
+}
+
+#endif /* FZ_DRAW_SIMD */
+
 #ifdef SINGLE_PIXEL_SPECIALS
 static void
 duplicate_single_pixel(unsigned char *dst, unsigned char *src, int n, int w, int h)
@@ -1206,6 +1404,145 @@ scale_single_col(unsigned char *dst, unsigned char *src, fz_weights *weights, in
 }
 #endif /* SINGLE_PIXEL_SPECIALS */
 
+/* SumatraPDF: scale large images in horizontal bands on several threads.
+ * Each band scales the source rows it needs into its own temporary
+ * buffer, so the bands only share (read-only) the source and the weights. */
+
+/* minimal number of output samples per band */
+#define SCALE_BAND_MIN_SIZE (1 << 19)
+#define SCALE_BAND_MAX_COUNT 8
+
+typedef struct fz_scale_band_s fz_scale_band;
+
+struct fz_scale_band_s
+{
+	fz_pixmap *src;
+	fz_pixmap *output;
+	fz_weights *contrib_rows;
+	fz_weights *contrib_cols;
+	void (*row_scale)(unsigned char *dst, unsigned char *src, fz_weights *weights);
+	void (*col_scale)(unsigned char *dst, unsigned char *src, fz_weights *weights, int width, int row);
+	unsigned char *temp;
+	int temp_span;
+	int temp_rows;
+	int flip_y;
+	int row0;
+	int row1;
+};
+
+static void
+scale_band(fz_scale_band *band)
+{
+	fz_pixmap *src = band->src;
+	fz_pixmap *output = band->output;
+	fz_weights *contrib_rows = band->contrib_rows;
+	unsigned char *temp = band->temp;
+	int temp_span = band->temp_span;
+	int temp_rows = band->temp_rows;
+	int row;
+	/* The temporary buffer is indexed by source row modulo temp_rows (as
+	 * expected by reorder_weights), so a band can start at any row. */
+	int max_row = contrib_rows->index[contrib_rows->index[band->row0]];
+
+	for (row = band->row0; row < band->row1; row++)
+	{
+		/*
+		Which source rows do we need to have scaled into the
+		temporary buffer in order to be able to do the final
+		scale?
+		*/
+		int row_index = contrib_rows->index[row];
+		int row_min = contrib_rows->index[row_index++];
+		int row_len = contrib_rows->index[row_index];
+		while (max_row < row_min+row_len)
+		{
+			/* Scale another row */
+			assert(max_row < src->h);
+			DBUG(("scaling row %d to temp\n", max_row));
+			(*band->row_scale)(&temp[temp_span*(max_row % temp_rows)], &src->samples[(band->flip_y ? (src->h-1-max_row): max_row)*src->w*src->n], band->contrib_cols);
+			max_row++;
+		}
+
+		DBUG(("scaling row %d from temp\n", row));
+		(*band->col_scale)(&output->samples[row*output->w*output->n], temp, contrib_rows, temp_span, row);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI
+scale_band_thread(LPVOID data)
+{
+	scale_band((fz_scale_band *)data);
+	return 0;
+}
+
+static int
+scale_band_cpu_count(void)
+{
+	static int cpu_count = 0;
+	if (!cpu_count)
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		cpu_count = info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+	}
+	return cpu_count;
+}
+#endif
+
+/* Runs all but the first band on separate threads (falling back to the
+ * calling thread if a thread can't be created) */
+static void
+scale_bands(fz_scale_band *bands, int count)
+{
+#ifdef _WIN32
+	HANDLE threads[SCALE_BAND_MAX_COUNT];
+	int i;
+
+	for (i = 1; i < count; i++)
+	{
+		threads[i] = CreateThread(NULL, 0, scale_band_thread, &bands[i], 0, NULL);
+		if (!threads[i])
+			scale_band(&bands[i]);
+	}
+	scale_band(&bands[0]);
+	for (i = 1; i < count; i++)
+	{
+		if (threads[i])
+		{
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+		}
+	}
+#else
+	int i;
+
+	for (i = 0; i < count; i++)
+		scale_band(&bands[i]);
+#endif
+}
+
+/* Returns the number of bands to use for an output of the given size */
+static int
+scale_band_count(int max_bands, int w, int h, int n)
+{
+	int count = max_bands;
+#ifdef _WIN32
+	if (count <= 0 || count > scale_band_cpu_count())
+		count = scale_band_cpu_count();
+#else
+	if (count <= 0)
+		count = 1;
+#endif
+	if (count > SCALE_BAND_MAX_COUNT)
+		count = SCALE_BAND_MAX_COUNT;
+	if ((float)w * h * n / count < SCALE_BAND_MIN_SIZE)
+		count = (int)((float)w * h * n / SCALE_BAND_MIN_SIZE);
+	if (count > h)
+		count = h;
+	return count > 1 ? count : 1;
+}
+
 fz_pixmap *
 fz_scale_pixmap(fz_context *ctx, fz_pixmap *src, float x, float y, float w, float h, fz_irect *clip)
 {
@@ -1214,19 +1551,26 @@ fz_scale_pixmap(fz_context *ctx, fz_pixmap *src, float x, float y, float w, floa
 
 fz_pixmap *
 fz_scale_pixmap_cached(fz_context *ctx, fz_pixmap *src, float x, float y, float w, float h, const fz_irect *clip, fz_scale_cache *cache_x, fz_scale_cache *cache_y)
+{
+	return fz_scale_pixmap_tuned(ctx, src, x, y, w, h, clip, cache_x, cache_y, fz_paint_simd_level(), 0);
+}
+
+fz_pixmap *
+fz_scale_pixmap_tuned(fz_context *ctx, fz_pixmap *src, float x, float y, float w, float h, const fz_irect *clip, fz_scale_cache *cache_x, fz_scale_cache *cache_y, int simd, int max_bands)
 {
 	fz_scale_filter *filter = &fz_scale_filter_simple;
 	fz_weights *contrib_rows = NULL;
 	fz_weights *contrib_cols = NULL;
 	fz_pixmap *output = NULL;
-	unsigned char *temp = NULL;
-	int max_row, temp_span, temp_rows, row;
+	fz_scale_band bands[SCALE_BAND_MAX_COUNT];
+	int band_count, temp_span, temp_rows, row, i;
 	int dst_w_int, dst_h_int, dst_x_int, dst_y_int;
 	int flip_x, flip_y;
 	fz_rect patch;
 
 	fz_var(contrib_cols);
 	fz_var(contrib_rows);
+	fz_var(bands);
 
 	DBUG(("Scale: (%d,%d) to (%g,%g) at (%g,%g)\n",src->w,src->h,w,h,x,y));
 
@@ -1430,23 +1774,34 @@ fz_scale_pixmap_cached(fz_context *ctx, fz_pixmap *src, float x, float y, float
 #endif /* SINGLE_PIXEL_SPECIALS */
 	{
 		void (*row_scale)(unsigned char *dst, unsigned char *src, fz_weights *weights);
+		void (*col_scale)(unsigned char *dst, unsigned char *src, fz_weights *weights, int width, int row);
 
 		temp_span = contrib_cols->count * src->n;
 		temp_rows = contrib_rows->max_len;
 		if (temp_span <= 0 || temp_rows > INT_MAX / temp_span)
 			goto cleanup;
+		band_count = scale_band_count(max_bands, output->w, output->h, output->n);
+		memset(bands, 0, sizeof(bands));
 		fz_try(ctx)
 		{
-			temp = fz_calloc(ctx, temp_span*temp_rows, sizeof(unsigned char));
+			for (i = 0; i < band_count; i++)
+				bands[i].temp = fz_calloc(ctx, temp_span*temp_rows, sizeof(unsigned char));
 		}
 		fz_catch(ctx)
 		{
-			fz_drop_pixmap(ctx, output);
-			if (!cache_x)
-				fz_free(ctx, contrib_cols);
-			if (!cache_y)
-				fz_free(ctx, contrib_rows);
-			fz_rethrow(ctx);
+			/* Use fewer bands if there isn't enough memory for all of them */
+			if (!bands[0].temp)
+			{
+				fz_drop_pixmap(ctx, output);
+				if (!cache_x)
+					fz_free(ctx, contrib_cols);
+				if (!cache_y)
+					fz_free(ctx, contrib_rows);
+				fz_rethrow(ctx);
+			}
+			for (i = 1; i < band_count && bands[i].temp; i++)
+				;
+			band_count = i;
 		}
 		switch (src->n)
 		{
@@ -1463,30 +1818,35 @@ fz_scale_pixmap_cached(fz_context *ctx, fz_pixmap *src, float x, float y, float
 			row_scale = scale_row_to_temp4;
 			break;
 		}
-		max_row = contrib_rows->index[contrib_rows->index[0]];
-		for (row = 0; row < contrib_rows->count; row++)
+		col_scale = scale_row_from_temp;
+#ifdef FZ_DRAW_SIMD
+		if (simd > 0 && weights_fit_16bit(contrib_cols) && weights_fit_16bit(contrib_rows))
 		{
-			/*
-			Which source rows do we need to have scaled into the
-			temporary buffer in order to be able to do the final
-			scale?
-			*/
-			int row_index = contrib_rows->index[row];
-			int row_min = contrib_rows->index[row_index++];
-			int row_len = contrib_rows->index[row_index];
-			while (max_row < row_min+row_len)
-			{
-				/* Scale another row */
-				assert(max_row < src->h);
-				DBUG(("scaling row %d to temp\n", max_row));
-				(*row_scale)(&temp[temp_span*(max_row % temp_rows)], &src->samples[(flip_y ? (src->h-1-max_row): max_row)*src->w*src->n], contrib_cols);
-				max_row++;
-			}
-
-			DBUG(("scaling row %d from temp\n", row));
-			scale_row_from_temp(&output->samples[row*output->w*output->n], temp, contrib_rows, temp_span, row);
+			if (src->n == 2)
+				row_scale = scale_row_to_temp2_sse2;
+			else if (src->n == 4)
+				row_scale = scale_row_to_temp4_sse2;
+			col_scale = scale_row_from_temp_sse2;
+		}
+#endif
+		for (i = 0, row = 0; i < band_count; i++)
+		{
+			bands[i].src = src;
+			bands[i].output = output;
+			bands[i].contrib_rows = contrib_rows;
+			bands[i].contrib_cols = contrib_cols;
+			bands[i].row_scale = row_scale;
+			bands[i].col_scale = col_scale;
+			bands[i].temp_span = temp_span;
+			bands[i].temp_rows = temp_rows;
+			bands[i].flip_y = flip_y;
+			bands[i].row0 = row;
+			row = (int)((int64_t)contrib_rows->count * (i + 1) / band_count);
+			bands[i].row1 = row;
 		}
-		fz_free(ctx, temp);
+		scale_bands(bands, band_count);
+		for (i = 0; i < band_count; i++)
+			fz_free(ctx, bands[i].temp);
 	}
 
 cleanup:
@@ -79,8 +79,15 @@ static inline unsigned int read_value(const unsigned char *data, int bytes)
 	return value;
 }
 
+/* SumatraPDF: allow decoding images at a reduced resolution (1/2^reduce) */
 fz_pixmap *
 fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs, int indexed)
+{
+	return fz_load_jpx_reduced(ctx, data, size, defcs, indexed, 0);
+}
+
+fz_pixmap *
+fz_load_jpx_reduced(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs, int indexed, int reduce)
 {
 	fz_pixmap *img;
 	opj_dparameters_t params;
@@ -106,6 +113,8 @@ fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs
 	opj_set_default_decoder_parameters(&params);
 	if (indexed)
 		params.flags |= OPJ_DPARAMETERS_IGNORE_PCLR_CMAP_CDEF_FLAG;
+	/* SumatraPDF: allow decoding images at a reduced resolution */
+	params.cp_reduce = reduce;
 
 	codec = opj_create_decompress(format);
 	opj_set_info_handler(codec, fz_opj_info_callback, ctx);
@@ -94,6 +94,8 @@ pdf_parse_link_dest(pdf_document *doc, fz_link_kind kind, pdf_obj *dest)
 		}
 		fz_catch(doc->ctx)
 		{
+			/* SumatraPDF: allow retrying with doc->page_objs */
+			doc->page_lookup_failed = 1;
 			ld.kind = FZ_LINK_NONE;
 			return ld;
 		}
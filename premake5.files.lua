@@ -475,6 +475,7 @@ function utils_files()
     "TrivialHtmlParser.*",
     "TxtParser.*",
     "UITask.*",
+    "VarintGob.*",
     "ZipUtil.*",
     "WebpReader.*",
     "WinDynCalls.*",
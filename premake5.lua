@@ -400,7 +400,7 @@ workspace "SumatraPDF"
     engine_dump_files()
     links { "engines", "utils", "mupdf", "unarrlib", "libwebp", "libdjvu" }
     links {
-      "comctl32", "gdiplus", "msimg32", "shlwapi",
+      "comctl32", "gdiplus", "msimg32", "psapi", "shlwapi",
       "version", "windowscodecs"
     }
 
@@ -451,6 +451,19 @@ GlobalPrefs = [
 		"actual resolution of the main screen in DPI (if this value " +
 		" isn't positive, the system's UI setting is used)",
 		expert=True, version="2.5"),
+	Field("RenderCacheSize", Int, 256,
+		"maximum amount of memory (in MB) used for caching rendered pages (if this value " +
+		"isn't positive, the default of 256 MB is used)",
+		expert=True, version="3.2"),
+	Field("PageRunCacheSize", Int, 40,
+		"maximum amount of memory (in MB) used per PDF document for caching parsed page " +
+		"content so that pages can be rendered again more quickly (if this value isn't " +
+		"positive, the default of 40 MB is used)",
+		expert=True, version="3.2"),
+	Field("CacheExtractedText", Bool, False,
+		"if true, the text extracted from documents for searching and selecting is cached on disk " +
+		"so that it doesn't have to be extracted again when a document is reopened",
+		expert=True, version="3.2"),
 	EmptyLine(),
 
 	Field("RememberStatePerDocument", Bool, True,
@@ -10,6 +10,7 @@
 // rendering engines
 #include "BaseEngine.h"
 #include "EbookEngine.h"
+#include "PdfEngine.h"
 // layout controllers
 #include "SettingsStructs.h"
 #include "FileHistory.h"
@@ -112,6 +113,7 @@ bool Load()
     // TODO: verify that all states have a non-nullptr file path?
     gFileHistory.UpdateStatesSource(gGlobalPrefs->fileStates);
     SetDefaultEbookFont(gGlobalPrefs->ebookUI.fontName, gGlobalPrefs->ebookUI.fontSize);
+    PdfEngine::SetPageRunCacheSize((size_t)std::max(gGlobalPrefs->pageRunCacheSize, 0) * 1024 * 1024);
 
     if (!file::Exists(path))
         Save();
@@ -224,6 +224,12 @@ public:
     virtual const WCHAR *FileName() const = 0;
     // number of pages the loaded document contains
     virtual int PageCount() const = 0;
+    // engines which paginate in the background (cf. EbookEngine) return an estimate
+    // from PageCount until they're done and then call onPageCountChanged once
+    // (from a background thread; immediately, if they're already done)
+    virtual void SetPageCountChangedCallback(const std::function<void()>& onPageCountChanged) {
+        UNUSED(onPageCountChanged);
+    }
 
     // the box containing the visible page content (usually RectD(0, 0, pageWidth, pageHeight))
     virtual RectD PageMediabox(int pageNo) = 0;
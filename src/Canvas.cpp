@@ -680,6 +680,9 @@ static void DrawDocument(WindowInfo& win, HDC hdc, RECT *rcArea)
     if (win.fwdSearchMark.show)
         PaintForwardSearchMark(&win, hdc);
 
+    if (win.findAllMarks.rects.Count() > 0)
+        PaintFindAllMarks(&win, hdc);
+
     if (!rendering)
         DebugShowLinks(*dm, hdc);
 }
@@ -20,8 +20,12 @@ public:
     virtual void Repaint() = 0;
     virtual void UpdateScrollbars(SizeI canvas) = 0;
     virtual void RequestRendering(int pageNo) = 0;
+    // tell the UI to stop rendering pages which are no longer visible
+    virtual void AbortInvisibleRendering(DisplayModel *dm) = 0;
     virtual void CleanUp(DisplayModel *dm) = 0;
     virtual void RenderThumbnail(DisplayModel *dm, SizeI size, const std::function<void(RenderedBitmap*)>&) = 0;
+    // tell the UI that the engine's final page count is known (cf. DisplayModel::UpdatePageCount)
+    virtual void PageCountChanged(DisplayModel *dm) = 0;
     // ChmModel //
     // tell the UI to move focus back to the main window
     // (if always == false, then focus is only moved if it's inside
@@ -146,7 +146,7 @@ static int LastPageInARowNo(int pageNo, int columns, bool showCover, int pageCou
 
 // must call SetInitialViewSettings() after creation
 DisplayModel::DisplayModel(BaseEngine *engine, EngineType type, ControllerCallback *cb) :
-    Controller(cb), engine(engine),
+    Controller(cb), engine(engine), pageCount(0),
     userAnnots(nullptr), userAnnotsModified(false), engineType(type), pdfSync(nullptr),
     pagesInfo(nullptr), displayMode(DM_AUTOMATIC), startPage(1),
     zoomReal(INVALID_ZOOM), zoomVirtual(INVALID_ZOOM),
@@ -156,6 +156,7 @@ DisplayModel::DisplayModel(BaseEngine *engine, EngineType type, ControllerCallba
     dontRenderFlag(false)
 {
     CrashIf(!engine || engine->PageCount() <= 0);
+    pageCount = engine->PageCount();
 
     if (!engine->IsImageCollection()) {
         windowMargin = gGlobalPrefs->fixedPageUI.windowMargin;
@@ -174,10 +175,13 @@ DisplayModel::DisplayModel(BaseEngine *engine, EngineType type, ControllerCallba
     textCache = new PageTextCache(engine);
     textSelection = new TextSelection(engine, textCache);
     textSearch = new TextSearch(engine, textCache);
+
+    engine->SetPageCountChangedCallback([=] { this->cb->PageCountChanged(this); });
 }
 
 DisplayModel::~DisplayModel()
 {
+    engine->SetPageCountChangedCallback(nullptr);
     dontRenderFlag = true;
     cb->CleanUp(this);
 
@@ -224,6 +228,39 @@ void DisplayModel::SetInitialViewSettings(DisplayMode newDisplayMode, int newSta
     BuildPagesInfo();
 }
 
+void DisplayModel::UpdatePageCount()
+{
+    int newPageCount = engine->PageCount();
+    if (newPageCount == pageCount || newPageCount <= 0)
+        return;
+
+    ScrollState ss = GetScrollState();
+    if (ss.page > newPageCount) {
+        ss.page = newPageCount;
+        ss.x = ss.y = -1;
+    }
+    for (ScrollState& navPt : navHistory) {
+        navPt.page = std::min(navPt.page, newPageCount);
+    }
+    startPage = std::min(startPage, newPageCount);
+    // the rendering thread mustn't access pagesInfo or textCache while they're resized
+    cb->CleanUp(this);
+    pageCount = newPageCount;
+
+    // text selections and searches are sized by the page count as well
+    delete textSearch;
+    delete textSelection;
+    textCache->UpdatePageCount();
+    textSelection = new TextSelection(engine, textCache);
+    textSearch = new TextSearch(engine, textCache);
+
+    free(pagesInfo);
+    pagesInfo = nullptr;
+    BuildPagesInfo();
+    Relayout(zoomVirtual, rotation);
+    SetScrollState(ss);
+}
+
 void DisplayModel::BuildPagesInfo()
 {
     AssertCrash(!pagesInfo);
@@ -828,6 +865,9 @@ bool DisplayModel::IsOverText(PointI pt)
 
 void DisplayModel::RenderVisibleParts()
 {
+    // the view port has changed, so stop rendering tiles which are no longer needed
+    cb->AbortInvisibleRendering(this);
+
     int firstVisiblePage = 0;
     int lastVisiblePage = 0;
 
@@ -65,7 +65,7 @@ public:
     // meta data
     virtual const WCHAR *FilePath() const { return engine->FileName(); }
     virtual const WCHAR *DefaultFileExt() const { return engine->GetDefaultFileExt(); }
-    virtual int PageCount() const { return engine->PageCount(); }
+    virtual int PageCount() const { return pageCount; }
     virtual WCHAR *GetProperty(DocumentProperty prop) { return engine->GetProperty(prop); }
 
     // page navigation (stateful)
@@ -102,7 +102,7 @@ public:
     virtual int GetPageByLabel(const WCHAR *label) const { return engine->GetPageByLabel(label); }
 
     // common shortcuts
-    virtual bool ValidPageNo(int pageNo) const { return 1 <= pageNo && pageNo <= engine->PageCount(); }
+    virtual bool ValidPageNo(int pageNo) const { return 1 <= pageNo && pageNo <= pageCount; }
     virtual bool GoToNextPage();
     virtual bool GoToPrevPage(bool toBottom=false) { return GoToPrevPage(toBottom ? -1 : 0); }
     virtual bool GoToFirstPage();
@@ -175,6 +175,8 @@ public:
     void            CopyNavHistory(DisplayModel& orig);
 
     void            SetInitialViewSettings(DisplayMode displayMode, int newStartPage, SizeI viewPort, int screenDPI);
+    // must be called on the UI thread after the engine's page count has changed
+    void            UpdatePageCount();
     void            SetDisplayR2L(bool r2l) { displayR2L = r2l; }
     bool            GetDisplayR2L() const { return displayR2L; }
 
@@ -205,6 +207,8 @@ protected:
 
     BaseEngine *    engine;
 
+    /* engine->PageCount() might only be an estimate until UpdatePageCount */
+    int             pageCount;
     /* an array of PageInfo, len of array is pageCount */
     PageInfo *      pagesInfo;
 
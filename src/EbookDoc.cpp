@@ -95,6 +95,54 @@ static char *DecodeTextToUtf8(const char *s, bool isXML=false)
     return str::ToMultiByte(s, codePage, CP_UTF8);
 }
 
+// files without a BOM can be used unconverted, if they're valid UTF-8
+// and don't declare a different encoding (cf. DecodeTextToUtf8)
+static bool IsStreamableUtf8(const char *s)
+{
+    UINT codePage = GetCodepageFromPI(s);
+    return (CP_ACP == codePage || CP_UTF8 == codePage) && IsValidUtf8(s);
+}
+
+// decompresses a file straight into dest if it's already UTF-8 encoded (as most
+// EPUB sections are) so that no intermediary copy of the file is needed
+// if the file has to be converted first, returns false with its content in data
+// (or with data = nullptr if the file can't be streamed at all)
+static bool ExtractUtf8XmlInto(ArchFile& archive, size_t fileindex, str::Str<char>& dest, ScopedMem<char>& data)
+{
+    ArchFileStream stream(&archive, fileindex);
+    if (!stream.IsValid())
+        return false;
+    size_t start = dest.Size();
+    size_t size = stream.GetSize();
+    char *s = dest.AppendBlanksChecked(size);
+    if (!s)
+        return false;
+    if (stream.Read(s, size) != size) {
+        dest.RemoveAt(start, size);
+        return false;
+    }
+    // dest is zero-terminated, so s can be treated like the result of GetFileDataByIdx
+    if (str::StartsWith(s, UTF8_BOM)) {
+        dest.RemoveAt(start, 3);
+        s = dest.Get() + start;
+        size -= 3;
+    }
+    else if (str::StartsWith(s, UTF16BE_BOM) || str::StartsWith(s, UTF16_BOM) ||
+             !IsStreamableUtf8(s)) {
+        // zero-terminate for UTF-16 as well
+        data.Set((char *)calloc(size + 3, 1));
+        if (data)
+            memcpy(data, s, size);
+        dest.RemoveAt(start, size);
+        return false;
+    }
+    // DecodeTextToUtf8 stops at the first embedded NUL as well
+    size_t len = str::Len(s);
+    if (len < size)
+        dest.RemoveAt(start + len, size - len);
+    return true;
+}
+
 char *NormalizeURL(const char *url, const char *base)
 {
     CrashIf(!url || !base);
@@ -231,15 +279,21 @@ const char *EPUB_NCX_NS = "http://www.daisy.org/z3986/2005/ncx/";
 const char *EPUB_ENC_NS = "http://www.w3.org/2001/04/xmlenc#";
 
 EpubDoc::EpubDoc(const WCHAR *fileName) :
-    zip(fileName, true), fileName(str::Dup(fileName)),
-    isNcxToc(false), isRtlDoc(false) {
+    zipData(nullptr), zipDataLen(0), zip(nullptr),
+    fileName(str::Dup(fileName)), isNcxToc(false), isRtlDoc(false) {
     InitializeCriticalSection(&zipAccess);
+    // read the file into memory once so that additional archive cursors
+    // don't each have to read the (compressed) resources from disk
+    zipData = file::ReadAll(fileName, &zipDataLen);
+    zip = AcquireZip();
 }
 
 EpubDoc::EpubDoc(IStream *stream) :
-    zip(stream, true), fileName(nullptr),
-    isNcxToc(false), isRtlDoc(false) {
+    zipData(nullptr), zipDataLen(0), zip(nullptr),
+    fileName(nullptr), isNcxToc(false), isRtlDoc(false) {
     InitializeCriticalSection(&zipAccess);
+    zipData = (const char *)GetDataFromStream(stream, &zipDataLen);
+    zip = AcquireZip();
 }
 
 EpubDoc::~EpubDoc()
@@ -250,14 +304,39 @@ EpubDoc::~EpubDoc()
         free(images.At(i).base.data);
         free(images.At(i).id);
     }
+    DeleteVecMembers(allZips);
+    free((void *)zipData);
 
     LeaveCriticalSection(&zipAccess);
     DeleteCriticalSection(&zipAccess);
 }
 
+// returns an archive cursor for exclusive use by the calling thread
+// until it's handed back through ReleaseZip
+ZipFile *EpubDoc::AcquireZip()
+{
+    {
+        ScopedCritSec scope(&zipAccess);
+        if (idleZips.Count() > 0)
+            return idleZips.Pop();
+    }
+    // all cursors are in use, so create another one over the same data
+    // (only reading the central directory is required for that)
+    ZipFile *zipCursor = new ZipFile(zipData, zipDataLen, true);
+    ScopedCritSec scope(&zipAccess);
+    allZips.Append(zipCursor);
+    return zipCursor;
+}
+
+void EpubDoc::ReleaseZip(ZipFile *zipCursor)
+{
+    ScopedCritSec scope(&zipAccess);
+    idleZips.Append(zipCursor);
+}
+
 bool EpubDoc::Load()
 {
-    ScopedMem<char> container(zip.GetFileDataByName(L"META-INF/container.xml"));
+    ScopedMem<char> container(zip->GetFileDataByName(L"META-INF/container.xml"));
     if (!container)
         return false;
     HtmlParser parser;
@@ -275,7 +354,7 @@ bool EpubDoc::Load()
 
     // encrypted files will be ignored (TODO: support decryption)
     WStrList encList;
-    ScopedMem<char> encryption(zip.GetFileDataByName(L"META-INF/encryption.xml"));
+    ScopedMem<char> encryption(zip->GetFileDataByName(L"META-INF/encryption.xml"));
     if (encryption) {
         (void)parser.ParseInPlace(encryption);
         HtmlElement *cr = parser.FindElementByNameNS("CipherReference", EPUB_ENC_NS);
@@ -289,7 +368,7 @@ bool EpubDoc::Load()
         }
     }
 
-    ScopedMem<char> content(zip.GetFileDataByName(contentPath));
+    ScopedMem<char> content(zip->GetFileDataByName(contentPath));
     if (!content)
         return false;
     ParseMetadata(content);
@@ -323,7 +402,7 @@ bool EpubDoc::Load()
             // load the image lazily
             ImageData2 data = { 0 };
             data.id = str::conv::ToUtf8(imgPath);
-            data.idx = zip.GetFileIndex(imgPath);
+            data.idx = zip->GetFileIndex(imgPath);
             images.Append(data);
         }
         else if (str::Eq(mediatype, L"application/xhtml+xml") ||
@@ -370,19 +449,25 @@ bool EpubDoc::Load()
             continue;
 
         ScopedMem<WCHAR> fullPath(str::Join(contentPath, pathList.At(idList.Find(idref))));
-        ScopedMem<char> html(zip.GetFileDataByName(fullPath));
-        if (!html)
-            continue;
-        html.Set(DecodeTextToUtf8(html, true));
-        if (!html)
-            continue;
         // insert explicit page-breaks between sections including
         // an anchor with the file name at the top (for internal links)
         ScopedMem<char> utf8_path(str::conv::ToUtf8(fullPath));
         CrashIfDebugOnly(str::FindChar(utf8_path, '"'));
         str::TransChars(utf8_path, "\"", "'");
+        size_t sectionStart = htmlData.Size();
         htmlData.AppendFmt("<pagebreak page_path=\"%s\" page_marker />", utf8_path.Get());
-        htmlData.Append(html);
+
+        ScopedMem<char> html;
+        if (ExtractUtf8XmlInto(*zip, zip->GetFileIndex(fullPath), htmlData, html))
+            continue;
+        if (!html)
+            html.Set(zip->GetFileDataByName(fullPath));
+        if (html)
+            html.Set(DecodeTextToUtf8(html, true));
+        if (html)
+            htmlData.Append(html);
+        else
+            htmlData.RemoveAt(sectionStart, htmlData.Size() - sectionStart);
     }
 
     return htmlData.Count() > 0;
@@ -441,10 +526,53 @@ size_t EpubDoc::GetHtmlDataSize() const
     return htmlData.Size();
 }
 
-ImageData *EpubDoc::GetImageData(const char *id, const char *pagePath)
+// returns the index of the first image (at or after startAt) with the given id or -1
+// caller must hold zipAccess
+int EpubDoc::FindImage(const char *id, bool partialMatch, size_t startAt)
+{
+    for (size_t i = startAt; i < images.Count(); i++) {
+        const char *imgId = images.At(i).id;
+        if (partialMatch ? str::EndsWithI(imgId, id) : str::Eq(imgId, id))
+            return (int)i;
+    }
+    return -1;
+}
+
+// extracts images.At(imageIdx) on first access
+// caller must not hold zipAccess so that other threads can extract at the same time
+ImageData *EpubDoc::LoadImage(size_t imageIdx)
 {
+    size_t fileIdx;
+    {
+        ScopedCritSec scope(&zipAccess);
+        ImageData2 *img = &images.At(imageIdx);
+        if (img->base.data)
+            return &img->base;
+        fileIdx = img->idx;
+    }
+
+    size_t len;
+    ZipFile *zipCursor = AcquireZip();
+    char *data = zipCursor->GetFileDataByIdx(fileIdx, &len);
+    ReleaseZip(zipCursor);
+    if (!data)
+        return nullptr;
+
     ScopedCritSec scope(&zipAccess);
+    ImageData2 *img = &images.At(imageIdx);
+    // another thread might have extracted the same image in the meantime
+    if (img->base.data) {
+        free(data);
+    }
+    else {
+        img->base.data = data;
+        img->base.len = len;
+    }
+    return &img->base;
+}
 
+ImageData *EpubDoc::GetImageData(const char *id, const char *pagePath)
+{
     if (!pagePath) {
         CrashIf(true);
         // if we're reparsing, we might not have pagePath, which is needed to
@@ -454,46 +582,56 @@ ImageData *EpubDoc::GetImageData(const char *id, const char *pagePath)
         // styling related state (such as nextPageStyle, listDepth, etc. including
         // format specific state such as hiddenDepth and titleCount) and store it
         // in every HtmlPage, but this should work well enough for now
-        for (size_t i = 0; i < images.Count(); i++) {
-            ImageData2 *img = &images.At(i);
-            if (str::EndsWithI(img->id, id)) {
-                if (!img->base.data)
-                    img->base.data = zip.GetFileDataByIdx(img->idx, &img->base.len);
-                if (img->base.data)
-                    return &img->base;
+        for (int idx = -1;;) {
+            {
+                ScopedCritSec scope(&zipAccess);
+                idx = FindImage(id, true, idx + 1);
             }
+            if (-1 == idx)
+                return nullptr;
+            ImageData *data = LoadImage(idx);
+            if (data)
+                return data;
         }
-        return nullptr;
     }
 
     ScopedMem<char> url(NormalizeURL(id, pagePath));
     // some EPUB producers use wrong path separators
     if (str::FindChar(url, '\\'))
         str::TransChars(url, "\\", "/");
-    for (size_t i = 0; i < images.Count(); i++) {
-        ImageData2 *img = &images.At(i);
-        if (str::Eq(img->id, url)) {
-            if (!img->base.data)
-                img->base.data = zip.GetFileDataByIdx(img->idx, &img->base.len);
-            if (img->base.data)
-                return &img->base;
+    for (int idx = -1;;) {
+        {
+            ScopedCritSec scope(&zipAccess);
+            idx = FindImage(url, false, idx + 1);
         }
+        if (-1 == idx)
+            break;
+        ImageData *data = LoadImage(idx);
+        if (data)
+            return data;
     }
 
     // try to also load images which aren't registered in the manifest
     ImageData2 data = { 0 };
     ScopedMem<WCHAR> imgPath(str::conv::FromUtf8(url));
-    data.idx = zip.GetFileIndex(imgPath);
-    if (data.idx != (size_t)-1) {
-        data.base.data = zip.GetFileDataByIdx(data.idx, &data.base.len);
-        if (data.base.data) {
-            data.id = str::Dup(url);
-            images.Append(data);
-            return &images.Last().base;
-        }
-    }
+    ZipFile *zipCursor = AcquireZip();
+    data.idx = zipCursor->GetFileIndex(imgPath);
+    if (data.idx != (size_t)-1)
+        data.base.data = zipCursor->GetFileDataByIdx(data.idx, &data.base.len);
+    ReleaseZip(zipCursor);
+    if (!data.base.data)
+        return nullptr;
 
-    return nullptr;
+    ScopedCritSec scope(&zipAccess);
+    // another thread might have added the same image in the meantime
+    int idx = FindImage(url, false);
+    if (idx != -1 && images.At(idx).base.data) {
+        free(data.base.data);
+        return &images.At(idx).base;
+    }
+    data.id = str::Dup(url);
+    images.Append(data);
+    return &images.Last().base;
 }
 
 char *EpubDoc::GetFileData(const char *relPath, const char *pagePath, size_t *lenOut)
@@ -503,11 +641,12 @@ char *EpubDoc::GetFileData(const char *relPath, const char *pagePath, size_t *le
         return nullptr;
     }
 
-    ScopedCritSec scope(&zipAccess);
-
     ScopedMem<char> url(NormalizeURL(relPath, pagePath));
     ScopedMem<WCHAR> zipPath(str::conv::FromUtf8(url));
-    return zip.GetFileDataByName(zipPath, lenOut);
+    ZipFile *zipCursor = AcquireZip();
+    char *data = zipCursor->GetFileDataByName(zipPath, lenOut);
+    ReleaseZip(zipCursor);
+    return data;
 }
 
 WCHAR *EpubDoc::GetProperty(DocumentProperty prop) const
@@ -637,11 +776,9 @@ bool EpubDoc::ParseToc(EbookTocVisitor *visitor)
     if (!tocPath)
         return false;
     size_t tocDataLen;
-    ScopedMem<char> tocData;
-    {
-        ScopedCritSec scope(&zipAccess);
-        tocData.Set(zip.GetFileDataByName(tocPath, &tocDataLen));
-    }
+    ZipFile *zipCursor = AcquireZip();
+    ScopedMem<char> tocData(zipCursor->GetFileDataByName(tocPath, &tocDataLen));
+    ReleaseZip(zipCursor);
     if (!tocData)
         return false;
 
@@ -684,6 +821,8 @@ EpubDoc *EpubDoc::CreateFromFile(const WCHAR *fileName)
         delete doc;
         return nullptr;
     }
+    // the cursor used for loading can be reused by the first thread which needs one
+    doc->ReleaseZip(doc->zip);
     return doc;
 }
 
@@ -694,6 +833,8 @@ EpubDoc *EpubDoc::CreateFromStream(IStream *stream)
         delete doc;
         return nullptr;
     }
+    // the cursor used for loading can be reused by the first thread which needs one
+    doc->ReleaseZip(doc->zip);
     return doc;
 }
 
@@ -1098,6 +1239,10 @@ bool PalmDoc::Load()
 
     size_t textLen;
     const char *text = mobiDoc->GetHtmlData(textLen);
+    if (!text) {
+        delete mobiDoc;
+        return false;
+    }
     UINT codePage = GuessTextCodepage(text, textLen, CP_ACP);
     ScopedMem<char> textUtf8(str::ToMultiByte(text, codePage, CP_UTF8));
     textLen = str::Len(textUtf8);
@@ -1156,9 +1301,9 @@ bool PalmDoc::ParseToc(EbookTocVisitor *visitor)
 bool PalmDoc::IsSupportedFile(const WCHAR *fileName, bool sniff)
 {
     if (sniff) {
-        PdbReader pdbReader(fileName);
-        return str::Eq(pdbReader.GetDbType(), "TEXtREAd") ||
-               str::Eq(pdbReader.GetDbType(), "TEXtTlDc");
+        char dbType[9];
+        return PdbReader::SniffDbType(fileName, dbType) &&
+               (str::Eq(dbType, "TEXtREAd") || str::Eq(dbType, "TEXtTlDc"));
     }
 
     return str::EndsWithI(fileName, L".pdb") ||
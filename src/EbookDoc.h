@@ -25,9 +25,17 @@ public:
 /* ********** EPUB ********** */
 
 class EpubDoc {
-    ZipFile zip;
-    // zip and images are the only mutable members of EpubDoc after initialization;
-    // access to them must be serialized for multi-threaded users (such as EbookController)
+    // the EPUB file's data shared by all archive cursors
+    const char *zipData;
+    size_t zipDataLen;
+    // ZipFile isn't thread-safe, so every thread extracting resources at the
+    // same time gets its own cursor (zip is the first one, used for loading)
+    ZipFile *zip;
+    Vec<ZipFile *> allZips;
+    Vec<ZipFile *> idleZips;
+    // idleZips, allZips and images are the only mutable members of EpubDoc after
+    // initialization; access to them is serialized for multi-threaded users
+    // (such as EbookController) but not held during decompression
     CRITICAL_SECTION zipAccess;
 
     str::Str<char> htmlData;
@@ -39,6 +47,10 @@ class EpubDoc {
     bool isRtlDoc;
 
     bool Load();
+    ZipFile *AcquireZip();
+    void ReleaseZip(ZipFile *zipCursor);
+    int FindImage(const char *id, bool partialMatch, size_t startAt=0);
+    ImageData *LoadImage(size_t imageIdx);
     void ParseMetadata(const char *content);
     bool ParseNavToc(const char *data, size_t dataLen, const char *pagePath, EbookTocVisitor *visitor);
     bool ParseNcxToc(const char *data, size_t dataLen, const char *pagePath, EbookTocVisitor *visitor);
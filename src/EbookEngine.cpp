@@ -14,6 +14,7 @@
 #include "HtmlPullParser.h"
 #include "Mui.h"
 #include "PalmDbReader.h"
+#include "ThreadUtil.h"
 #include "TrivialHtmlParser.h"
 #include "WinUtil.h"
 #include "ZipUtil.h"
@@ -65,13 +66,20 @@ public:
     void Abort() override { abort = true; }
 };
 
+class EbookPaginator;
+class EbookLink;
+
 class EbookEngine : public BaseEngine {
+    friend EbookPaginator;
+    friend EbookLink;
+
 public:
     EbookEngine();
     virtual ~EbookEngine();
 
     const WCHAR *FileName() const override { return fileName; };
-    int PageCount() const override { return pages ? (int)pages->Count() : 0; }
+    int PageCount() const override;
+    void SetPageCountChangedCallback(const std::function<void()>& onPageCountChanged) override;
 
     RectD PageMediabox(int pageNo) override { UNUSED(pageNo);  return pageRect; }
     RectD PageContentBox(int pageNo, RenderTarget target=Target_View) override {
@@ -113,7 +121,19 @@ public:
 
 protected:
     WCHAR *fileName;
+    // pages are formatted on demand (cf. FormatPages) while
+    // paginator formats the remaining ones in the background
     Vec<HtmlPage *> *pages;
+    // published once all pages have been formatted (-1 until then),
+    // so that PageCount doesn't have to wait for pagesAccess afterwards
+    volatile LONG pageCount;
+    // extrapolated from the formatter's progress until pageCount is known
+    volatile LONG estimatedPageCount;
+    // called once pageCount is known (protected by pagesAccess)
+    std::function<void()> onPageCountChanged;
+    HtmlFormatter *formatter;
+    bool skipEmptyPages;
+    EbookPaginator *paginator;
     Vec<PageAnchor> anchors;
     // contains for each page the last anchor indicating
     // a break between two merged documents
@@ -131,19 +151,40 @@ protected:
     void GetTransform(Matrix& m, float zoom, int rotation) {
         GetBaseTransform(m, pageRect.ToGdipRectF(), zoom, rotation);
     }
-    bool ExtractPageAnchors();
+    bool StartFormatting(HtmlFormatter *formatter, bool skipEmptyPages);
+    void StopFormatting();
+    bool FormatNextPage();
+    bool FormatPages(int untilPageNo=-1);
+    void ExtractPageAnchors(int pageNo);
     WCHAR *ExtractFontList();
 
     virtual PageElement *CreatePageLink(DrawInstr *link, RectI rect, int pageNo);
+    // called by EbookLink once an internal link is activated
+    virtual PageDestination *ResolvePageLink(DrawInstr *link, const WCHAR *url, int pageNo);
 
+    // returns nullptr for pages beyond the estimated page count
     Vec<DrawInstr> *GetHtmlPage(int pageNo) {
-        CrashIf(pageNo < 1 || PageCount() < pageNo);
-        if (pageNo < 1 || PageCount() < pageNo)
+        CrashIf(pageNo < 1);
+        ScopedCritSec scope(&pagesAccess);
+        if (pageNo < 1 || !FormatPages(pageNo))
             return nullptr;
         return &pages->At(pageNo - 1)->instructions;
     }
 };
 
+// formats all remaining pages of an EbookEngine (one page at a time, so
+// that pages needed for rendering can be formatted in between)
+class EbookPaginator : public ThreadBase {
+    EbookEngine *engine;
+
+public:
+    explicit EbookPaginator(EbookEngine *engine) : ThreadBase("EbookPaginator"), engine(engine) { }
+
+    virtual void Run() {
+        while (!WasCancelRequested() && engine->FormatNextPage());
+    }
+};
+
 class SimpleDest2 : public PageDestination {
 protected:
     int pageNo;
@@ -166,22 +207,37 @@ class EbookLink : public PageElement, public PageDestination {
     RectI rect;
     int pageNo;
     bool showUrl;
+    // internal links are only resolved once they're activated (cf. AsLink),
+    // as that might require all pages to have been formatted
+    EbookEngine *engine;
+    ScopedMem<WCHAR> destName;
 
 public:
-    EbookLink() : dest(nullptr), link(nullptr), pageNo(-1), showUrl(false) { }
+    EbookLink() : dest(nullptr), link(nullptr), pageNo(-1), showUrl(false), engine(nullptr) { }
     EbookLink(DrawInstr *link, RectI rect, PageDestination *dest, int pageNo=-1, bool showUrl=false) :
-        link(link), rect(rect), dest(dest), pageNo(pageNo), showUrl(showUrl) { }
+        link(link), rect(rect), dest(dest), pageNo(pageNo), showUrl(showUrl), engine(nullptr) { }
+    EbookLink(DrawInstr *link, RectI rect, EbookEngine *engine, WCHAR *destName, int pageNo) :
+        link(link), rect(rect), dest(nullptr), pageNo(pageNo), showUrl(false), engine(engine), destName(destName) { }
     virtual ~EbookLink() { delete dest; }
 
     PageElementType GetType() const override { return Element_Link; }
     int GetPageNo() const override { return pageNo; }
     RectD GetRect() const override { return rect.Convert<double>(); }
     WCHAR *GetValue() const override {
-        if (!dest || showUrl)
+        if (!dest && !destName || showUrl)
             return str::conv::FromHtmlUtf8(link->str.s, link->str.len);
         return nullptr;
     }
-    virtual PageDestination *AsLink() { return dest ? dest : this; }
+    virtual PageDestination *AsLink() {
+        if (engine) {
+            dest = engine->ResolvePageLink(link, destName, pageNo);
+            engine = nullptr;
+        }
+        // internal links which can't be resolved lead nowhere
+        if (destName)
+            return dest;
+        return dest ? dest : this;
+    }
 
     PageDestType GetDestType() const override { return Dest_LaunchURL; }
     int GetDestPageNo() const override { return 0; }
@@ -227,7 +283,8 @@ public:
     virtual PageDestination *GetLink() { return dest; }
 };
 
-EbookEngine::EbookEngine() : fileName(nullptr), pages(nullptr),
+EbookEngine::EbookEngine() : fileName(nullptr), pages(nullptr), pageCount(-1), estimatedPageCount(0),
+    formatter(nullptr), skipEmptyPages(false), paginator(nullptr),
     pageRect(0, 0, 5.12 * GetFileDPI(), 7.8 * GetFileDPI()), // "B Format" paperback
     pageBorder(0.4f * GetFileDPI())
 {
@@ -236,6 +293,8 @@ EbookEngine::EbookEngine() : fileName(nullptr), pages(nullptr),
 
 EbookEngine::~EbookEngine()
 {
+    StopFormatting();
+
     EnterCriticalSection(&pagesAccess);
 
     if (pages)
@@ -247,31 +306,114 @@ EbookEngine::~EbookEngine()
     DeleteCriticalSection(&pagesAccess);
 }
 
-bool EbookEngine::ExtractPageAnchors()
+// the number of pages is only known once all of them have been formatted,
+// until then this returns an estimate (cf. SetPageCountChangedCallback)
+int EbookEngine::PageCount() const
+{
+    LONG count = pageCount;
+    if (count >= 0)
+        return (int)count;
+    return (int)estimatedPageCount;
+}
+
+void EbookEngine::SetPageCountChangedCallback(const std::function<void()>& onPageCountChanged)
 {
     ScopedCritSec scope(&pagesAccess);
+    this->onPageCountChanged = onPageCountChanged;
+    if (pageCount >= 0 && onPageCountChanged)
+        onPageCountChanged();
+}
 
-    DrawInstr *baseAnchor = nullptr;
-    for (int pageNo = 1; pageNo <= PageCount(); pageNo++) {
-        Vec<DrawInstr> *pageInstrs = GetHtmlPage(pageNo);
-        if (!pageInstrs)
-            return false;
+// takes ownership of formatter and formats the first page (so that the document
+// can be shown right away), all further pages are formatted in the background
+bool EbookEngine::StartFormatting(HtmlFormatter *formatter, bool skipEmptyPages)
+{
+    CrashIf(pages || this->formatter);
+    this->formatter = formatter;
+    this->skipEmptyPages = skipEmptyPages;
+    pages = new Vec<HtmlPage *>();
+    if (!FormatPages(1))
+        return false;
 
-        for (size_t k = 0; k < pageInstrs->Count(); k++) {
-            DrawInstr *i = &pageInstrs->At(k);
-            if (InstrAnchor != i->type)
-                continue;
-            anchors.Append(PageAnchor(i, pageNo));
-            if (k < 2 && str::StartsWith(i->str.s + i->str.len, "\" page_marker />"))
-                baseAnchor = i;
-        }
-        baseAnchors.Append(baseAnchor);
+    paginator = new EbookPaginator(this);
+    paginator->Start();
+    return true;
+}
+
+// must be called by all derived classes before deleting data
+// that might still be needed by the formatter
+void EbookEngine::StopFormatting()
+{
+    if (paginator) {
+        paginator->RequestCancel();
+        paginator->Join();
+        delete paginator;
+        paginator = nullptr;
     }
+    delete formatter;
+    formatter = nullptr;
+}
 
-    CrashIf(baseAnchors.Count() != pages->Count());
+// returns false once all pages have been formatted
+bool EbookEngine::FormatNextPage()
+{
+    ScopedCritSec scope(&pagesAccess);
+    if (!formatter)
+        return false;
+
+    HtmlPage *page = formatter->Next(skipEmptyPages);
+    if (!page) {
+        delete formatter;
+        formatter = nullptr;
+        InterlockedExchange(&pageCount, (LONG)pages->Count());
+        if (onPageCountChanged)
+            onPageCountChanged();
+        return false;
+    }
+    pages->Append(page);
+    ExtractPageAnchors((int)pages->Count());
+
+    // extrapolate from how much of the html has been formatted so far
+    // (there's at least one more page until the formatter runs dry)
+    size_t count = pages->Count();
+    size_t estimate = count + 1;
+    size_t parsedLen = formatter->ParsedLen();
+    if (parsedLen > 0)
+        estimate = std::max(estimate, (size_t)((double)count * formatter->HtmlLen() / parsedLen + 0.5));
+    InterlockedExchange(&estimatedPageCount, (LONG)std::min(estimate, (size_t)INT_MAX));
     return true;
 }
 
+// makes sure that all pages up to untilPageNo (or all pages, if untilPageNo
+// is -1) have been formatted, returns false if there aren't enough pages
+bool EbookEngine::FormatPages(int untilPageNo)
+{
+    ScopedCritSec scope(&pagesAccess);
+    if (!pages)
+        return false;
+    while ((untilPageNo < 0 || (int)pages->Count() < untilPageNo) && FormatNextPage());
+    return untilPageNo <= (int)pages->Count();
+}
+
+// caller must hold pagesAccess
+void EbookEngine::ExtractPageAnchors(int pageNo)
+{
+    // the base anchor of a merged document remains valid until the next one
+    DrawInstr *baseAnchor = baseAnchors.Count() > 0 ? baseAnchors.Last() : nullptr;
+    Vec<DrawInstr> *pageInstrs = &pages->At(pageNo - 1)->instructions;
+    for (size_t k = 0; k < pageInstrs->Count(); k++) {
+        DrawInstr *i = &pageInstrs->At(k);
+        if (InstrAnchor != i->type)
+            continue;
+        anchors.Append(PageAnchor(i, pageNo));
+        if (k < 2 && str::StartsWith(i->str.s + i->str.len, "\" page_marker />"))
+            baseAnchor = i;
+    }
+    baseAnchors.Append(baseAnchor);
+
+    CrashIf(baseAnchors.Count() != pages->Count());
+}
+
 PointD EbookEngine::Transform(PointD pt, int pageNo, float zoom, int rotation, bool inverse)
 {
     RectD rect = Transform(RectD(pt, SizeD()), pageNo, zoom, rotation, inverse);
@@ -389,7 +531,10 @@ RenderedBitmap *EbookEngine::RenderBitmap(int pageNo, float zoom, int rotation,
     ScopedCritSec scope(&pagesAccess);
 
     mui::ITextRender *textDraw = mui::TextRenderGdiplus::Create(&g);
-    DrawHtmlPage(&g, textDraw, GetHtmlPage(pageNo), pageBorder, pageBorder, false, Color((ARGB)Color::Black), cookie ? &cookie->abort : nullptr);
+    // pages beyond the estimated page count remain blank
+    Vec<DrawInstr> *pageInstrs = GetHtmlPage(pageNo);
+    if (pageInstrs)
+        DrawHtmlPage(&g, textDraw, pageInstrs, pageBorder, pageBorder, false, Color((ARGB)Color::Black), cookie ? &cookie->abort : nullptr);
     DrawAnnotations(g, userAnnots, pageNo);
     delete textDraw;
     DeleteDC(hDC);
@@ -420,6 +565,8 @@ WCHAR *EbookEngine::ExtractPageText(int pageNo, const WCHAR *lineSep, RectI **co
     bool insertSpace = false;
 
     Vec<DrawInstr> *pageInstrs = GetHtmlPage(pageNo);
+    if (!pageInstrs)
+        return nullptr;
     for (DrawInstr& i : *pageInstrs) {
         RectI bbox = GetInstrBbox(i, pageBorder);
         switch (i.type) {
@@ -512,17 +659,23 @@ PageElement *EbookEngine::CreatePageLink(DrawInstr *link, RectI rect, int pageNo
         url.Set(str::conv::FromUtf8(absPath));
     }
 
-    PageDestination *dest = GetNamedDest(url);
-    if (!dest)
-        return nullptr;
-    return new EbookLink(link, rect, dest, pageNo);
+    return new EbookLink(link, rect, this, url.StealData(), pageNo);
+}
+
+PageDestination *EbookEngine::ResolvePageLink(DrawInstr *link, const WCHAR *url, int pageNo)
+{
+    UNUSED(link); UNUSED(pageNo);
+    return GetNamedDest(url);
 }
 
 Vec<PageElement *> *EbookEngine::GetElements(int pageNo)
 {
+    ScopedCritSec scope(&pagesAccess);
     Vec<PageElement *> *els = new Vec<PageElement *>();
 
     Vec<DrawInstr> *pageInstrs = GetHtmlPage(pageNo);
+    if (!pageInstrs)
+        return els;
     for (DrawInstr& i : *pageInstrs) {
         if (InstrImage == i.type)
             els->Append(new ImageDataElement(pageNo, &i.img, GetInstrBbox(i, pageBorder)));
@@ -557,6 +710,9 @@ PageElement *EbookEngine::GetElementAtPos(int pageNo, PointD pt)
 
 PageDestination *EbookEngine::GetNamedDest(const WCHAR *name)
 {
+    // anchors are only complete once all pages have been formatted
+    FormatPages();
+
     ScopedMem<char> name_utf8(str::conv::ToUtf8(name));
     const char *id = name_utf8;
     if (str::FindChar(id, '#'))
@@ -745,6 +901,7 @@ protected:
 
 EpubEngineImpl::~EpubEngineImpl()
 {
+    StopFormatting();
     delete doc;
     if (stream)
         stream->Release();
@@ -786,11 +943,7 @@ bool EpubEngineImpl::FinishLoading()
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplusQuick;
 
-    pages = EpubFormatter(&args, doc).FormatAllPages(false);
-    if (!ExtractPageAnchors())
-        return false;
-
-    return pages->Count() > 0;
+    return StartFormatting(new EpubFormatter(&args, doc), false);
 }
 
 unsigned char *EpubEngineImpl::GetFileData(size_t *cbCount)
@@ -884,7 +1037,10 @@ BaseEngine *CreateFromStream(IStream *stream)
 class Fb2EngineImpl : public EbookEngine {
 public:
     Fb2EngineImpl() : EbookEngine(), doc(nullptr) { }
-    virtual ~Fb2EngineImpl() { delete doc; }
+    virtual ~Fb2EngineImpl() {
+        StopFormatting();
+        delete doc;
+    }
     BaseEngine *Clone() override {
         return fileName ? CreateFromFile(fileName) : nullptr;
     }
@@ -937,11 +1093,7 @@ bool Fb2EngineImpl::FinishLoading()
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplusQuick;
 
-    pages = Fb2Formatter(&args, doc).FormatAllPages(false);
-    if (!ExtractPageAnchors())
-        return false;
-
-    return pages->Count() > 0;
+    return StartFormatting(new Fb2Formatter(&args, doc), false);
 }
 
 DocTocItem *Fb2EngineImpl::GetTocTree()
@@ -1000,7 +1152,10 @@ BaseEngine *CreateFromStream(IStream *stream)
 class MobiEngineImpl : public EbookEngine {
 public:
     MobiEngineImpl() : EbookEngine(), doc(nullptr) { }
-    ~MobiEngineImpl() override { delete doc; }
+    ~MobiEngineImpl() override {
+        StopFormatting();
+        delete doc;
+    }
     BaseEngine *Clone() override {
         return fileName ? CreateFromFile(fileName) : nullptr;
     }
@@ -1045,6 +1200,8 @@ bool MobiEngineImpl::FinishLoading()
 
     HtmlFormatterArgs args;
     args.htmlStr = doc->GetHtmlData(args.htmlStrLen);
+    if (!args.htmlStr)
+        return false;
     args.pageDx = (float)pageRect.dx - 2 * pageBorder;
     args.pageDy = (float)pageRect.dy - 2 * pageBorder;
     args.SetFontName(GetDefaultFontName());
@@ -1052,11 +1209,7 @@ bool MobiEngineImpl::FinishLoading()
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplusQuick;
 
-    pages = MobiFormatter(&args, doc).FormatAllPages();
-    if (!ExtractPageAnchors())
-        return false;
-
-    return pages->Count() > 0;
+    return StartFormatting(new MobiFormatter(&args, doc), true);
 }
 
 PageDestination *MobiEngineImpl::GetNamedDest(const WCHAR *name)
@@ -1064,20 +1217,23 @@ PageDestination *MobiEngineImpl::GetNamedDest(const WCHAR *name)
     int filePos = _wtoi(name);
     if (filePos < 0 || 0 == filePos && *name != '0')
         return nullptr;
+
+    ScopedCritSec scope(&pagesAccess);
+    // only format as many pages as needed for reaching filePos
     int pageNo;
-    for (pageNo = 1; pageNo < PageCount(); pageNo++) {
+    for (pageNo = 1; FormatPages(pageNo + 1); pageNo++) {
         if (pages->At(pageNo)->reparseIdx > filePos)
             break;
     }
-    CrashIf(pageNo < 1 || pageNo > PageCount());
 
     size_t htmlLen;
     char *start = doc->GetHtmlData(htmlLen);
-    if ((size_t)filePos > htmlLen)
+    if (!start || (size_t)filePos > htmlLen)
         return nullptr;
 
-    ScopedCritSec scope(&pagesAccess);
     Vec<DrawInstr> *pageInstrs = GetHtmlPage(pageNo);
+    if (!pageInstrs)
+        return nullptr;
     // link to the bottom of the page, if filePos points
     // beyond the last visible DrawInstr of a page
     float currY = (float)pageRect.dy;
@@ -1148,7 +1304,10 @@ BaseEngine *CreateFromStream(IStream *stream)
 class PdbEngineImpl : public EbookEngine {
 public:
     PdbEngineImpl() : EbookEngine(), doc(nullptr) { }
-    virtual ~PdbEngineImpl() { delete doc; }
+    virtual ~PdbEngineImpl() {
+        StopFormatting();
+        delete doc;
+    }
     BaseEngine *Clone() override {
         return fileName ? CreateFromFile(fileName) : nullptr;
     }
@@ -1186,11 +1345,7 @@ bool PdbEngineImpl::Load(const WCHAR *fileName)
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplusQuick;
 
-    pages = HtmlFormatter(&args).FormatAllPages();
-    if (!ExtractPageAnchors())
-        return false;
-
-    return pages->Count() > 0;
+    return StartFormatting(new HtmlFormatter(&args), true);
 }
 
 DocTocItem *PdbEngineImpl::GetTocTree()
@@ -1350,6 +1505,7 @@ public:
         pageRect = RectD(0, 0, 8.27 * GetFileDPI(), 11.693 * GetFileDPI());
     }
     virtual ~ChmEngineImpl() {
+        StopFormatting();
         delete dataCache;
         delete doc;
     }
@@ -1376,7 +1532,7 @@ protected:
 
     bool Load(const WCHAR *fileName);
 
-    virtual PageElement *CreatePageLink(DrawInstr *link, RectI rect, int pageNo);
+    virtual PageDestination *ResolvePageLink(DrawInstr *link, const WCHAR *url, int pageNo);
     bool SaveEmbedded(LinkSaverUI& saveUI, const char *path);
 };
 
@@ -1491,11 +1647,7 @@ bool ChmEngineImpl::Load(const WCHAR *fileName)
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplusQuick;
 
-    pages = ChmFormatter(&args, dataCache).FormatAllPages(false);
-    if (!ExtractPageAnchors())
-        return false;
-
-    return pages->Count() > 0;
+    return StartFormatting(new ChmFormatter(&args, dataCache), false);
 }
 
 PageDestination *ChmEngineImpl::GetNamedDest(const WCHAR *name)
@@ -1547,21 +1699,20 @@ public:
     bool SaveEmbedded(LinkSaverUI& saveUI)  override { return engine->SaveEmbedded(saveUI, path); }
 };
 
-PageElement *ChmEngineImpl::CreatePageLink(DrawInstr *link, RectI rect, int pageNo)
+PageDestination *ChmEngineImpl::ResolvePageLink(DrawInstr *link, const WCHAR *url, int pageNo)
 {
-    PageElement *linkEl = EbookEngine::CreatePageLink(link, rect, pageNo);
-    if (linkEl)
-        return linkEl;
+    PageDestination *dest = EbookEngine::ResolvePageLink(link, url, pageNo);
+    if (dest)
+        return dest;
 
+    ScopedCritSec scope(&pagesAccess);
     DrawInstr *baseAnchor = baseAnchors.At(pageNo-1);
     ScopedMem<char> basePath(str::DupN(baseAnchor->str.s, baseAnchor->str.len));
-    ScopedMem<char> url(str::DupN(link->str.s, link->str.len));
-    url.Set(NormalizeURL(url, basePath));
-    if (!doc->HasData(url))
+    ScopedMem<char> path(str::DupN(link->str.s, link->str.len));
+    path.Set(NormalizeURL(path, basePath));
+    if (!doc->HasData(path))
         return nullptr;
-
-    PageDestination *dest = new ChmEmbeddedDest(this, url);
-    return new EbookLink(link, rect, dest, pageNo);
+    return new ChmEmbeddedDest(this, path);
 }
 
 bool ChmEngineImpl::SaveEmbedded(LinkSaverUI& saveUI, const char *path)
@@ -1607,6 +1758,7 @@ public:
         pageRect = RectD(0, 0, 8.27 * GetFileDPI(), 11.693 * GetFileDPI());
     }
     virtual ~HtmlEngineImpl() {
+        StopFormatting();
         delete doc;
     }
     BaseEngine *Clone() override {
@@ -1646,11 +1798,7 @@ bool HtmlEngineImpl::Load(const WCHAR *fileName)
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplus;
 
-    pages = HtmlFileFormatter(&args, doc).FormatAllPages(false);
-    if (!ExtractPageAnchors())
-        return false;
-
-    return pages->Count() > 0;
+    return StartFormatting(new HtmlFileFormatter(&args, doc), false);
 }
 
 class RemoteHtmlDest : public SimpleDest2 {
@@ -1716,7 +1864,10 @@ public:
         // ISO 216 A4 (210mm x 297mm)
         pageRect = RectD(0, 0, 8.27 * GetFileDPI(), 11.693 * GetFileDPI());
     }
-    virtual ~TxtEngineImpl() { delete doc; }
+    virtual ~TxtEngineImpl() {
+        StopFormatting();
+        delete doc;
+    }
     BaseEngine *Clone() override {
         return fileName ? CreateFromFile(fileName) : nullptr;
     }
@@ -1762,11 +1913,7 @@ bool TxtEngineImpl::Load(const WCHAR *fileName)
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplus;
 
-    pages = TxtFormatter(&args).FormatAllPages(false);
-    if (!ExtractPageAnchors())
-        return false;
-
-    return pages->Count() > 0;
+    return StartFormatting(new TxtFormatter(&args), false);
 }
 
 DocTocItem *TxtEngineImpl::GetTocTree()
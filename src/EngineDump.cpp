@@ -4,10 +4,13 @@
 // utils
 #include "BaseUtil.h"
 #include "CmdLineParser.h"
+#include "DirIter.h"
 #include "FileUtil.h"
 #include "GdiPlusUtil.h"
 #include "MiniMui.h"
 #include "TgaReader.h"
+#include "ThreadUtil.h"
+#include "Timer.h"
 #include "WinUtil.h"
 // rendering engines
 #include "BaseEngine.h"
@@ -16,6 +19,8 @@
 #include "FileModifications.h"
 #include "PdfCreator.h"
 
+#include <psapi.h>
+
 #define Out(msg, ...) printf(msg, __VA_ARGS__)
 
 // caller must free() the result
@@ -396,6 +401,190 @@ bool RenderDocument(BaseEngine *engine, const WCHAR *renderPath, float zoom=1.f,
     return success;
 }
 
+/* benchmarking mode (-bench): renders all pages of all documents at the
+   given zoom levels without saving them and prints the timings as JSON */
+
+#define MAX_BENCH_ZOOMS   8
+#define MAX_BENCH_THREADS 16
+
+struct BenchPageResult {
+    double loadMs; // negative if the page couldn't be loaded
+    double renderMs[MAX_BENCH_ZOOMS]; // negative if the page couldn't be rendered
+};
+
+struct BenchData {
+    Vec<float> *zooms;
+    int pageCount;
+    LONG lastPage;
+    BenchPageResult *results;
+};
+
+static void BenchPage(BaseEngine *engine, int pageNo, Vec<float> *zooms, BenchPageResult *result)
+{
+    Timer t;
+    bool ok = engine->BenchLoadPage(pageNo);
+    result->loadMs = ok ? t.Stop() : -1;
+
+    for (size_t i = 0; i < zooms->Count(); i++) {
+        t.Start();
+        RenderedBitmap *bmp = engine->RenderBitmap(pageNo, zooms->At(i), 0);
+        result->renderMs[i] = bmp ? t.Stop() : -1;
+        delete bmp;
+    }
+}
+
+class BenchWorker : public ThreadBase {
+    BaseEngine *engine;
+    bool ownsEngine;
+    BenchData *data;
+
+public:
+    BenchWorker(BaseEngine *engine, bool ownsEngine, BenchData *data) :
+        ThreadBase("BenchWorker"), engine(engine), ownsEngine(ownsEngine), data(data) { }
+    virtual ~BenchWorker() {
+        if (ownsEngine)
+            delete engine;
+    }
+
+    virtual void Run() {
+        // pages are handed out in order to all worker threads
+        for (;;) {
+            int pageNo = (int)InterlockedIncrement(&data->lastPage);
+            if (pageNo > data->pageCount)
+                break;
+            BenchPage(engine, pageNo, data->zooms, &data->results[pageNo - 1]);
+        }
+    }
+};
+
+static size_t GetPeakMemoryUsage()
+{
+    PROCESS_MEMORY_COUNTERS pmc = { 0 };
+    pmc.cb = sizeof(pmc);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+    return pmc.PeakWorkingSetSize;
+}
+
+// caller must free() the result
+static char *JsonEscape(const WCHAR *string)
+{
+    str::Str<WCHAR> escaped(256);
+    for (const WCHAR *s = string; *s; s++) {
+        switch (*s) {
+        case '"': escaped.Append(L"\\\""); break;
+        case '\\': escaped.Append(L"\\\\"); break;
+        default:
+            if (*s < 0x20)
+                escaped.AppendFmt(L"\\u%04x", *s);
+            else
+                escaped.Append(*s);
+            break;
+        }
+    }
+    return str::conv::ToUtf8(escaped.Get());
+}
+
+static void BenchDocument(const WCHAR *filePath, Vec<float>& zooms, int threadCount, PasswordUI *pwdUI, bool isLast)
+{
+    ScopedMem<char> fileName(JsonEscape(filePath));
+    Out("    {\n      \"file\": \"%s\",\n", fileName.Get());
+
+    Timer t;
+    BaseEngine *engine = EngineManager::CreateEngine(filePath, pwdUI);
+    double loadMs = t.Stop();
+    if (!engine) {
+        Out("      \"error\": \"couldn't create an engine\"\n    }%s\n", isLast ? "" : ",");
+        return;
+    }
+    Out("      \"loadMs\": %.2f,\n", loadMs);
+    Out("      \"pageCount\": %d,\n", engine->PageCount());
+
+    BenchData data;
+    data.zooms = &zooms;
+    data.pageCount = engine->PageCount();
+    data.lastPage = 0;
+    data.results = AllocArray<BenchPageResult>(data.pageCount);
+
+    // each additional thread renders with its own copy of the document
+    BenchWorker *workers[MAX_BENCH_THREADS];
+    int workerCount = 0;
+    workers[workerCount++] = new BenchWorker(engine, false, &data);
+    for (; workerCount < threadCount && workerCount < data.pageCount; workerCount++) {
+        BaseEngine *clone = engine->Clone();
+        if (!clone)
+            break;
+        workers[workerCount] = new BenchWorker(clone, true, &data);
+    }
+    t.Start();
+    for (int i = 0; i < workerCount; i++) {
+        workers[i]->Start();
+    }
+    for (int i = 0; i < workerCount; i++) {
+        workers[i]->Join();
+        delete workers[i];
+    }
+    double totalMs = t.Stop();
+
+    Out("      \"threads\": %d,\n", workerCount);
+    Out("      \"totalMs\": %.2f,\n", totalMs);
+    Out("      \"pages\": [\n");
+    for (int pageNo = 1; pageNo <= data.pageCount; pageNo++) {
+        BenchPageResult *res = &data.results[pageNo - 1];
+        Out("        { \"page\": %d, \"loadMs\": %.2f, \"renderMs\": [", pageNo, res->loadMs);
+        for (size_t i = 0; i < zooms.Count(); i++) {
+            Out("%s%.2f", i > 0 ? ", " : "", res->renderMs[i]);
+        }
+        Out("] }%s\n", pageNo < data.pageCount ? "," : "");
+    }
+    Out("      ],\n");
+    // the peak is process-wide and thus includes all previously benchmarked documents
+    Out("      \"processPeakMemoryKB\": %u\n", (unsigned int)(GetPeakMemoryUsage() / 1024));
+    Out("    }%s\n", isLast ? "" : ",");
+
+    free(data.results);
+    delete engine;
+}
+
+// benchPath can either be a single document or a directory
+// containing documents (including all its subdirectories)
+static bool BenchDocuments(const WCHAR *benchPath, Vec<float>& zooms, int threadCount, PasswordUI *pwdUI)
+{
+    WStrVec filePaths;
+    if (dir::Exists(benchPath)) {
+        DirIter di(benchPath, true);
+        for (const WCHAR *filePath = di.First(); filePath; filePath = di.Next()) {
+            if (EngineManager::IsSupportedFile(filePath))
+                filePaths.Append(str::Dup(filePath));
+        }
+        filePaths.SortNatural();
+    }
+    else if (file::Exists(benchPath)) {
+        filePaths.Append(str::Dup(benchPath));
+    }
+    if (filePaths.Count() == 0) {
+        ErrOut("Error: No documents found at %s!", benchPath);
+        return false;
+    }
+
+    Out("{\n");
+    Out("  \"threads\": %d,\n", threadCount);
+    Out("  \"zooms\": [");
+    for (size_t i = 0; i < zooms.Count(); i++) {
+        Out("%s%.2f", i > 0 ? ", " : "", zooms.At(i));
+    }
+    Out("],\n");
+    Out("  \"documents\": [\n");
+    for (size_t i = 0; i < filePaths.Count(); i++) {
+        BenchDocument(filePaths.At(i), zooms, threadCount, pwdUI, i == filePaths.Count() - 1);
+        fflush(stdout);
+    }
+    Out("  ],\n");
+    Out("  \"peakMemoryKB\": %u\n", (unsigned int)(GetPeakMemoryUsage() / 1024));
+    Out("}\n");
+    return true;
+}
+
 class PasswordHolder : public PasswordUI {
     const WCHAR *password;
 public:
@@ -420,6 +609,8 @@ int main(int argc, char **argv)
 Usage:
         ErrOut("%s [-pwd <password>][-quick][-render <path-%%d.tga>] <filename>",
             path::GetBaseName(argList.At(0)));
+        ErrOut("%s [-pwd <password>] -bench [-zoom <100%%,200%%>][-threads <count>] <filename or directory>",
+            path::GetBaseName(argList.At(0)));
         return 2;
     }
 
@@ -429,6 +620,9 @@ Usage:
     WCHAR *renderPath = nullptr;
     float renderZoom = 1.f;
     bool loadOnly = false, silent = false;
+    bool bench = false;
+    Vec<float> benchZooms;
+    int benchThreads = 1;
 #ifdef DEBUG
     int breakAlloc = 0;
 #endif
@@ -447,6 +641,21 @@ Usage:
             }
             renderPath = argList.At(++i);
         }
+        else if (str::Eq(argList.At(i), L"-bench"))
+            bench = true;
+        else if (str::Eq(argList.At(i), L"-zoom") && i + 1 < argList.Count() && benchZooms.Count() == 0) {
+            WStrVec zooms;
+            zooms.Split(argList.At(++i), L",", true);
+            for (size_t j = 0; j < zooms.Count() && benchZooms.Count() < MAX_BENCH_ZOOMS; j++) {
+                float zoom;
+                if (!str::Parse(zooms.At(j), L"%f%%%$", &zoom) || zoom <= 0.f)
+                    goto Usage;
+                benchZooms.Append(zoom / 100.f);
+            }
+        }
+        else if (str::Eq(argList.At(i), L"-threads") && i + 1 < argList.Count()) {
+            benchThreads = limitValue(_wtoi(argList.At(++i)), 1, MAX_BENCH_THREADS);
+        }
         // -loadonly and -silent are only meant for profiling
         else if (str::Eq(argList.At(i), L"-loadonly"))
             loadOnly = true;
@@ -493,8 +702,14 @@ Usage:
         FindClose(hfind);
     }
 
-    EngineType engineType;
     PasswordHolder pwdUI(password);
+    if (bench) {
+        if (benchZooms.Count() == 0)
+            benchZooms.Append(1.f);
+        return BenchDocuments(filePath, benchZooms, benchThreads, &pwdUI) ? 0 : 1;
+    }
+
+    EngineType engineType;
     BaseEngine *engine = EngineManager::CreateEngine(filePath, &pwdUI, &engineType);
 #ifdef DEBUG
     bool couldLeak = engineType == Engine_DjVu || DjVuEngine::IsSupportedFile(filePath) || DjVuEngine::IsSupportedFile(filePath, true);
@@ -16,9 +16,12 @@
 #include "FileThumbnails.h"
 
 #define THUMBNAILS_DIR_NAME L"sumatrapdfcache"
+// archive listings are also useful for archives that aren't (yet) frequently used,
+// so they're only removed (least recently used first) once they take up more space
+#define ARCHIVE_INDEX_CACHE_MAX_SIZE (16 * 1024 * 1024)
 
 // TODO: create in TEMP directory instead?
-static WCHAR *GetThumbnailPath(const WCHAR *filePath)
+static WCHAR *GetCacheFilePath(const WCHAR *filePath, const WCHAR *ext)
 {
     // create a fingerprint of a (normalized) path for the file name
     // I'd have liked to also include the file's last modification time
@@ -41,16 +44,30 @@ static WCHAR *GetThumbnailPath(const WCHAR *filePath)
         return nullptr;
     ScopedMem<WCHAR> fname(str::conv::FromAnsi(fingerPrint));
 
-    return str::Format(L"%s\\%s.png", thumbsPath.Get(), fname.Get());
+    return str::Format(L"%s\\%s.%s", thumbsPath.Get(), fname.Get(), ext);
 }
 
-// removes thumbnails that don't belong to any frequently used item in file history
-void CleanUpThumbnailCache(FileHistory& fileHistory)
+static WCHAR *GetThumbnailPath(const WCHAR *filePath)
+{
+    return GetCacheFilePath(filePath, L"png");
+}
+
+WCHAR *GetTextCachePath(const WCHAR *filePath)
+{
+    return GetCacheFilePath(filePath, L"txtcache");
+}
+
+WCHAR *GetArchiveIndexCachePath(const WCHAR *filePath)
+{
+    return GetCacheFilePath(filePath, L"arcidx");
+}
+
+static void CleanUpCacheFiles(FileHistory& fileHistory, const WCHAR *ext)
 {
     ScopedMem<WCHAR> thumbsPath(AppGenDataFilename(THUMBNAILS_DIR_NAME));
     if (!thumbsPath)
         return;
-    ScopedMem<WCHAR> pattern(path::Join(thumbsPath, L"*.png"));
+    ScopedMem<WCHAR> pattern(str::Format(L"%s\\*.%s", thumbsPath.Get(), ext));
 
     WStrVec files;
     WIN32_FIND_DATA fdata;
@@ -67,10 +84,10 @@ void CleanUpThumbnailCache(FileHistory& fileHistory)
     Vec<DisplayState *> list;
     fileHistory.GetFrequencyOrder(list);
     for (size_t i = 0; i < list.Count() && i < FILE_HISTORY_MAX_FREQUENT * 2; i++) {
-        ScopedMem<WCHAR> bmpPath(GetThumbnailPath(list.At(i)->filePath));
-        if (!bmpPath)
+        ScopedMem<WCHAR> cachePath(GetCacheFilePath(list.At(i)->filePath, ext));
+        if (!cachePath)
             continue;
-        int idx = files.Find(path::GetBaseName(bmpPath));
+        int idx = files.Find(path::GetBaseName(cachePath));
         if (idx != -1) {
             CrashIf(idx < 0 || files.Count() <= (size_t)idx);
             free(files.PopAt(idx));
@@ -78,11 +95,67 @@ void CleanUpThumbnailCache(FileHistory& fileHistory)
     }
 
     for (size_t i = 0; i < files.Count(); i++) {
-        ScopedMem<WCHAR> bmpPath(path::Join(thumbsPath, files.At(i)));
-        file::Delete(bmpPath);
+        ScopedMem<WCHAR> cachePath(path::Join(thumbsPath, files.At(i)));
+        file::Delete(cachePath);
+    }
+}
+
+struct ArchiveIndexCacheFile {
+    WCHAR *name;
+    uint64 size;
+    // updated by ArchFile whenever the listing is used
+    FILETIME lastUsed;
+};
+
+static int cmpArchiveIndexCacheFiles(const void *a, const void *b)
+{
+    // most recently used first
+    return CompareFileTime(&((ArchiveIndexCacheFile *)b)->lastUsed, &((ArchiveIndexCacheFile *)a)->lastUsed);
+}
+
+// removes the least recently used archive listings once they take up too much space
+void CleanUpArchiveIndexCache()
+{
+    ScopedMem<WCHAR> thumbsPath(AppGenDataFilename(THUMBNAILS_DIR_NAME));
+    if (!thumbsPath)
+        return;
+    ScopedMem<WCHAR> pattern(str::Format(L"%s\\*.arcidx", thumbsPath.Get()));
+
+    Vec<ArchiveIndexCacheFile> files;
+    WIN32_FIND_DATA fdata;
+
+    HANDLE hfind = FindFirstFile(pattern, &fdata);
+    if (INVALID_HANDLE_VALUE == hfind)
+        return;
+    do {
+        if (!(fdata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            ArchiveIndexCacheFile file = { str::Dup(fdata.cFileName), 0, fdata.ftLastWriteTime };
+            file.size = ((uint64)fdata.nFileSizeHigh << 32) | fdata.nFileSizeLow;
+            files.Append(file);
+        }
+    } while (FindNextFile(hfind, &fdata));
+    FindClose(hfind);
+
+    files.Sort(cmpArchiveIndexCacheFiles);
+    uint64 totalSize = 0;
+    for (ArchiveIndexCacheFile& file : files) {
+        totalSize += file.size;
+        if (totalSize > ARCHIVE_INDEX_CACHE_MAX_SIZE) {
+            ScopedMem<WCHAR> cachePath(path::Join(thumbsPath, file.name));
+            file::Delete(cachePath);
+        }
+        free(file.name);
     }
 }
 
+// removes thumbnails and cached text that don't belong to any frequently used item in file history
+void CleanUpThumbnailCache(FileHistory& fileHistory)
+{
+    CleanUpCacheFiles(fileHistory, L"png");
+    CleanUpCacheFiles(fileHistory, L"txtcache");
+    CleanUpArchiveIndexCache();
+}
+
 static RenderedBitmap *LoadRenderedBitmap(const WCHAR *filePath)
 {
     size_t len;
@@ -6,6 +6,7 @@
 #define THUMBNAIL_DY        150
 
 void    CleanUpThumbnailCache(FileHistory& fileHistory);
+void    CleanUpArchiveIndexCache();
 
 bool    LoadThumbnail(DisplayState& ds);
 bool    HasThumbnail(DisplayState& ds);
@@ -13,3 +14,8 @@ bool    HasThumbnail(DisplayState& ds);
 void    SetThumbnail(DisplayState *ds, RenderedBitmap *bmp);
 void    SaveThumbnail(DisplayState& ds);
 void    RemoveThumbnail(DisplayState& ds);
+
+// path for PageTextCache's on-disk cache (caller needs to free() the result)
+WCHAR * GetTextCachePath(const WCHAR *filePath);
+// path for ArchFile's on-disk listing cache (caller needs to free() the result)
+WCHAR * GetArchiveIndexCachePath(const WCHAR *filePath);
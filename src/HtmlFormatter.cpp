@@ -3,6 +3,7 @@
 
 // utils
 #include "BaseUtil.h"
+#include "Dict.h"
 #include "GdiPlusUtil.h"
 #include "HtmlParserLookup.h"
 #include "CssParser.h"
@@ -178,6 +179,112 @@ HtmlFormatterArgs::HtmlFormatterArgs() :
 {
 }
 
+// upper limit for the number of strings in the TextMeasureCache
+#define MAX_CACHED_MEASUREMENTS (64 * 1024)
+
+// the measurements of all strings (words and word prefixes)
+// for a font and a text rendering method
+struct FontMeasurements {
+    ScopedMem<WCHAR> fontName;
+    float fontSize;
+    FontStyle fontStyle;
+    mui::TextRenderMethod method;
+    dict::MapWStrToInt indices;
+    Vec<RectF> bboxes;
+
+    FontMeasurements(mui::CachedFont *font, mui::TextRenderMethod method) :
+        fontName(str::Dup(font->GetName())), fontSize(font->GetSize()),
+        fontStyle(font->GetStyle()), method(method), indices(1024) { }
+
+    bool SameAs(mui::CachedFont *font, mui::TextRenderMethod method) const {
+        return this->method == method && font->SameAs(fontName, fontSize, fontStyle);
+    }
+};
+
+// text measurements are shared by all HtmlFormatters, so that layouting a document
+// again (e.g. at a different page size) doesn't have to measure the same words again
+// (fonts are identified by name, size and style, since mui's CachedFonts are
+// recreated whenever mui is reinitialized)
+class TextMeasureCache {
+    Vec<FontMeasurements *> fonts;
+    size_t count;
+    TextMeasureStats stats;
+    CRITICAL_SECTION access;
+
+    FontMeasurements *GetFont(mui::CachedFont *font, mui::TextRenderMethod method) {
+        for (FontMeasurements *fm : fonts) {
+            if (fm->SameAs(font, method))
+                return fm;
+        }
+        FontMeasurements *fm = new FontMeasurements(font, method);
+        fonts.Append(fm);
+        return fm;
+    }
+
+public:
+    TextMeasureCache() : count(0) {
+        stats.hits = stats.misses = 0;
+        InitializeCriticalSection(&access);
+    }
+    ~TextMeasureCache() {
+        DeleteVecMembers(fonts);
+        DeleteCriticalSection(&access);
+    }
+
+    RectF Measure(mui::ITextRender *textMeasure, mui::CachedFont *font, const WCHAR *s, size_t len);
+    TextMeasureStats GetStats() {
+        ScopedCritSec scope(&access);
+        return stats;
+    }
+};
+
+RectF TextMeasureCache::Measure(mui::ITextRender *textMeasure, mui::CachedFont *font, const WCHAR *s, size_t len)
+{
+    WCHAR key[512];
+    if (len < dimof(key)) {
+        memcpy(key, s, len * sizeof(WCHAR));
+        key[len] = '\0';
+    }
+    // strings containing a zero character can't be cached
+    bool cacheable = len < dimof(key) && str::Len(key) == len;
+
+    if (cacheable) {
+        ScopedCritSec scope(&access);
+        FontMeasurements *fm = GetFont(font, textMeasure->method);
+        int idx;
+        if (fm->indices.Get(key, &idx)) {
+            stats.hits++;
+            return fm->bboxes.At(idx);
+        }
+        stats.misses++;
+    }
+
+    // don't block other threads while measuring
+    textMeasure->SetFont(font);
+    RectF bbox = textMeasure->Measure(s, len);
+    if (!cacheable)
+        return bbox;
+
+    ScopedCritSec scope(&access);
+    if (count >= MAX_CACHED_MEASUREMENTS) {
+        DeleteVecMembers(fonts);
+        count = 0;
+    }
+    FontMeasurements *fm = GetFont(font, textMeasure->method);
+    if (fm->indices.Insert(key, (int)fm->bboxes.Count(), nullptr)) {
+        fm->bboxes.Append(bbox);
+        count++;
+    }
+    return bbox;
+}
+
+static TextMeasureCache gTextMeasureCache;
+
+TextMeasureStats GetTextMeasureStats()
+{
+    return gTextMeasureCache.GetStats();
+}
+
 HtmlFormatter::HtmlFormatter(HtmlFormatterArgs *args) :
     pageDx(args->pageDx), pageDy(args->pageDy),
     textAllocator(args->textAllocator), currLineReparseIdx(0),
@@ -726,6 +833,53 @@ void HtmlFormatter::EmitElasticSpace()
     AppendInstr(DrawInstr(InstrElasticSpace));
 }
 
+RectF HtmlFormatter::MeasureText(const WCHAR *s, size_t len)
+{
+    return gTextMeasureCache.Measure(textMeasure, CurrFont(), s, len);
+}
+
+// returns the length of the longest prefix of s that fits into dx (cf. mui::StringLenForWidth)
+size_t HtmlFormatter::StringLenForWidth(const WCHAR *s, size_t len, float dx)
+{
+    RectF r = MeasureText(s, len);
+    if (r.Width <= dx)
+        return len;
+    CrashIf(len > dimof(buf));
+    // make the best guess of the length that fits by distributing
+    // the total width according to the widths of the individual characters
+    // (usually resulting in just two more measurements for the exact length)
+    float advances[dimof(buf)];
+    float total = 0;
+    for (size_t i = 0; i < len; i++) {
+        total += MeasureText(s + i, 1).Width;
+        advances[i] = total;
+    }
+    size_t n = 1;
+    while (n < len && advances[n] * r.Width <= dx * total) {
+        n++;
+    }
+    r = MeasureText(s, n);
+    // find the length len of s that fits within dx iff width of len+1 exceeds dx
+    int dir = 1; // increasing length
+    if (r.Width > dx)
+        dir = -1; // decreasing length
+    for (;;) {
+        n += dir;
+        r = MeasureText(s, n);
+        if (1 == dir) {
+            // if advancing length, we know that previous string did fit, so if
+            // the new one doesn't fit, the previous length was the right one
+            if (r.Width > dx)
+                return n - 1;
+        } else {
+            // if decreasing length, we know that previous string didn't fit, so if
+            // the one one fits, it's of the correct length
+            if (r.Width < dx)
+                return n;
+        }
+    }
+}
+
 // a text run is a string of consecutive text with uniform style
 void HtmlFormatter::EmitTextRun(const char *s, const char *end)
 {
@@ -749,8 +903,7 @@ void HtmlFormatter::EmitTextRun(const char *s, const char *end)
         strLen -= str::RemoveChars(buf, L"\xad");
         if (0 == strLen)
             break;
-        textMeasure->SetFont(CurrFont());
-        RectF bbox = textMeasure->Measure(buf, strLen);
+        RectF bbox = MeasureText(buf, strLen);
         EnsureDx(bbox.Width);
         if (bbox.Width <= pageDx - currX) {
             AppendInstr(DrawInstr::Str(s, end - s, bbox, dirRtl));
@@ -758,7 +911,7 @@ void HtmlFormatter::EmitTextRun(const char *s, const char *end)
             break;
         }
 
-        size_t lenThatFits = StringLenForWidth(textMeasure, buf, strLen, pageDx - NewLineX());
+        size_t lenThatFits = StringLenForWidth(buf, strLen, pageDx - NewLineX());
 
         //jjg 注释掉这块,解决中文标点导致的不正常换行问题
         // try to prevent a break in the middle of a word
@@ -771,8 +924,7 @@ void HtmlFormatter::EmitTextRun(const char *s, const char *end)
         //    }
         //}
 
-        textMeasure->SetFont(CurrFont());
-        bbox = textMeasure->Measure(buf, lenThatFits);
+        bbox = MeasureText(buf, lenThatFits);
         CrashIf(bbox.Width > pageDx);
         // s is UTF-8 and buf is UTF-16, so one
         // WCHAR doesn't always equal one char
@@ -169,6 +169,8 @@ protected:
 
     bool  EmitImage(ImageData *img);
     void  EmitHr();
+    RectF  MeasureText(const WCHAR *s, size_t len);
+    size_t StringLenForWidth(const WCHAR *s, size_t len, float dx);
     void  EmitTextRun(const char *s, const char *end);
     void  EmitElasticSpace();
     void  EmitParagraph(float indent);
@@ -257,10 +259,22 @@ public:
 
     HtmlPage *Next(bool skipEmptyPages=true);
     Vec<HtmlPage*> *FormatAllPages(bool skipEmptyPages=true);
+
+    // how far formatting has progressed (e.g. for estimating the page count)
+    size_t ParsedLen() const { return (size_t)currReparseIdx; }
+    size_t HtmlLen() const { return htmlParser->Len(); }
 };
 
 void DrawHtmlPage(Graphics *g, mui::ITextRender *textRender, Vec<DrawInstr> *drawInstructions, REAL offX, REAL offY, bool showBbox, Color textColor, bool *abortCookie=nullptr);
 
+// counters for the text measurement cache shared by all HtmlFormatters
+struct TextMeasureStats {
+    size_t hits;
+    size_t misses;
+};
+
+TextMeasureStats GetTextMeasureStats();
+
 mui::TextRenderMethod GetTextRenderMethod();
 void SetTextRenderMethod(mui::TextRenderMethod method);
 HtmlFormatterArgs *CreateFormatterDefaultArgs(int dx, int dy, Allocator *textAllocator=nullptr);
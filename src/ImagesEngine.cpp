@@ -9,6 +9,7 @@
 #include "HtmlParserLookup.h"
 #include "HtmlPullParser.h"
 #include "JsonParser.h"
+#include "ThreadUtil.h"
 #include "WinUtil.h"
 // rendering engines
 #include "BaseEngine.h"
@@ -17,6 +18,15 @@
 
 // number of decoded bitmaps to cache for quicker rendering
 #define MAX_IMAGE_PAGE_CACHE    10
+// enough data for determining an image's dimensions for most files
+#define MAX_IMAGE_HEADER_SIZE   (8 * 1024)
+// number of pages before and after the current one to decode ahead of time
+#define IMAGE_PREFETCH_PAGES    2
+#define MAX_IMAGE_PREFETCHERS   2
+// don't decode further pages ahead of time once the cached pages use this much memory
+#define MAX_IMAGE_PREFETCH_MEMORY   (256 * 1024 * 1024)
+// pages rendered at a smaller size (e.g. thumbnails) don't decode any further pages ahead of time
+#define IMAGE_PREFETCH_MIN_PIXELS   (512 * 512)
 
 ///// ImagesEngine methods apply to all types of engines handling full-page images /////
 
@@ -25,11 +35,50 @@ struct ImagePage {
     Bitmap *bmp;
     bool ownBmp;
     int refs;
+    // estimated memory needed for the decoded bitmap
+    size_t memSize;
+    // bmp might have been decoded at 1/2^reduce of the image's resolution
+    int reduce;
+    // decoded ahead of time and not yet requested
+    bool prefetched;
+
+    ImagePage(int pageNo, Bitmap *bmp, int reduce=0) :
+        pageNo(pageNo), bmp(bmp), ownBmp(true), refs(1), memSize(0), reduce(reduce), prefetched(false) { }
+};
 
-    ImagePage(int pageNo, Bitmap *bmp) :
-        pageNo(pageNo), bmp(bmp), ownBmp(true), refs(1) { }
+// marks a page which is being decoded ahead of time, so that GetPage
+// can wait for it instead of decoding the same page a second time
+struct ImagePageDecode {
+    int pageNo;
+    int reduce;
+    HANDLE done;
+    int refs;
+
+    ImagePageDecode(int pageNo, int reduce) : pageNo(pageNo), reduce(reduce), refs(1) {
+        done = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    }
+    ~ImagePageDecode() { CloseHandle(done); }
 };
 
+// returns how often the image's resolution can be halved
+// while still rendering it at the given zoom level
+static int GetImageReduction(float zoom)
+{
+    int reduce = 0;
+    // libjpeg only supports scaling down by up to 1/8
+    while (reduce < 3 && zoom * (2 << reduce) <= 1.0f) {
+        reduce++;
+    }
+    return reduce;
+}
+
+static size_t GetBitmapMemSize(Bitmap *bmp)
+{
+    if (!bmp)
+        return 0;
+    return (size_t)bmp->GetWidth() * bmp->GetHeight() * 4;
+}
+
 class ImageElement;
 
 class ImagesEngine : public BaseEngine {
@@ -82,15 +131,31 @@ protected:
 
     CRITICAL_SECTION cacheAccess;
     Vec<ImagePage *> pageCache;
+    // pages currently being decoded ahead of time (protected by cacheAccess)
+    Vec<ImagePageDecode *> pageDecodes;
     Vec<RectD> mediaboxes;
 
     void GetTransform(Matrix& m, int pageNo, float zoom, int rotation);
 
-    virtual Bitmap *LoadBitmap(int pageNo, bool& deleteAfterUse) = 0;
+    // reduce > 0 allows to load the image at 1/2^reduce of its resolution
+    virtual Bitmap *LoadBitmap(int pageNo, int reduce, bool& deleteAfterUse) = 0;
     virtual RectD LoadMediabox(int pageNo) = 0;
 
-    ImagePage *GetPage(int pageNo, bool tryOnly=false);
+    // returns a page with at least 1/2^reduce of the image's resolution
+    ImagePage *GetPage(int pageNo, bool tryOnly=false, int reduce=0);
     void DropPage(ImagePage *page, bool forceRemove=false);
+    // registers a page for being decoded ahead of time (returns false if it's
+    // already cached or being decoded); FinishPageDecode must be called afterwards
+    bool StartPageDecode(int pageNo, int reduce);
+    // adds a page decoded ahead of time to the cache (takes ownership of bmp,
+    // which may be nullptr if decoding failed)
+    void FinishPageDecode(int pageNo, int reduce, Bitmap *bmp);
+    ImagePageDecode *FindPageDecode(int pageNo, int reduce);
+    bool IsPageCached(int pageNo, int reduce=0);
+    size_t CachedPagesMemSize();
+
+    // called after a page has been rendered
+    virtual void PrefetchAdjacentPages(int pageNo, int reduce) { UNUSED(pageNo); UNUSED(reduce); }
 };
 
 ImagesEngine::ImagesEngine() : fileName(nullptr)
@@ -122,13 +187,17 @@ RectD ImagesEngine::PageMediabox(int pageNo)
 
 RenderedBitmap *ImagesEngine::RenderBitmap(int pageNo, float zoom, int rotation, RectD *pageRect, RenderTarget target, AbortCookie **cookieOut)
 {
-    UNUSED(target); UNUSED(cookieOut);
-    ImagePage *page = GetPage(pageNo);
+    UNUSED(cookieOut);
+    // decode large images at a lower resolution when zoomed out
+    int reduce = GetImageReduction(zoom);
+    ImagePage *page = GetPage(pageNo, false, reduce);
     if (!page)
         return nullptr;
 
     RectD pageRc = pageRect ? *pageRect : PageMediabox(pageNo);
     RectI screen = Transform(pageRc, pageNo, zoom, rotation).Round();
+    if (Target_View == target && (int64)screen.dx * screen.dy >= IMAGE_PREFETCH_MIN_PIXELS)
+        PrefetchAdjacentPages(pageNo, reduce);
     PointI screenTL = screen.TL();
     screen.Offset(-screen.x, -screen.y);
 
@@ -154,9 +223,11 @@ RenderedBitmap *ImagesEngine::RenderBitmap(int pageNo, float zoom, int rotation,
     g.SetTransform(&m);
 
     RectI pageRcI = PageMediabox(pageNo).Round();
+    // a reduced bitmap still covers the entire page
+    SizeI srcSize = page->reduce > 0 ? SizeI(page->bmp->GetWidth(), page->bmp->GetHeight()) : pageRcI.Size();
     ImageAttributes imgAttrs;
     imgAttrs.SetWrapMode(WrapModeTileFlipXY);
-    Status ok = g.DrawImage(page->bmp, pageRcI.ToGdipRect(), 0, 0, pageRcI.dx, pageRcI.dy, UnitPixel, &imgAttrs);
+    Status ok = g.DrawImage(page->bmp, pageRcI.ToGdipRect(), 0, 0, srcSize.dx, srcSize.dy, UnitPixel, &imgAttrs);
 
     DropPage(page);
     DeleteDC(hDC);
@@ -269,20 +340,38 @@ bool ImagesEngine::SaveFileAs(const WCHAR *copyFileName, bool includeUserAnnots)
     return false;
 }
 
-ImagePage *ImagesEngine::GetPage(int pageNo, bool tryOnly)
+ImagePage *ImagesEngine::GetPage(int pageNo, bool tryOnly, int reduce)
 {
     ScopedCritSec scope(&cacheAccess);
 
     ImagePage *result = nullptr;
 
     for (size_t i = 0; i < pageCache.Count(); i++) {
-        if (pageCache.At(i)->pageNo == pageNo) {
+        // pages with a higher resolution than needed can be used as well
+        if (pageCache.At(i)->pageNo == pageNo && pageCache.At(i)->reduce <= reduce) {
             result = pageCache.At(i);
             break;
         }
     }
     if (!result && tryOnly)
         return nullptr;
+    // wait for a prefetcher which is already decoding this page
+    // instead of decoding it a second time
+    ImagePageDecode *decode;
+    if (!result && (decode = FindPageDecode(pageNo, reduce)) != nullptr) {
+        decode->refs++;
+        LeaveCriticalSection(&cacheAccess);
+        WaitForSingleObject(decode->done, INFINITE);
+        EnterCriticalSection(&cacheAccess);
+        if (0 == --decode->refs)
+            delete decode;
+        for (size_t i = 0; i < pageCache.Count(); i++) {
+            if (pageCache.At(i)->pageNo == pageNo && pageCache.At(i)->reduce <= reduce) {
+                result = pageCache.At(i);
+                break;
+            }
+        }
+    }
     if (!result) {
         // TODO: drop most memory intensive pages first
         // (i.e. formats which aren't IsGdiPlusNativeFormat)?
@@ -290,8 +379,9 @@ ImagePage *ImagesEngine::GetPage(int pageNo, bool tryOnly)
             CrashIf(pageCache.Count() != MAX_IMAGE_PAGE_CACHE);
             DropPage(pageCache.Last(), true);
         }
-        result = new ImagePage(pageNo, nullptr);
-        result->bmp = LoadBitmap(pageNo, result->ownBmp);
+        result = new ImagePage(pageNo, nullptr, reduce);
+        result->bmp = LoadBitmap(pageNo, reduce, result->ownBmp);
+        result->memSize = GetBitmapMemSize(result->bmp);
         pageCache.InsertAt(0, result);
     }
     else if (result != pageCache.At(0)) {
@@ -303,8 +393,10 @@ ImagePage *ImagesEngine::GetPage(int pageNo, bool tryOnly)
     if (result && !result->bmp)
         result = nullptr;
 
-    if (result)
+    if (result) {
         result->refs++;
+        result->prefetched = false;
+    }
     return result;
 }
 
@@ -323,6 +415,84 @@ void ImagesEngine::DropPage(ImagePage *page, bool forceRemove)
     }
 }
 
+bool ImagesEngine::StartPageDecode(int pageNo, int reduce)
+{
+    ScopedCritSec scope(&cacheAccess);
+    if (IsPageCached(pageNo, reduce) || FindPageDecode(pageNo, reduce))
+        return false;
+    pageDecodes.Append(new ImagePageDecode(pageNo, reduce));
+    return true;
+}
+
+void ImagesEngine::FinishPageDecode(int pageNo, int reduce, Bitmap *bmp)
+{
+    ScopedCritSec scope(&cacheAccess);
+    ImagePageDecode *decode = nullptr;
+    for (ImagePageDecode *d : pageDecodes) {
+        if (d->pageNo == pageNo && d->reduce == reduce)
+            decode = d;
+    }
+    CrashIf(!decode);
+
+    if (bmp && !IsPageCached(pageNo, reduce) && pageCache.Count() >= MAX_IMAGE_PAGE_CACHE) {
+        // make room by dropping the least recently used page which is neither
+        // in use nor has itself been decoded ahead of time and not been shown yet
+        for (size_t i = pageCache.Count(); i > 0; i--) {
+            ImagePage *page = pageCache.At(i - 1);
+            if (1 == page->refs && !page->prefetched) {
+                DropPage(page, true);
+                break;
+            }
+        }
+    }
+    if (bmp && !IsPageCached(pageNo, reduce) && pageCache.Count() < MAX_IMAGE_PAGE_CACHE) {
+        // pages which haven't been shown yet are the first to be dropped again
+        ImagePage *page = new ImagePage(pageNo, bmp, reduce);
+        page->memSize = GetBitmapMemSize(bmp);
+        page->prefetched = true;
+        pageCache.Append(page);
+    }
+    else {
+        delete bmp;
+    }
+
+    pageDecodes.Remove(decode);
+    SetEvent(decode->done);
+    if (0 == --decode->refs)
+        delete decode;
+}
+
+// caller must hold cacheAccess
+ImagePageDecode *ImagesEngine::FindPageDecode(int pageNo, int reduce)
+{
+    for (ImagePageDecode *decode : pageDecodes) {
+        // pages with a higher resolution than needed can be used as well
+        if (decode->pageNo == pageNo && decode->reduce <= reduce)
+            return decode;
+    }
+    return nullptr;
+}
+
+bool ImagesEngine::IsPageCached(int pageNo, int reduce)
+{
+    ScopedCritSec scope(&cacheAccess);
+    for (ImagePage *page : pageCache) {
+        if (page->pageNo == pageNo && page->reduce <= reduce)
+            return true;
+    }
+    return false;
+}
+
+size_t ImagesEngine::CachedPagesMemSize()
+{
+    ScopedCritSec scope(&cacheAccess);
+    size_t memSize = 0;
+    for (ImagePage *page : pageCache) {
+        memSize += page->memSize;
+    }
+    return memSize;
+}
+
 ///// ImageEngine handles a single image file /////
 
 class ImageEngineImpl : public ImagesEngine {
@@ -350,7 +520,7 @@ protected:
     bool LoadFromStream(IStream *stream);
     bool FinishLoading();
 
-    virtual Bitmap *LoadBitmap(int pageNo, bool& deleteAfterUse);
+    virtual Bitmap *LoadBitmap(int pageNo, int reduce, bool& deleteAfterUse);
     virtual RectD LoadMediabox(int pageNo);
 };
 
@@ -475,8 +645,10 @@ WCHAR *ImageEngineImpl::GetProperty(DocumentProperty prop)
     }
 }
 
-Bitmap *ImageEngineImpl::LoadBitmap(int pageNo, bool& deleteAfterUse)
+Bitmap *ImageEngineImpl::LoadBitmap(int pageNo, int reduce, bool& deleteAfterUse)
 {
+    // the image has already been decoded at its full resolution
+    UNUSED(reduce);
     if (1 == pageNo) {
         deleteAfterUse = false;
         return image;
@@ -642,7 +814,7 @@ public:
 protected:
     bool LoadImageDir(const WCHAR *dirName);
 
-    virtual Bitmap *LoadBitmap(int pageNo, bool& deleteAfterUse);
+    virtual Bitmap *LoadBitmap(int pageNo, int reduce, bool& deleteAfterUse);
     virtual RectD LoadMediabox(int pageNo);
 
     WStrVec pageFileNames;
@@ -739,21 +911,33 @@ bool ImageDirEngineImpl::SaveFileAs(const WCHAR *copyFileName, bool includeUserA
     return ok;
 }
 
-Bitmap *ImageDirEngineImpl::LoadBitmap(int pageNo, bool& deleteAfterUse)
+Bitmap *ImageDirEngineImpl::LoadBitmap(int pageNo, int reduce, bool& deleteAfterUse)
 {
     size_t len;
     ScopedMem<char> bmpData(file::ReadAll(pageFileNames.At(pageNo - 1), &len));
     if (bmpData) {
         deleteAfterUse = true;
-        return BitmapFromData(bmpData, len);
+        return BitmapFromData(bmpData, len, reduce);
     }
     return nullptr;
 }
 
 RectD ImageDirEngineImpl::LoadMediabox(int pageNo)
 {
-    size_t len;
-    ScopedMem<char> bmpData(file::ReadAll(pageFileNames.At(pageNo - 1), &len));
+    const WCHAR *filePath = pageFileNames.At(pageNo - 1);
+    // try to determine the image size from the file's header first
+    int64 fileSize = file::GetSize(filePath);
+    if (fileSize < 0)
+        return RectD();
+    char header[MAX_IMAGE_HEADER_SIZE];
+    size_t len = (size_t)std::min(fileSize, (int64)sizeof(header));
+    if (len > 0 && file::ReadN(filePath, header, len)) {
+        Size size = ImageSizeFromHeader(header, len);
+        if (!size.Empty())
+            return RectD(0, 0, size.Width, size.Height);
+    }
+
+    ScopedMem<char> bmpData(file::ReadAll(filePath, &len));
     if (bmpData) {
         Size size = BitmapSizeFromData(bmpData, len);
         return RectD(0, 0, size.Width, size.Height);
@@ -807,10 +991,16 @@ BaseEngine *CreateFromFile(const WCHAR *fileName)
 
 enum CbxFormat { Arch_Zip, Arch_Rar, Arch_7z, Arch_Tar };
 
+class CbxPrefetcher;
+
 class CbxEngineImpl : public ImagesEngine, public json::ValueVisitor {
+    friend CbxPrefetcher;
+
 public:
-    CbxEngineImpl(ArchFile *arch, CbxFormat cbxFormat) : cbxFile(arch), cbxFormat(cbxFormat) { }
-    virtual ~CbxEngineImpl() { delete cbxFile; }
+    CbxEngineImpl(ArchFile *arch, CbxFormat cbxFormat) : cbxFile(arch), cbxFormat(cbxFormat), prefetchReduce(0) {
+        ZeroMemory(prefetchers, sizeof(prefetchers));
+    }
+    virtual ~CbxEngineImpl();
 
     virtual BaseEngine *Clone()  override {
         if (fileStream) {
@@ -841,7 +1031,7 @@ public:
     static BaseEngine *CreateFromStream(IStream *stream);
 
 protected:
-    virtual Bitmap *LoadBitmap(int pageNo, bool& deleteAfterUse);
+    virtual Bitmap *LoadBitmap(int pageNo, int reduce, bool& deleteAfterUse);
     virtual RectD LoadMediabox(int pageNo);
 
     bool LoadFromFile(const WCHAR *fileName);
@@ -849,13 +1039,25 @@ protected:
     bool FinishLoading();
 
     char *GetImageData(int pageNo, size_t& len);
+    char *GetImageHeader(int pageNo, size_t& len);
     void ParseComicInfoXml(const char *xmlData);
 
+    void PrefetchAdjacentPages(int pageNo, int reduce) override;
+    ArchFile *OpenArchive();
+    int NextPrefetchPage(int& reduce);
+    void PrefetchPage(ArchFile *arch, int pageNo, int reduce);
+    Bitmap *DecodePage(ArchFile *arch, int pageNo, int reduce);
+
     // access to cbxFile must be protected after initialization (with cacheAccess)
     ArchFile *cbxFile;
     CbxFormat cbxFormat;
     Vec<size_t> fileIdxs;
 
+    // pages to be decoded by the prefetchers (protected by cacheAccess)
+    Vec<int> prefetchQueue;
+    int prefetchReduce;
+    CbxPrefetcher *prefetchers[MAX_IMAGE_PREFETCHERS];
+
     // extracted metadata
     ScopedMem<WCHAR> propTitle;
     WStrVec propAuthors;
@@ -867,6 +1069,60 @@ protected:
     ScopedMem<WCHAR> propAuthorTmp;
 };
 
+// decodes the pages adjacent to the current one in the background
+class CbxPrefetcher : public ThreadBase {
+    CbxEngineImpl *engine;
+    HANDLE event;
+
+public:
+    explicit CbxPrefetcher(CbxEngineImpl *engine) : ThreadBase("CbxPrefetcher"), engine(engine) {
+        event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    }
+    virtual ~CbxPrefetcher() { CloseHandle(event); }
+
+    void Request() { SetEvent(event); }
+    void Stop() {
+        RequestCancel();
+        SetEvent(event);
+        Join();
+    }
+
+    // ThreadBase
+    virtual void Run();
+};
+
+void CbxPrefetcher::Run()
+{
+    // every prefetcher extracts from its own instance of the archive
+    // so that pages can be extracted in parallel without locking
+    ScopedPtr<ArchFile> arch;
+    while (!WasCancelRequested()) {
+        WaitForSingleObject(event, INFINITE);
+        int pageNo, reduce;
+        while (!WasCancelRequested() && (pageNo = engine->NextPrefetchPage(reduce)) != 0) {
+            if (!arch)
+                arch = engine->OpenArchive();
+            if (!arch) {
+                // don't keep GetPage waiting for this page
+                engine->FinishPageDecode(pageNo, reduce, nullptr);
+                return;
+            }
+            engine->PrefetchPage(arch, pageNo, reduce);
+        }
+    }
+}
+
+CbxEngineImpl::~CbxEngineImpl()
+{
+    for (size_t i = 0; i < dimof(prefetchers); i++) {
+        if (prefetchers[i]) {
+            prefetchers[i]->Stop();
+            delete prefetchers[i];
+        }
+    }
+    delete cbxFile;
+}
+
 bool CbxEngineImpl::LoadFromFile(const WCHAR *file)
 {
     if (!file)
@@ -886,9 +1142,21 @@ bool CbxEngineImpl::LoadFromStream(IStream *stream)
     return FinishLoading();
 }
 
-static int cmpAscii(const void *a, const void *b)
+struct PageFileName {
+    const WCHAR *name;
+    size_t idx;
+};
+
+// sorts pages by name (comparing numbers by value) and pages with
+// identical names in the order in which they appear in the archive
+static int cmpPageFileName(const void *a, const void *b)
 {
-    return wcscmp(*(const WCHAR **)a, *(const WCHAR **)b);
+    const PageFileName *pa = (const PageFileName *)a;
+    const PageFileName *pb = (const PageFileName *)b;
+    int cmp = str::CmpNatural(pa->name, pb->name);
+    if (cmp != 0)
+        return cmp;
+    return pa->idx < pb->idx ? -1 : pa->idx > pb->idx ? 1 : 0;
 }
 
 bool CbxEngineImpl::FinishLoading()
@@ -897,26 +1165,24 @@ bool CbxEngineImpl::FinishLoading()
     if (!cbxFile)
         return false;
 
-    Vec<const WCHAR *> allFileNames;
-    Vec<const WCHAR *> pageFileNames;
+    // sorting (name, index) pairs avoids having to look up the
+    // index of every page by name (which is quadratic in the
+    // number of files for scans with tens of thousands of pages)
+    Vec<PageFileName> pageFiles;
 
     for (size_t idx = 0; idx < cbxFile->GetFileCount(); idx++) {
         const WCHAR *fileName = cbxFile->GetFileName(idx);
         if (fileName && ImageEngine::IsSupportedFile(fileName) &&
             // OS X occasionally leaves metadata with image extensions
             !str::StartsWith(path::GetBaseName(fileName), L".")) {
-            allFileNames.Append(fileName);
-            pageFileNames.Append(fileName);
+            PageFileName page = { fileName, idx };
+            pageFiles.Append(page);
         }
         else if (Arch_Zip == cbxFormat && str::StartsWith(fileName, L"_rels/.rels")) {
             // bail, if we accidentally try to load an XPS file
             return false;
         }
-        else {
-            allFileNames.Append(nullptr);
-        }
     }
-    AssertCrash(allFileNames.Count() == cbxFile->GetFileCount());
 
     ScopedMem<char> metadata(cbxFile->GetFileDataByName(L"ComicInfo.xml"));
     if (metadata)
@@ -925,11 +1191,11 @@ bool CbxEngineImpl::FinishLoading()
     if (metadata)
         json::Parse(metadata, this);
 
-    pageFileNames.Sort(cmpAscii);
-    for (const WCHAR *fn : pageFileNames) {
-        fileIdxs.Append(allFileNames.Find(fn));
+    pageFiles.Sort(cmpPageFileName);
+    for (PageFileName& page : pageFiles) {
+        fileIdxs.Append(page.idx);
     }
-    AssertCrash(pageFileNames.Count() == fileIdxs.Count());
+    AssertCrash(pageFiles.Count() == fileIdxs.Count());
     if (fileIdxs.Count() == 0)
         return false;
 
@@ -945,6 +1211,107 @@ char *CbxEngineImpl::GetImageData(int pageNo, size_t& len)
     return cbxFile->GetFileDataByIdx(fileIdxs.At(pageNo - 1), &len);
 }
 
+char *CbxEngineImpl::GetImageHeader(int pageNo, size_t& len)
+{
+    AssertCrash(1 <= pageNo && pageNo <= PageCount());
+    ScopedCritSec scope(&cacheAccess);
+    return cbxFile->GetFileDataStartByIdx(fileIdxs.At(pageNo - 1), MAX_IMAGE_HEADER_SIZE, &len);
+}
+
+ArchFile *CbxEngineImpl::OpenArchive()
+{
+    ScopedComPtr<IStream> stream;
+    if (fileStream && FAILED(fileStream->Clone(&stream)))
+        return nullptr;
+    if (!stream && !fileName)
+        return nullptr;
+
+    ScopedPtr<ArchFile> arch;
+    switch (cbxFormat) {
+    case Arch_Zip: arch = stream ? new ZipFile(stream) : new ZipFile(fileName); break;
+    case Arch_Rar: arch = stream ? new RarFile(stream) : new RarFile(fileName); break;
+    case Arch_7z:  arch = stream ? new _7zFile(stream) : new _7zFile(fileName); break;
+    case Arch_Tar: arch = stream ? new TarFile(stream) : new TarFile(fileName); break;
+    default: CrashIf(true); return nullptr;
+    }
+
+    // fileIdxs must be valid for the new instance as well
+    ScopedCritSec scope(&cacheAccess);
+    if (arch->GetFileCount() != cbxFile->GetFileCount())
+        return nullptr;
+    return arch.Detach();
+}
+
+void CbxEngineImpl::PrefetchAdjacentPages(int pageNo, int reduce)
+{
+    ScopedCritSec scope(&cacheAccess);
+    // first decode the pages after and before the current one, then
+    // (for Facing and Book View) the following ones in either direction
+    prefetchQueue.Reset();
+    prefetchReduce = reduce;
+    for (int i = 1; i <= IMAGE_PREFETCH_PAGES; i++) {
+        if (pageNo + i <= PageCount() && !IsPageCached(pageNo + i, reduce))
+            prefetchQueue.Append(pageNo + i);
+        if (pageNo - i >= 1 && !IsPageCached(pageNo - i, reduce))
+            prefetchQueue.Append(pageNo - i);
+    }
+    for (size_t i = 0; i < prefetchQueue.Count() && i < dimof(prefetchers); i++) {
+        if (!prefetchers[i]) {
+            prefetchers[i] = new CbxPrefetcher(this);
+            prefetchers[i]->Start();
+        }
+        prefetchers[i]->Request();
+    }
+}
+
+// called on a CbxPrefetcher's thread
+int CbxEngineImpl::NextPrefetchPage(int& reduce)
+{
+    ScopedCritSec scope(&cacheAccess);
+    reduce = prefetchReduce;
+    // only use the memory that isn't needed for the pages currently being rendered
+    if (CachedPagesMemSize() >= MAX_IMAGE_PREFETCH_MEMORY)
+        return 0;
+    while (prefetchQueue.Count() > 0) {
+        int pageNo = prefetchQueue.PopAt(0);
+        if (StartPageDecode(pageNo, reduce))
+            return pageNo;
+    }
+    return 0;
+}
+
+// called on a CbxPrefetcher's thread (after StartPageDecode)
+void CbxEngineImpl::PrefetchPage(ArchFile *arch, int pageNo, int reduce)
+{
+    FinishPageDecode(pageNo, reduce, DecodePage(arch, pageNo, reduce));
+}
+
+Bitmap *CbxEngineImpl::DecodePage(ArchFile *arch, int pageNo, int reduce)
+{
+    size_t len;
+    ScopedMem<char> bmpData(arch->GetFileDataByIdx(fileIdxs.At(pageNo - 1), &len));
+    if (!bmpData)
+        return nullptr;
+    ScopedPtr<Bitmap> bmp(BitmapFromData(bmpData, len, reduce));
+    if (!bmp)
+        return nullptr;
+
+    // GDI+ only decodes images when they're first drawn, so do that here
+    // instead of on the rendering thread (premultiplied alpha is what
+    // GDI+ draws fastest with)
+    int dx = bmp->GetWidth(), dy = bmp->GetHeight();
+    ScopedPtr<Bitmap> decoded(new Bitmap(dx, dy, PixelFormat32bppPARGB));
+    if (decoded->GetLastStatus() != Ok)
+        return nullptr;
+    {
+        Graphics g(decoded);
+        g.SetCompositingMode(CompositingModeSourceCopy);
+        if (g.DrawImage(bmp, 0, 0, dx, dy) != Ok)
+            return nullptr;
+    }
+    return decoded.Detach();
+}
+
 static char *GetTextContent(HtmlPullParser& parser)
 {
     HtmlToken *tok = parser.Next();
@@ -1084,28 +1451,37 @@ const WCHAR *CbxEngineImpl::GetDefaultFileExt() const
     }
 }
 
-Bitmap *CbxEngineImpl::LoadBitmap(int pageNo, bool& deleteAfterUse)
+Bitmap *CbxEngineImpl::LoadBitmap(int pageNo, int reduce, bool& deleteAfterUse)
 {
     size_t len;
     ScopedMem<char> bmpData(GetImageData(pageNo, len));
     if (bmpData) {
         deleteAfterUse = true;
-        return BitmapFromData(bmpData, len);
+        return BitmapFromData(bmpData, len, reduce);
     }
     return nullptr;
 }
 
 RectD CbxEngineImpl::LoadMediabox(int pageNo)
 {
-    // fill the cache to prevent the first few images from being unpacked twice
-    ImagePage *page = GetPage(pageNo, MAX_IMAGE_PAGE_CACHE == pageCache.Count());
+    // reuse the image if it's already been decoded
+    ImagePage *page = GetPage(pageNo, true);
     if (page) {
         RectD mbox(0, 0, page->bmp->GetWidth(), page->bmp->GetHeight());
         DropPage(page);
         return mbox;
     }
 
+    // try to determine the image size by only extracting the image's header
+    // so that laying out all pages doesn't require unpacking the entire archive
     size_t len;
+    ScopedMem<char> header(GetImageHeader(pageNo, len));
+    if (header) {
+        Size size = ImageSizeFromHeader(header, len);
+        if (!size.Empty())
+            return RectD(0, 0, size.Width, size.Height);
+    }
+
     ScopedMem<char> bmpData(GetImageData(pageNo, len));
     if (bmpData) {
         Size size = BitmapSizeFromData(bmpData, len);
@@ -10,6 +10,7 @@
 #include "HtmlParserLookup.h"
 #include "HtmlPullParser.h"
 #include "PalmDbReader.h"
+#include "Timer.h"
 #include "TrivialHtmlParser.h"
 // rendering engines
 #include "BaseEngine.h"
@@ -193,11 +194,27 @@ static_assert(kCdicHeaderLen == sizeof(CdicHeader), "wrong size of CdicHeader st
 
 #define kCdicsMax 32
 
+// number of leading bits for which the lengths of all codes
+// up to that length are looked up in a single table
+#define kHuffLookupBits     12
+#define kHuffLookupCount    (1 << kHuffLookupBits)
+
+// expanding dictionary entries is only cached for reasonable code lengths
+#define kMaxExpandedCodeLen 16
+
 class HuffDicDecompressor
 {
     uint32      cacheTable[kCacheItemCount];
     uint32      baseTable[kBaseTableItemCount];
 
+    // the length of a code starting with the given kHuffLookupBits bits
+    // (or 0 if the code is longer) and the value the code is subtracted from
+    struct LookupEntry {
+        uint32  codeLen;
+        uint32  maxCode;
+    };
+    LookupEntry lookupTable[kHuffLookupCount];
+
     size_t      dictsCount;
     // owned by the creator (in our case: by the PdbReader)
     uint8 *     dicts[kCdicsMax];
@@ -205,20 +222,177 @@ class HuffDicDecompressor
 
     uint32      codeLength;
 
+    // fully expanded (i.e. recursively decompressed) dictionary entries
+    struct ExpandedEntry {
+        uint32  offset;
+        uint32  len;
+    };
+    Vec<ExpandedEntry> expanded;
+    str::Str<char> expandedData;
+
     Vec<uint32> recursionGuard;
 
+    void BuildLookupTable();
+    bool DecodeOne(uint32 code, str::Str<char>& dst);
+    bool DecodeOneReference(uint32 code, str::Str<char>& dst);
+
 public:
     HuffDicDecompressor();
 
     bool SetHuffData(uint8 *huffData, size_t huffDataLen);
     bool AddCdicData(uint8 *cdicData, uint32 cdicDataLen);
     bool Decompress(uint8 *src, size_t octets, str::Str<char>& dst);
-    bool DecodeOne(uint32 code, str::Str<char>& dst);
+    // the original bit-by-bit decoder (for verification and benchmarking)
+    bool DecompressReference(uint8 *src, size_t octets, str::Str<char>& dst);
 };
 
 HuffDicDecompressor::HuffDicDecompressor() : codeLength(0), dictsCount(0) { }
 
+void HuffDicDecompressor::BuildLookupTable()
+{
+    for (uint32 i = 0; i < kHuffLookupCount; i++) {
+        uint32 bits = i << (32 - kHuffLookupBits);
+        uint32 v = cacheTable[bits >> 24];
+        uint32 codeLen = v & 0x1f;
+        lookupTable[i].codeLen = 0;
+        if (!codeLen)
+            continue;
+        if ((v & 0x80)) {
+            lookupTable[i].codeLen = codeLen;
+            lookupTable[i].maxCode = v >> 8;
+            continue;
+        }
+        for (; codeLen <= kHuffLookupBits; codeLen++) {
+            if (baseTable[codeLen * 2 - 2] <= (bits >> (32 - codeLen))) {
+                lookupTable[i].codeLen = codeLen;
+                lookupTable[i].maxCode = baseTable[codeLen * 2 - 1];
+                break;
+            }
+        }
+    }
+}
+
 bool HuffDicDecompressor::DecodeOne(uint32 code, str::Str<char>& dst)
+{
+    uint32 fullCode = code;
+    uint16 dict = (uint16)(code >> codeLength);
+    if (dict >= dictsCount) {
+        lf("invalid dict value");
+        return false;
+    }
+    code &= ((1 << (codeLength)) - 1);
+    uint16 offset = UInt16BE(dicts[dict] + code * 2);
+
+    if ((uint32)offset + 2 > dictSize[dict]) {
+        lf("invalid offset");
+        return false;
+    }
+    uint16 symLen = UInt16BE(dicts[dict] + offset);
+    uint8 *p = dicts[dict] + offset + 2;
+    if ((uint32)(symLen & 0x7fff) > dictSize[dict] - offset - 2) {
+        lf("invalid symLen");
+        return false;
+    }
+
+    if ((symLen & 0x8000)) {
+        symLen &= 0x7fff;
+        if (symLen > 127) {
+            lf("symLen too big");
+            return false;
+        }
+        dst.Append((char *)p, symLen);
+        return true;
+    }
+
+    bool cacheable = codeLength <= kMaxExpandedCodeLen;
+    if (cacheable && 0 == expanded.Count()) {
+        ExpandedEntry *entries = expanded.AppendBlanks(dictsCount << codeLength);
+        for (size_t i = 0; i < expanded.Count(); i++) {
+            entries[i].len = (uint32)-1;
+        }
+    }
+    if (cacheable && expanded.At(fullCode).len != (uint32)-1) {
+        dst.Append(expandedData.Get() + expanded.At(fullCode).offset, expanded.At(fullCode).len);
+        return true;
+    }
+
+    if (recursionGuard.Contains(fullCode)) {
+        lf("infinite recursion");
+        return false;
+    }
+    recursionGuard.Push(fullCode);
+    size_t start = dst.Size();
+    if (!Decompress(p, symLen, dst))
+        return false;
+    recursionGuard.Pop();
+
+    if (cacheable && expandedData.Size() <= (uint32)-1 - (dst.Size() - start)) {
+        expanded.At(fullCode).offset = (uint32)expandedData.Size();
+        expanded.At(fullCode).len = (uint32)(dst.Size() - start);
+        expandedData.Append(dst.Get() + start, dst.Size() - start);
+    }
+    return true;
+}
+
+bool HuffDicDecompressor::Decompress(uint8 *src, size_t srcSize, str::Str<char>& dst)
+{
+    // the next bits of src, aligned to the most significant bit
+    uint64    buf = 0;
+    uint32    bufBits = 0;
+    size_t    bitsLeft = srcSize * 8;
+    uint8 *   srcEnd = src + srcSize;
+
+    while (bitsLeft > 0) {
+        // refill the buffer so that at least 32 bits are available
+        // (padding with zeroes after the end of the data)
+        for (; bufBits <= 56; bufBits += 8) {
+            buf |= (uint64)(src < srcEnd ? *src++ : 0) << (56 - bufBits);
+        }
+
+        uint32 bits = (uint32)(buf >> 32);
+        if (bitsLeft < 8 && 0 == bits)
+            break;
+
+        uint32 codeLen, maxCode;
+        LookupEntry& entry = lookupTable[bits >> (32 - kHuffLookupBits)];
+        if (entry.codeLen) {
+            codeLen = entry.codeLen;
+            maxCode = entry.maxCode;
+        } else {
+            uint32 v = cacheTable[bits >> 24];
+            codeLen = v & 0x1f;
+            if (!codeLen) {
+                lf("corrupted table, zero code len");
+                return false;
+            }
+            CrashIf((v & 0x80));
+            // codes up to kHuffLookupBits have been handled by the lookup table
+            codeLen = std::max(codeLen, (uint32)kHuffLookupBits + 1);
+            for (; baseTable[codeLen * 2 - 2] > (bits >> (32 - codeLen)); codeLen++) {
+                if (codeLen >= 32) {
+                    lf("code len > 32 bits");
+                    return false;
+                }
+            }
+            maxCode = baseTable[codeLen * 2 - 1];
+        }
+
+        if (codeLen > bitsLeft) {
+            lf("not enough data");
+            return false;
+        }
+        buf <<= codeLen;
+        bufBits -= codeLen;
+        bitsLeft -= codeLen;
+
+        if (!DecodeOne(maxCode - (bits >> (32 - codeLen)), dst))
+            return false;
+    }
+
+    return true;
+}
+
+bool HuffDicDecompressor::DecodeOneReference(uint32 code, str::Str<char>& dst)
 {
     uint16 dict = (uint16)(code >> codeLength);
     if (dict >= dictsCount) {
@@ -245,7 +419,7 @@ bool HuffDicDecompressor::DecodeOne(uint32 code, str::Str<char>& dst)
             return false;
         }
         recursionGuard.Push(code);
-        if (!Decompress(p, symLen, dst))
+        if (!DecompressReference(p, symLen, dst))
             return false;
         recursionGuard.Pop();
     } else {
@@ -259,7 +433,7 @@ bool HuffDicDecompressor::DecodeOne(uint32 code, str::Str<char>& dst)
     return true;
 }
 
-bool HuffDicDecompressor::Decompress(uint8 *src, size_t srcSize, str::Str<char>& dst)
+bool HuffDicDecompressor::DecompressReference(uint8 *src, size_t srcSize, str::Str<char>& dst)
 {
     uint32    bitsConsumed = 0;
     uint32    bits = 0;
@@ -304,7 +478,7 @@ bool HuffDicDecompressor::Decompress(uint8 *src, size_t srcSize, str::Str<char>&
             code = baseTable[codeLen * 2 - 1] - (bits >> (32 - codeLen));
         }
 
-        if (!DecodeOne(code, dst))
+        if (!DecodeOneReference(code, dst))
             return false;
         bitsConsumed = codeLen;
     }
@@ -352,6 +526,7 @@ bool HuffDicDecompressor::SetHuffData(uint8 *huffData, size_t huffDataLen)
         baseTable[i] = d.UInt32();
     }
     CrashIf(d.Offset() != kHuffRecordMinLen);
+    BuildLookupTable();
     return true;
 }
 
@@ -465,18 +640,22 @@ static bool IsValidCompression(int comprType)
 MobiDoc::MobiDoc(const WCHAR *filePath) :
     fileName(str::Dup(filePath)), pdbReader(nullptr),
     docType(Pdb_Unknown), docRecCount(0), compressionType(0), docUncompressedSize(0),
-    doc(nullptr), multibyte(false), trailersCount(0), imageFirstRec(0), coverImageRec(0),
-    imagesCount(0), images(nullptr), huffDic(nullptr), textEncoding(CP_UTF8), docTocIndex((size_t)-1)
+    doc(nullptr), docLeadByte(0), docLoadFailed(false), multibyte(false), trailersCount(0),
+    imageFirstRec(0), coverImageRec(0), imagesCount(0), images(nullptr), imagesLoaded(nullptr),
+    huffDic(nullptr), textEncoding(CP_UTF8), docTocIndex((size_t)-1)
 {
+    InitializeCriticalSection(&docAccess);
 }
 
 MobiDoc::~MobiDoc()
 {
     free(fileName);
     free(images);
+    free(imagesLoaded);
     delete huffDic;
     delete doc;
     delete pdbReader;
+    DeleteCriticalSection(&docAccess);
     for (size_t i = 0; i < props.Count(); i++) {
         free(props.At(i).value);
     }
@@ -689,54 +868,52 @@ static bool KnownImageFormat(const char *data, size_t dataLen)
     return nullptr != GfxFileExtFromData(data, dataLen);
 }
 
-// return false if we should stop loading images (because we
-// encountered eof record or ran out of memory)
-bool MobiDoc::LoadImage(size_t imageNo)
+// reads the image's record the first time the image is needed
+// returns nullptr if the record isn't an image we recognize
+ImageData *MobiDoc::LoadImage(size_t imageNo)
 {
+    ScopedCritSec scope(&docAccess);
+    if (imagesLoaded[imageNo])
+        return images[imageNo].data ? &images[imageNo] : nullptr;
+    imagesLoaded[imageNo] = true;
+
     size_t imageRec = imageFirstRec + imageNo;
     size_t imgDataLen;
 
     const char *imgData = pdbReader->GetRecord(imageRec, &imgDataLen);
     if (!imgData || (0 == imgDataLen))
-        return true;
+        return nullptr;
     if (IsEofRecord((uint8 *)imgData, imgDataLen))
-        return false;
+        return nullptr;
     if (KnownNonImageRec((uint8 *)imgData, imgDataLen))
-        return true;
+        return nullptr;
     if (!KnownImageFormat(imgData, imgDataLen)) {
         lf("Unknown image format");
-        return true;
+        return nullptr;
     }
     images[imageNo].data = (char *)imgData;
-    if (!images[imageNo].data)
-        return false;
     images[imageNo].len = imgDataLen;
-    return true;
+    return &images[imageNo];
 }
 
 void MobiDoc::LoadImages()
 {
     if (0 == imagesCount)
         return;
+    // the image records are read on demand by LoadImage
     images = AllocArray<ImageData>(imagesCount);
-    for (size_t i = 0; i < imagesCount; i++) {
-        if (!LoadImage(i))
-            return;
-    }
+    imagesLoaded = AllocArray<bool>(imagesCount);
 }
 
 // imgRecIndex corresponds to recindex attribute of <img> tag
 // as far as I can tell, this means: it starts at 1
 // returns nullptr if there is no image (e.g. it's not a format we
 // recognize)
-ImageData *MobiDoc::GetImage(size_t imgRecIndex) const
+ImageData *MobiDoc::GetImage(size_t imgRecIndex)
 {
     if ((imgRecIndex > imagesCount) || (imgRecIndex < 1))
         return nullptr;
-    --imgRecIndex;
-    if (!images[imgRecIndex].data || (0 == images[imgRecIndex].len))
-        return nullptr;
-    return &images[imgRecIndex];
+    return LoadImage(imgRecIndex - 1);
 }
 
 ImageData *MobiDoc::GetCoverImage()
@@ -744,9 +921,9 @@ ImageData *MobiDoc::GetCoverImage()
     if (!coverImageRec || coverImageRec < imageFirstRec)
         return nullptr;
     size_t imageNo = coverImageRec - imageFirstRec;
-    if (imageNo >= imagesCount || !images[imageNo].data)
+    if (imageNo >= imagesCount)
         return nullptr;
-    return &images[imageNo];
+    return LoadImage(imageNo);
 }
 
 // each record can have extra data at the end, which we must discard
@@ -785,7 +962,9 @@ static size_t GetRealRecordSize(uint8 *recData, size_t recLen, size_t trailersCo
 bool MobiDoc::LoadDocRecordIntoBuffer(size_t recNo, str::Str<char>& strOut)
 {
     size_t recSize;
-    const char *recData = pdbReader->GetRecord(recNo, &recSize);
+    // text records are only needed once, so don't keep them around
+    ScopedMem<char> rec(pdbReader->ReadRecord(recNo, &recSize));
+    const char *recData = rec.Get();
     if (nullptr == recData)
         return false;
     recSize = GetRealRecordSize((uint8*)recData, recSize, trailersCount, multibyte);
@@ -825,34 +1004,99 @@ bool MobiDoc::LoadDocument(PdbReader *pdbReader)
     if (!ParseHeader())
         return false;
 
-    assert(!doc);
+    // the remaining text records are decompressed on demand, so that e.g.
+    // extracting the cover image doesn't require decompressing all of them
     doc = new str::Str<char>(docUncompressedSize);
-    for (size_t i = 1; i <= docRecCount; i++) {
-        if (!LoadDocRecordIntoBuffer(i, *doc))
+    return LoadTextRecords(0);
+}
+
+// decompresses text records until the HTML data extends beyond htmlOffset
+// (or all of them); returns false if a record fails to decompress
+bool MobiDoc::LoadTextRecords(size_t htmlOffset)
+{
+    ScopedCritSec scope(&docAccess);
+    while (doc->Size() <= htmlOffset && docRecStarts.Count() < docRecCount) {
+        if (docLoadFailed)
             return false;
+        size_t recNo = docRecStarts.Count() + 1;
+        str::Str<char> text;
+        if (!LoadDocRecordIntoBuffer(recNo, text)) {
+            docLoadFailed = true;
+            return false;
+        }
+        docRecStarts.Append(doc->Size());
+        AppendTextRecord(text, recNo == docRecCount);
     }
+    return !docLoadFailed;
+}
+
+void MobiDoc::AppendTextRecord(str::Str<char>& text, bool isLast)
+{
     // replace unexpected \0 with spaces
     // cf. https://code.google.com/p/sumatrapdf/issues/detail?id=2529
-    char *s = doc->Get(), *end = s + doc->Size();
+    char *s = text.Get(), *end = s + text.Size();
     while ((s = (char *)memchr(s, '\0', end - s)) != nullptr) {
         *s = ' ';
     }
-    if (textEncoding != CP_UTF8) {
-        char *docUtf8 = str::ToMultiByte(doc->Get(), textEncoding, CP_UTF8);
-        if (docUtf8) {
-            doc->Reset();
-            doc->AppendAndFree(docUtf8);
-        }
+    if (textEncoding == CP_UTF8) {
+        doc->Append(text.Get(), text.Size());
+        return;
     }
-    return true;
+
+    if (docLeadByte) {
+        text.InsertAt(0, docLeadByte);
+        docLeadByte = 0;
+    }
+    // don't split a double-byte character between two records
+    for (size_t i = 0; i < text.Size() && !isLast; i++) {
+        if (!IsDBCSLeadByteEx(textEncoding, text.At(i)))
+            continue;
+        if (i + 1 == text.Size())
+            docLeadByte = text.Pop();
+        i++;
+    }
+    char *textUtf8 = str::ToMultiByte(text.Get(), textEncoding, CP_UTF8);
+    if (textUtf8)
+        doc->AppendAndFree(textUtf8);
+    else
+        doc->Append(text.Get(), text.Size());
 }
 
-char *MobiDoc::GetHtmlData(size_t& lenOut) const
+// returns nullptr if a text record fails to decompress
+char *MobiDoc::GetHtmlData(size_t& lenOut)
 {
+    if (!LoadTextRecords((size_t)-1)) {
+        lenOut = 0;
+        return nullptr;
+    }
     lenOut = doc->Size();
     return doc->Get();
 }
 
+size_t MobiDoc::GetHtmlDataSize()
+{
+    LoadTextRecords((size_t)-1);
+    return doc->Size();
+}
+
+// returns the number of the text record containing htmlOffset
+// (decompressing the records up to there) or 0 if there's none
+size_t MobiDoc::GetTextRecordAt(size_t htmlOffset)
+{
+    ScopedCritSec scope(&docAccess);
+    if (!LoadTextRecords(htmlOffset) || htmlOffset >= doc->Size())
+        return 0;
+    size_t lo = 0, hi = docRecStarts.Count();
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (docRecStarts.At(mid) <= htmlOffset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo + 1;
+}
+
 WCHAR *MobiDoc::GetProperty(DocumentProperty prop)
 {
     for (size_t i = 0; i < props.Count(); i++) {
@@ -864,6 +1108,8 @@ WCHAR *MobiDoc::GetProperty(DocumentProperty prop)
 
 bool MobiDoc::HasToc()
 {
+    if (!LoadTextRecords((size_t)-1))
+        return false;
     if (docTocIndex != (size_t)-1)
         return docTocIndex < doc->Size();
     docTocIndex = doc->Size(); // no ToC
@@ -942,14 +1188,49 @@ bool MobiDoc::ParseToc(EbookTocVisitor *visitor)
     return true;
 }
 
+// decompresses all text records of a HuffDic compressed document with both
+// the table-driven and the reference decoder and times them
+// returns false if the document isn't HuffDic compressed
+bool MobiDoc::BenchHuffDic(const WCHAR *fileName, double& fastMs, double& referenceMs, bool& sameResult)
+{
+    ScopedPtr<MobiDoc> mb(CreateFromFile(fileName));
+    if (!mb || COMPRESSION_HUFF != mb->compressionType || !mb->huffDic)
+        return false;
+
+    str::Str<char> fast(mb->docUncompressedSize);
+    Timer t;
+    for (size_t i = 1; i <= mb->docRecCount; i++) {
+        if (!mb->LoadDocRecordIntoBuffer(i, fast))
+            break;
+    }
+    fastMs = t.Stop();
+
+    str::Str<char> reference(mb->docUncompressedSize);
+    t.Start();
+    for (size_t i = 1; i <= mb->docRecCount; i++) {
+        size_t recSize;
+        const char *recData = mb->pdbReader->GetRecord(i, &recSize);
+        if (!recData)
+            break;
+        recSize = GetRealRecordSize((uint8*)recData, recSize, mb->trailersCount, mb->multibyte);
+        if ((size_t)-1 == recSize || !mb->huffDic->DecompressReference((uint8*)recData, recSize, reference))
+            break;
+    }
+    referenceMs = t.Stop();
+
+    sameResult = fast.Size() == reference.Size() && memeq(fast.Get(), reference.Get(), fast.Size());
+    return true;
+}
+
 bool MobiDoc::IsSupportedFile(const WCHAR *fileName, bool sniff)
 {
     if (sniff) {
-        PdbReader pdbReader(fileName);
+        char dbType[9];
         // in most cases, we're only interested in Mobipocket files
         // (PalmDoc uses MobiDoc for loading other formats based on MOBI,
         // but implements sniffing itself in PalmDoc::IsSupportedFile)
-        return Pdb_Mobipocket == GetPdbDocType(pdbReader.GetDbType());
+        return PdbReader::SniffDbType(fileName, dbType) &&
+               Pdb_Mobipocket == GetPdbDocType(dbType);
     }
 
     return str::EndsWithI(fileName, L".mobi") ||
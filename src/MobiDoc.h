@@ -24,7 +24,9 @@ class MobiDoc
     size_t              imageFirstRec; // 0 if no images
     size_t              coverImageRec; // 0 if no cover image
 
+    // images are only read when they're first needed
     ImageData *         images;
+    bool *              imagesLoaded;
 
     HuffDicDecompressor *huffDic;
 
@@ -34,26 +36,37 @@ class MobiDoc
     };
     Vec<Metadata>       props;
 
+    // the text records are decompressed (in order) when they're first needed
+    str::Str<char> *    doc;
+    // offset of each decompressed text record within doc
+    Vec<size_t>         docRecStarts;
+    // lead byte of a double-byte character split between two text records
+    char                docLeadByte;
+    bool                docLoadFailed;
+    CRITICAL_SECTION    docAccess;
+
     explicit MobiDoc(const WCHAR *filePath);
 
     bool    ParseHeader();
     bool    LoadDocRecordIntoBuffer(size_t recNo, str::Str<char>& strOut);
+    bool    LoadTextRecords(size_t htmlOffset);
+    void    AppendTextRecord(str::Str<char>& text, bool isLast);
     void    LoadImages();
-    bool    LoadImage(size_t imageNo);
+    ImageData *LoadImage(size_t imageNo);
     bool    LoadDocument(PdbReader *pdbReader);
     bool    DecodeExthHeader(const char *data, size_t dataLen);
 
 public:
-    str::Str<char> *    doc;
-
     size_t              imagesCount;
 
     ~MobiDoc();
 
-    char *              GetHtmlData(size_t& lenOut) const;
-    size_t              GetHtmlDataSize() const { return doc->Size(); }
+    // returns nullptr if a text record fails to decompress
+    char *              GetHtmlData(size_t& lenOut);
+    size_t              GetHtmlDataSize();
+    size_t              GetTextRecordAt(size_t htmlOffset);
     ImageData *         GetCoverImage();
-    ImageData *         GetImage(size_t imgRecIndex) const;
+    ImageData *         GetImage(size_t imgRecIndex);
     const WCHAR *       GetFileName() const { return fileName; }
     WCHAR *             GetProperty(DocumentProperty prop);
     PdbDocType          GetDocType() const { return docType; }
@@ -62,6 +75,7 @@ public:
     bool                ParseToc(EbookTocVisitor *visitor);
 
     static bool         IsSupportedFile(const WCHAR *fileName, bool sniff=false);
+    static bool         BenchHuffDic(const WCHAR *fileName, double& fastMs, double& referenceMs, bool& sameResult);
     static MobiDoc *    CreateFromFile(const WCHAR *fileName);
     static MobiDoc *    CreateFromStream(IStream *stream);
 };
@@ -13,6 +13,7 @@ extern "C" {
 #include "FileUtil.h"
 #include "HtmlParserLookup.h"
 #include "HtmlPullParser.h"
+#include "ThreadUtil.h"
 #include "TrivialHtmlParser.h"
 #include "WinUtil.h"
 #include "ZipUtil.h"
@@ -25,14 +26,31 @@ extern "C" {
 // so that their content can be loaded on demand in order to preserve memory
 #define MAX_MEMORY_FILE_SIZE (10 * 1024 * 1024)
 
-// number of page content trees to cache for quicker rendering
+// number of page content trees to cache for quicker rendering (XPS only)
 #define MAX_PAGE_RUN_CACHE  8
 // maximum estimated memory requirement allowed for the run cache of one document
+// (the default for PDF documents, cf. PdfEngine::SetPageRunCacheSize)
 #define MAX_PAGE_RUN_MEMORY (40 * 1024 * 1024)
+// number of buckets of PdfEngineImpl's run cache hash table (should be a power of 2)
+#define PAGE_RUN_CACHE_BUCKETS 64
+// time to wait for rendering to settle before building display lists for adjacent pages
+#define PAGE_RUN_PREFETCH_DELAY_MS 200
+// pages rendered at a smaller size (e.g. thumbnails) don't trigger any prefetching
+#define PAGE_RUN_PREFETCH_MIN_PIXELS (512 * 512)
+// minimum number of pixels per band when rasterizing a large page on several threads
+#define MIN_RENDER_BAND_PIXELS (2 * 1024 * 1024)
+// maximum number of bands (and thus threads) a single page is rasterized in
+#define MAX_RENDER_BANDS 8
 
 // maximum amount of memory that MuPDF should use per fz_context store
 #define MAX_CONTEXT_MEMORY  (256 * 1024 * 1024)
 
+// SSE2 is always available for x64 and enabled with /arch:SSE2 for x86
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define USE_SSE2_SWIZZLE
+#endif
+
 ///// extensions to Fitz that are usable for both PDF and XPS /////
 
 inline RectD fz_rect_to_RectD(fz_rect rect)
@@ -60,66 +78,187 @@ inline float fz_calc_overlap(fz_rect r1, fz_rect r2)
     return (isect.x1 - isect.x0) * (isect.y1 - isect.y0) / ((r1.x1 - r1.x0) * (r1.y1 - r1.y0));
 }
 
-static RenderedBitmap *new_rendered_fz_pixmap(fz_context *ctx, fz_pixmap *pixmap)
+// open addressing hash table for looking up palette indices by color
+// (must have considerably more than 256 slots so that probing stays short)
+#define PALETTE_HASH_BITS 10
+#define PALETTE_HASH_SIZE (1 << PALETTE_HASH_BITS)
+
+// produces an 8-bit palette (of BGR colors) and palette indices for an RGBA or BGRA pixmap;
+// returns the number of colors or -1 as soon as the pixmap turns out to use more than 256
+static int palettize_pixmap(fz_pixmap *pixmap, bool isBgr, unsigned char *dest, int stride, uint32_t *palette)
 {
+    // keys are colors with the (otherwise unused) alpha byte set for occupied slots
+    uint32_t keys[PALETTE_HASH_SIZE] = { 0 };
+    BYTE idxs[PALETTE_HASH_SIZE];
     int paletteSize = 0;
-    bool hasPalette = false;
+    uint32_t lastKey = 0;
+    BYTE lastIdx = 0;
+
+    const uint32_t *source = (const uint32_t *)pixmap->samples;
+    for (int j = 0; j < pixmap->h; j++) {
+        unsigned char *row = dest + j * stride;
+        for (int i = 0; i < pixmap->w; i++) {
+            uint32_t key = (*source++ & 0xFFFFFF) | 0xFF000000;
+            // most pages consist of long runs of identically colored pixels
+            if (key != lastKey) {
+                uint32_t slot = (key * 2654435761U) >> (32 - PALETTE_HASH_BITS);
+                while (keys[slot] && keys[slot] != key) {
+                    slot = (slot + 1) & (PALETTE_HASH_SIZE - 1);
+                }
+                if (!keys[slot]) {
+                    if (256 == paletteSize)
+                        return -1;
+                    keys[slot] = key;
+                    idxs[slot] = (BYTE)paletteSize;
+                    if (isBgr)
+                        palette[paletteSize++] = key & 0xFFFFFF;
+                    else
+                        palette[paletteSize++] = ((key & 0xFF) << 16) | (key & 0xFF00) | ((key >> 16) & 0xFF);
+                }
+                lastKey = key;
+                lastIdx = idxs[slot];
+            }
+            /* 8-bit data consists of indices into the color palette */
+            row[i] = lastIdx;
+        }
+    }
+    return paletteSize;
+}
+
+// converts RGBA to BGRA (the GDI compatible format) by swapping red and blue
+static void swizzle_rgba_to_bgra(const unsigned char *source, unsigned char *dest, size_t pixelCount)
+{
+    size_t i = 0;
+#ifdef USE_SSE2_SWIZZLE
+    const __m128i maskGA = _mm_set1_epi32((int)0xFF00FF00);
+    const __m128i maskLow = _mm_set1_epi32(0xFF);
+    for (; i + 4 <= pixelCount; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)(source + i * 4));
+        __m128i ga = _mm_and_si128(px, maskGA);
+        __m128i r = _mm_slli_epi32(_mm_and_si128(px, maskLow), 16);
+        __m128i b = _mm_and_si128(_mm_srli_epi32(px, 16), maskLow);
+        _mm_storeu_si128((__m128i *)(dest + i * 4), _mm_or_si128(ga, _mm_or_si128(r, b)));
+    }
+#endif
+    const uint32_t *src = (const uint32_t *)source;
+    uint32_t *dst = (uint32_t *)dest;
+    for (; i < pixelCount; i++) {
+        uint32_t px = src[i];
+        dst[i] = (px & 0xFF00FF00) | ((px & 0xFF) << 16) | ((px >> 16) & 0xFF);
+    }
+}
+
+static void init_bitmap_header(BITMAPINFOHEADER *bmih, int w, int h, int paletteSize)
+{
+    bool hasPalette = paletteSize >= 0;
+    int rows8 = ((w + 3) / 4) * 4;
+    bmih->biSize = sizeof(*bmih);
+    bmih->biWidth = w;
+    bmih->biHeight = -h;
+    bmih->biPlanes = 1;
+    bmih->biCompression = BI_RGB;
+    bmih->biBitCount = hasPalette ? 8 : 32;
+    bmih->biSizeImage = h * (hasPalette ? rows8 : w * 4);
+    bmih->biClrUsed = hasPalette ? paletteSize : 0;
+}
+
+static HBITMAP new_dib_section(BITMAPINFO *bmi, void **data, HANDLE *hMap)
+{
+    *hMap = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, bmi->bmiHeader.biSizeImage, nullptr);
+    return CreateDIBSection(nullptr, bmi, DIB_RGB_COLORS, data, *hMap, 0);
+}
+
+static void free_dib_section(HBITMAP hbmp, HANDLE hMap)
+{
+    DeleteObject(hbmp);
+    if (hMap)
+        CloseHandle(hMap);
+}
+
+// creates a BGRA pixmap for bbox which renders straight into the memory of a new
+// DIB section (so that the result doesn't have to be converted and copied afterwards);
+// returns nullptr if the DIB section can't be created
+static fz_pixmap *new_dib_section_pixmap(fz_context *ctx, const fz_irect *bbox, HBITMAP *hbmpOut, HANDLE *hMapOut)
+{
+    ScopedMem<BITMAPINFO> bmi((BITMAPINFO *)calloc(1, sizeof(BITMAPINFO)));
+    if (!bmi)
+        return nullptr;
+    init_bitmap_header(&bmi.Get()->bmiHeader, bbox->x1 - bbox->x0, bbox->y1 - bbox->y0, -1);
+    void *data = nullptr;
+    HANDLE hMap = nullptr;
+    HBITMAP hbmp = new_dib_section(bmi, &data, &hMap);
+    if (!hbmp) {
+        if (hMap)
+            CloseHandle(hMap);
+        return nullptr;
+    }
+
+    fz_pixmap *pixmap = nullptr;
+    fz_try(ctx) {
+        pixmap = fz_new_pixmap_with_bbox_and_data(ctx, fz_device_bgr(ctx), bbox, (unsigned char *)data);
+    }
+    fz_catch(ctx) {
+        free_dib_section(hbmp, hMap);
+        return nullptr;
+    }
+    *hbmpOut = hbmp;
+    *hMapOut = hMap;
+    return pixmap;
+}
 
+// takes ownership of the DIB section backing pixmap (as created by new_dib_section_pixmap)
+// and replaces it with an 8-bit one if the page doesn't use more than 256 colors
+static RenderedBitmap *new_rendered_dib_section(fz_pixmap *pixmap, HBITMAP hbmp, HANDLE hMap)
+{
     int w = pixmap->w;
     int h = pixmap->h;
     int rows8 = ((w + 3) / 4) * 4;
 
+    // produce an 8-bit palette for saving some memory (as new_rendered_fz_pixmap does)
+    ScopedMem<BITMAPINFO> bmi((BITMAPINFO *)calloc(1, sizeof(BITMAPINFO) + 255 * sizeof(RGBQUAD)));
+    ScopedMem<unsigned char> bmpData((unsigned char *)calloc(rows8, h));
+    int paletteSize = -1;
+    if (bmi && bmpData)
+        paletteSize = palettize_pixmap(pixmap, true, bmpData, rows8, (uint32_t *)bmi.Get()->bmiColors);
+    if (paletteSize < 0)
+        return new RenderedBitmap(hbmp, SizeI(w, h), hMap);
+
+    init_bitmap_header(&bmi.Get()->bmiHeader, w, h, paletteSize);
+    void *data = nullptr;
+    HANDLE hMap8 = nullptr;
+    HBITMAP hbmp8 = new_dib_section(bmi, &data, &hMap8);
+    if (!hbmp8) {
+        if (hMap8)
+            CloseHandle(hMap8);
+        return new RenderedBitmap(hbmp, SizeI(w, h), hMap);
+    }
+    memcpy(data, bmpData, bmi.Get()->bmiHeader.biSizeImage);
+    free_dib_section(hbmp, hMap);
+    return new RenderedBitmap(hbmp8, SizeI(w, h), hMap8);
+}
+
+static RenderedBitmap *new_rendered_fz_pixmap(fz_context *ctx, fz_pixmap *pixmap)
+{
+    int paletteSize = -1;
+
+    int w = pixmap->w;
+    int h = pixmap->h;
+    int rows8 = ((w + 3) / 4) * 4;
+    bool isRgb = pixmap->n == 4 && pixmap->colorspace == fz_device_rgb(ctx);
+
     ScopedMem<BITMAPINFO> bmi((BITMAPINFO *)calloc(1, sizeof(BITMAPINFO) + 255 * sizeof(RGBQUAD)));
 
     // always try to produce an 8-bit palette for saving some memory
-    unsigned char *bmpData = (unsigned char *)calloc(rows8, h);
-    if (!bmpData)
-        return nullptr;
+    ScopedMem<unsigned char> bmpData;
     fz_pixmap *bgrPixmap = nullptr;
-    if (bmpData && pixmap->n == 4 &&
-        pixmap->colorspace == fz_device_rgb(ctx)) {
-        unsigned char *dest = bmpData;
-        unsigned char *source = pixmap->samples;
-        uint32_t *palette = (uint32_t *)bmi.Get()->bmiColors;
-        BYTE grayIdxs[256] = { 0 };
-
-        for (int j = 0; j < h; j++) {
-            for (int i = 0; i < w; i++) {
-                RGBQUAD c;
-
-                c.rgbRed = *source++;
-                c.rgbGreen = *source++;
-                c.rgbBlue = *source++;
-                c.rgbReserved = 0;
-                source++;
-
-                /* find this color in the palette */
-                int k;
-                bool isGray = c.rgbRed == c.rgbGreen && c.rgbRed == c.rgbBlue;
-                if (isGray) {
-                    k = grayIdxs[c.rgbRed] || palette[0] == *(uint32_t *)&c ? grayIdxs[c.rgbRed] : paletteSize;
-                }
-                else {
-                    for (k = 0; k < paletteSize && palette[k] != *(uint32_t *)&c; k++);
-                }
-                /* add it to the palette if it isn't in there and if there's still space left */
-                if (k == paletteSize) {
-                    if (++paletteSize > 256)
-                        goto ProducingPaletteDone;
-                    if (isGray)
-                        grayIdxs[c.rgbRed] = (BYTE)k;
-                    palette[k] = *(uint32_t *)&c;
-                }
-                /* 8-bit data consists of indices into the color palette */
-                *dest++ = k;
-            }
-            dest += rows8 - w;
-        }
-ProducingPaletteDone:
-        hasPalette = paletteSize <= 256;
+    if (isRgb) {
+        bmpData.Set((unsigned char *)calloc(rows8, h));
+        if (!bmpData)
+            return nullptr;
+        paletteSize = palettize_pixmap(pixmap, false, bmpData, rows8, (uint32_t *)bmi.Get()->bmiColors);
     }
-    if (!hasPalette) {
-        free(bmpData);
+    bool hasPalette = paletteSize >= 0;
+    if (!hasPalette && !isRgb) {
         /* BGRA is a GDI compatible format */
         fz_try(ctx) {
             fz_irect bbox;
@@ -131,27 +270,23 @@ ProducingPaletteDone:
             return nullptr;
         }
     }
-    AssertCrash(hasPalette || bgrPixmap);
+    AssertCrash(hasPalette || isRgb || bgrPixmap);
 
     BITMAPINFOHEADER *bmih = &bmi.Get()->bmiHeader;
-    bmih->biSize = sizeof(*bmih);
-    bmih->biWidth = w;
-    bmih->biHeight = -h;
-    bmih->biPlanes = 1;
-    bmih->biCompression = BI_RGB;
-    bmih->biBitCount = hasPalette ? 8 : 32;
-    bmih->biSizeImage = h * (hasPalette ? rows8 : w * 4);
-    bmih->biClrUsed = hasPalette ? paletteSize : 0;
+    init_bitmap_header(bmih, w, h, paletteSize);
 
     void *data = nullptr;
-    HANDLE hMap = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, bmih->biSizeImage, nullptr);
-    HBITMAP hbmp = CreateDIBSection(nullptr, bmi, DIB_RGB_COLORS, &data, hMap, 0);
-    if (hbmp)
-        memcpy(data, hasPalette ? bmpData : bgrPixmap->samples, bmih->biSizeImage);
-
-    if (hasPalette)
-        free(bmpData);
-    else
+    HANDLE hMap = nullptr;
+    HBITMAP hbmp = new_dib_section(bmi, &data, &hMap);
+    if (hbmp && hasPalette)
+        memcpy(data, bmpData, bmih->biSizeImage);
+    else if (hbmp && isRgb)
+        // convert straight into the DIB section instead of into an intermediary pixmap
+        swizzle_rgba_to_bgra(pixmap->samples, (unsigned char *)data, (size_t)w * h);
+    else if (hbmp)
+        memcpy(data, bgrPixmap->samples, bmih->biSizeImage);
+
+    if (bgrPixmap)
         fz_drop_pixmap(ctx, bgrPixmap);
 
     // return a RenderedBitmap even if hbmp is nullptr so that callers can
@@ -668,6 +803,11 @@ static void fz_inspection_handle_path(fz_device *dev, fz_path *path)
     ((ListInspectionData *)dev->user)->mem_estimate += sizeof(fz_path) + path->cmd_cap + path->coord_cap * sizeof(float);
 }
 
+static void fz_inspection_handle_text(fz_device *dev, fz_text *text)
+{
+    ((ListInspectionData *)dev->user)->mem_estimate += sizeof(fz_text) + text->cap * sizeof(fz_text_item);
+}
+
 static void fz_inspection_handle_image(fz_device *dev, fz_image *image)
 {
     int n = image->colorspace ? image->colorspace->n + 1 : 1;
@@ -702,6 +842,41 @@ fz_inspection_clip_stroke_path(fz_device *dev, fz_path *path, const fz_rect *rec
     fz_inspection_handle_path(dev, path);
 }
 
+extern "C" static void
+fz_inspection_fill_text(fz_device *dev, fz_text *text, const fz_matrix *ctm, fz_colorspace *colorspace, float *color, float alpha)
+{
+    UNUSED(ctm); UNUSED(colorspace); UNUSED(color); UNUSED(alpha);
+    fz_inspection_handle_text(dev, text);
+}
+
+extern "C" static void
+fz_inspection_stroke_text(fz_device *dev, fz_text *text, fz_stroke_state *stroke, const fz_matrix *ctm, fz_colorspace *colorspace, float *color, float alpha)
+{
+    UNUSED(stroke); UNUSED(ctm); UNUSED(colorspace); UNUSED(color); UNUSED(alpha);
+    fz_inspection_handle_text(dev, text);
+}
+
+extern "C" static void
+fz_inspection_clip_text(fz_device *dev, fz_text *text, const fz_matrix *ctm, int accumulate)
+{
+    UNUSED(ctm); UNUSED(accumulate);
+    fz_inspection_handle_text(dev, text);
+}
+
+extern "C" static void
+fz_inspection_clip_stroke_text(fz_device *dev, fz_text *text, fz_stroke_state *stroke, const fz_matrix *ctm)
+{
+    UNUSED(stroke); UNUSED(ctm);
+    fz_inspection_handle_text(dev, text);
+}
+
+extern "C" static void
+fz_inspection_ignore_text(fz_device *dev, fz_text *text, const fz_matrix *ctm)
+{
+    UNUSED(ctm);
+    fz_inspection_handle_text(dev, text);
+}
+
 extern "C" static void
 fz_inspection_fill_shade(fz_device *dev, fz_shade *shade, const fz_matrix *ctm, float alpha)
 {
@@ -748,6 +923,12 @@ static fz_device *fz_new_inspection_device(fz_context *ctx, ListInspectionData *
     dev->clip_path = fz_inspection_clip_path;
     dev->clip_stroke_path = fz_inspection_clip_stroke_path;
 
+    dev->fill_text = fz_inspection_fill_text;
+    dev->stroke_text = fz_inspection_stroke_text;
+    dev->clip_text = fz_inspection_clip_text;
+    dev->clip_stroke_text = fz_inspection_clip_stroke_text;
+    dev->ignore_text = fz_inspection_ignore_text;
+
     dev->fill_shade = fz_inspection_fill_shade;
     dev->fill_image = fz_inspection_fill_image;
     dev->fill_image_mask = fz_inspection_fill_image_mask;
@@ -763,31 +944,96 @@ public:
     void Abort() override { cookie.abort = 1; }
 };
 
+// MuPDF expects one mutex per FZ_LOCK_* type (cf. fz_locks_context in context.h)
+// so that cloned contexts can share the store, the glyph cache and FreeType
+class FitzLocks {
+public:
+    CRITICAL_SECTION cs[FZ_LOCK_MAX];
+    fz_locks_context locks;
+
+    FitzLocks();
+    ~FitzLocks();
+};
+
 extern "C" static void
 fz_lock_context_cs(void *user, int lock)
 {
-    UNUSED(lock);
-    // we use a single critical section for all locks,
-    // since that critical section (ctxAccess) should
-    // be guarding all fz_context access anyway and
-    // thus already be in place (in debug builds we
-    // crash if that assertion doesn't hold)
-    CRITICAL_SECTION *cs = (CRITICAL_SECTION *)user;
-    BOOL ok = TryEnterCriticalSection(cs);
-    if (!ok) {
-        CrashIf(true);
-        EnterCriticalSection(cs);
-    }
+    CrashIf(lock < 0 || lock >= FZ_LOCK_MAX);
+    FitzLocks *fl = (FitzLocks *)user;
+    EnterCriticalSection(&fl->cs[lock]);
 }
 
 extern "C" static void
 fz_unlock_context_cs(void *user, int lock)
 {
-    UNUSED(lock);
-    CRITICAL_SECTION *cs = (CRITICAL_SECTION *)user;
-    LeaveCriticalSection(cs);
+    CrashIf(lock < 0 || lock >= FZ_LOCK_MAX);
+    FitzLocks *fl = (FitzLocks *)user;
+    LeaveCriticalSection(&fl->cs[lock]);
 }
 
+FitzLocks::FitzLocks()
+{
+    for (int i = 0; i < FZ_LOCK_MAX; i++) {
+        InitializeCriticalSection(&cs[i]);
+    }
+    locks.user = this;
+    locks.lock = fz_lock_context_cs;
+    locks.unlock = fz_unlock_context_cs;
+}
+
+FitzLocks::~FitzLocks()
+{
+    for (int i = 0; i < FZ_LOCK_MAX; i++) {
+        DeleteCriticalSection(&cs[i]);
+    }
+}
+
+// pool of contexts cloned from a document's fz_context, so that several threads
+// can replay display lists at the same time (only document access has to be
+// serialized through the owner's ctxAccess critical section)
+class FitzContextPool {
+    fz_context *ctx;
+    Vec<fz_context *> unused;
+    CRITICAL_SECTION access;
+
+public:
+    explicit FitzContextPool(fz_context *ctx=nullptr) : ctx(ctx) {
+        InitializeCriticalSection(&access);
+    }
+    ~FitzContextPool() {
+        Clear();
+        DeleteCriticalSection(&access);
+    }
+
+    void SetContext(fz_context *ctx) { this->ctx = ctx; }
+
+    // returns nullptr if no context could be cloned (callers should
+    // fall back to the original context protected by ctxAccess)
+    fz_context *Get() {
+        ScopedCritSec scope(&access);
+        if (unused.Count() > 0)
+            return unused.Pop();
+        return ctx ? fz_clone_context(ctx) : nullptr;
+    }
+
+    void Release(fz_context *clone) {
+        if (!clone)
+            return;
+        ScopedCritSec scope(&access);
+        unused.Append(clone);
+    }
+
+    // must be called before the original context is freed
+    // and after all clones have been released
+    void Clear() {
+        ScopedCritSec scope(&access);
+        for (size_t i = 0; i < unused.Count(); i++) {
+            fz_free_context(unused.At(i));
+        }
+        unused.Reset();
+    }
+};
+
 static Vec<PageAnnotation> fz_get_user_page_annots(Vec<PageAnnotation>& userAnnots, int pageNo)
 {
     Vec<PageAnnotation> result;
@@ -1126,6 +1372,8 @@ pdf_load_page_objs(pdf_document *doc, pdf_obj **page_objs)
                 if (page_no >= pdf_count_pages(doc))
                     fz_throw(ctx, FZ_ERROR_GENERIC, "found more /Page objects than anticipated");
 
+                // page_objs might already have been partially filled by pdf_lookup_page_obj_cached
+                pdf_drop_obj(page_objs[page_no]);
                 page_objs[page_no] = pdf_keep_obj(kid);
                 page_no++;
             }
@@ -1142,6 +1390,98 @@ pdf_load_page_objs(pdf_document *doc, pdf_obj **page_objs)
     doc->page_objs = page_objs;
 }
 
+struct PageTreeNode {
+    pdf_obj *kids;
+    int first, count;
+};
+
+#define MAX_PAGE_TREE_DEPTH 64
+
+// looks up a single /Page object (page_no is 0-based) by descending the page tree
+// according to the /Count values of the intermediate /Pages nodes; path caches the
+// nodes leading to the previously looked up page, so that subsequent lookups of
+// neighboring pages don't have to start at the root again
+static pdf_obj *
+pdf_lookup_page_obj_cached(pdf_document *doc, int page_no, Vec<PageTreeNode>& path)
+{
+    fz_context *ctx = doc->ctx;
+    pdf_obj *page = nullptr;
+
+    while (path.Count() > 0 && (page_no < path.Last().first || path.Last().first + path.Last().count <= page_no))
+        path.Pop();
+    if (path.Count() == 0) {
+        PageTreeNode root = { pdf_dict_getp(pdf_trailer(doc), "Root/Pages/Kids"), 0, pdf_count_pages(doc) };
+        path.Append(root);
+    }
+    // the /Kids arrays along the path are marked while descending so that
+    // a cyclic page tree is detected instead of being followed forever
+    for (size_t i = 0; i < path.Count(); i++) {
+        if (pdf_mark_obj(path.At(i).kids)) {
+            while (i > 0)
+                pdf_unmark_obj(path.At(--i).kids);
+            path.Reset();
+            fz_throw(ctx, FZ_ERROR_GENERIC, "cycle in page tree");
+        }
+    }
+
+    fz_var(page);
+    fz_try(ctx) {
+        while (!page) {
+            PageTreeNode node = path.Last();
+            int len = pdf_array_len(node.kids);
+            int skip = page_no - node.first;
+
+            // both leaves and (non-empty) intermediate nodes have to be counted,
+            // as a node's kids may include /Pages nodes with a /Count of 0
+            PageTreeNode next = { nullptr, node.first, 0 };
+            for (int i = 0; i < len && !page && !next.kids; i++) {
+                pdf_obj *kid = pdf_array_get(node.kids, i);
+                char *type = pdf_to_name(pdf_dict_gets(kid, "Type"));
+                if (*type ? str::Eq(type, "Pages") : pdf_dict_gets(kid, "Kids") && !pdf_dict_gets(kid, "MediaBox")) {
+                    int count = pdf_to_int(pdf_dict_gets(kid, "Count"));
+                    if (count <= 0)
+                        continue;
+                    if (skip < count) {
+                        next.kids = pdf_dict_gets(kid, "Kids");
+                        next.count = count;
+                    }
+                    else {
+                        skip -= count;
+                        next.first += count;
+                    }
+                }
+                else if (0 == skip) {
+                    page = kid;
+                }
+                else {
+                    skip--;
+                    next.first++;
+                }
+            }
+            if (page)
+                break;
+            if (!next.kids)
+                fz_throw(ctx, FZ_ERROR_GENERIC, "cannot find page %d in page tree", page_no + 1);
+            if (path.Count() >= MAX_PAGE_TREE_DEPTH)
+                fz_throw(ctx, FZ_ERROR_GENERIC, "page tree too deep");
+            if (pdf_mark_obj(next.kids))
+                fz_throw(ctx, FZ_ERROR_GENERIC, "cycle in page tree");
+            path.Append(next);
+        }
+    }
+    fz_always(ctx) {
+        for (size_t i = 0; i < path.Count(); i++) {
+            pdf_unmark_obj(path.At(i).kids);
+        }
+    }
+    fz_catch(ctx) {
+        path.Reset();
+        fz_rethrow(ctx);
+    }
+
+    return page;
+}
+
 ///// Above are extensions to Fitz and MuPDF, now follows PdfEngine /////
 
 struct PdfPageRun {
@@ -1150,17 +1490,82 @@ struct PdfPageRun {
     size_t size_est;
     int refs;
 
+    // links for PdfEngineImpl's run cache hash table and its list
+    // of cached runs in most recently used order
+    bool cached;
+    PdfPageRun *nextInBucket;
+    PdfPageRun *mruPrev, *mruNext;
+
     PdfPageRun(pdf_page *page, fz_display_list *list, ListInspectionData& data) :
-        page(page), list(list), size_est(data.mem_estimate), refs(1) { }
+        page(page), list(list), size_est(data.mem_estimate), refs(1),
+        cached(false), nextInBucket(nullptr), mruPrev(nullptr), mruNext(nullptr) { }
+};
+
+// marks a page whose display list is being recorded by GetPageRun, so that
+// other threads can wait for it instead of recording the same page again;
+// speculative recordings can be aborted through their cookie
+struct PdfRunBuild {
+    pdf_page *page;
+    HANDLE done;
+    int refs;
+    FitzAbortCookie *cookie;
+
+    PdfRunBuild(pdf_page *page, bool speculative) : page(page), refs(1),
+        cookie(speculative ? new FitzAbortCookie() : nullptr) {
+        done = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    }
+    ~PdfRunBuild() {
+        CloseHandle(done);
+        delete cookie;
+    }
+};
+
+class PdfEngineImpl;
+
+// a horizontal band of a page which is rasterized on its own thread
+// (cf. PdfEngineImpl::RunPageListInBands)
+struct PdfRenderBand {
+    PdfEngineImpl *engine;
+    PdfPageRun *run;
+    fz_device *dev;
+    const fz_matrix *ctm;
+    fz_rect cliprect;
+    // every band needs its own cookie, as fitz updates a cookie's progress while
+    // rendering (aborting is forwarded from the caller's cookie, cf. RunPageListInBands)
+    FitzAbortCookie cookie;
+    HANDLE thread;
+    bool ok;
+
+    PdfRenderBand() : engine(nullptr), run(nullptr), dev(nullptr), ctm(nullptr), thread(nullptr), ok(false) { }
 };
 
+// large pages are split into as many bands as there are processors,
+// as long as each band is still worth the overhead of a thread
+static int GetRenderBandCount(const fz_irect& bbox)
+{
+    int height = bbox.y1 - bbox.y0;
+    int64 pixels = (int64)(bbox.x1 - bbox.x0) * height;
+    if (pixels < 2 * MIN_RENDER_BAND_PIXELS)
+        return 1;
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int count = (int)std::min(pixels / MIN_RENDER_BAND_PIXELS, (int64)MAX_RENDER_BANDS);
+    count = std::min(count, (int)si.dwNumberOfProcessors);
+    return limitValue(count, 1, height);
+}
+
+static size_t gPageRunCacheSize = MAX_PAGE_RUN_MEMORY;
+
 class PdfTocItem;
 class PdfLink;
 class PdfImage;
+class PdfRunPrefetcher;
 
 class PdfEngineImpl : public BaseEngine {
     friend PdfLink;
     friend PdfImage;
+    friend PdfRunPrefetcher;
 
 public:
     PdfEngineImpl();
@@ -1238,12 +1643,17 @@ protected:
     // protected critical section in order to avoid deadlocks
     CRITICAL_SECTION ctxAccess;
     fz_context *    ctx;
-    fz_locks_context fz_locks_ctx;
+    FitzLocks       fz_locks_ctx;
     pdf_document *  _doc;
+    // contexts for rendering cached page runs in parallel
+    FitzContextPool ctxPool;
 
     CRITICAL_SECTION pagesAccess;
     pdf_page **     _pages;
+    // resolved lazily by GetPdfPageObj
     pdf_obj **      _pageObjs;
+    Vec<PageTreeNode> pageTreePath;
+    bool            loadedAllPageObjs;
 
     bool            Load(const WCHAR *fileName, PasswordUI *pwdUI=nullptr);
     bool            Load(IStream *stream, PasswordUI *pwdUI=nullptr);
@@ -1252,6 +1662,10 @@ protected:
     bool            FinishLoading();
 
     pdf_page      * GetPdfPage(int pageNo, bool failIfBusy=false);
+    pdf_obj       * GetPdfPageObj(int pageNo);
+    void            LoadAllPageObjs();
+    bool            LoadAllPageObjsAfterFailedLookup();
+    pdf_page      * LoadPdfPage(int pageNo);
     int             GetPageNo(pdf_page *page);
     fz_matrix       viewctm(int pageNo, float zoom, int rotation) {
         const fz_rect tmpRc = fz_RectD_to_rect(PageMediabox(pageNo));
@@ -1264,13 +1678,39 @@ protected:
     WCHAR         * ExtractPageText(pdf_page *page, const WCHAR *lineSep, RectI **coordsOut=nullptr,
                                     RenderTarget target=Target_View, bool cacheRun=false);
 
-    Vec<PdfPageRun *> runCache; // ordered most recently used first
+    // all cached page runs hashed by page (protected by pagesAccess)
+    PdfPageRun    * runBuckets[PAGE_RUN_CACHE_BUCKETS];
+    // all cached page runs, most recently used first
+    PdfPageRun    * runFirst;
+    PdfPageRun    * runLast;
+    int             runCount;
+    size_t          runCacheSize;
+    // pages whose display lists are currently being recorded (protected by pagesAccess)
+    Vec<PdfRunBuild *> runBuilds;
+    // builds display lists for pages adjacent to the ones being rendered
+    PdfRunPrefetcher *runPrefetcher;
+
+    PdfPageRun    * FindCachedRun(pdf_page *page);
+    void            CacheRun(PdfPageRun *run, bool mostRecent);
+    void            UncacheRun(PdfPageRun *run);
+    void            ShrinkRunCache();
+    void            PrefetchAdjacentRuns(int pageNo);
+    void            PrefetchPageRun(int pageNo);
+    PdfRunBuild   * FindRunBuild(pdf_page *page);
+    void            DropRunBuild(PdfRunBuild *build);
+    fz_display_list * RecordPageList(pdf_page *page, RenderTarget target, FitzAbortCookie *cookie);
     PdfPageRun    * CreatePageRun(pdf_page *page, fz_display_list *list);
-    PdfPageRun    * GetPageRun(pdf_page *page, bool tryOnly=false);
+    PdfPageRun    * GetPageRun(pdf_page *page, bool tryOnly=false, bool speculative=false);
+    PdfPageRun    * GetTargetPageRun(pdf_page *page, RenderTarget target, FitzAbortCookie *cookie);
     bool            RunPage(pdf_page *page, fz_device *dev, const fz_matrix *ctm,
                             RenderTarget target=Target_View,
                             const fz_rect *cliprect=nullptr, bool cacheRun=true,
                             FitzAbortCookie *cookie=nullptr);
+    bool            RunPageList(PdfPageRun *run, fz_device *dev, const fz_matrix *ctm,
+                                const fz_rect *cliprect=nullptr, FitzAbortCookie *cookie=nullptr);
+    bool            RunPageListInBands(PdfPageRun *run, fz_pixmap *image, const fz_matrix *ctm,
+                                       int bandCount, FitzAbortCookie *cookie, bool *ok);
+    static DWORD WINAPI RenderBandThread(LPVOID data);
     void            DropPageRun(PdfPageRun *run, bool forceRemove=false);
 
     PdfTocItem    * BuildTocTree(fz_outline *entry, int& idCounter);
@@ -1371,19 +1811,67 @@ public:
     }
 };
 
+// builds the display lists of the pages next to the one rendered most
+// recently, once rendering has paused for PAGE_RUN_PREFETCH_DELAY_MS
+class PdfRunPrefetcher : public ThreadBase {
+    PdfEngineImpl *engine;
+    HANDLE event;
+    LONG pageNo;
+
+public:
+    explicit PdfRunPrefetcher(PdfEngineImpl *engine) : ThreadBase("PdfRunPrefetcher"),
+        engine(engine), pageNo(0) {
+        event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    }
+    virtual ~PdfRunPrefetcher() { CloseHandle(event); }
+
+    void Request(int pageNo) {
+        InterlockedExchange(&this->pageNo, pageNo);
+        SetEvent(event);
+    }
+    void Stop() {
+        RequestCancel();
+        SetEvent(event);
+        Join();
+    }
+
+    // ThreadBase
+    virtual void Run();
+};
+
+void PdfRunPrefetcher::Run()
+{
+    // first try the pages after and before the current one, then (for
+    // Facing and Book View) the next two pages in either direction
+    static const int offsets[] = { 1, -1, 2, -2 };
+
+    while (!WasCancelRequested()) {
+        WaitForSingleObject(event, INFINITE);
+        // wait until no further page has been rendered for a moment
+        while (!WasCancelRequested() && WaitForSingleObject(event, PAGE_RUN_PREFETCH_DELAY_MS) == WAIT_OBJECT_0);
+        int current = (int)InterlockedExchange(&pageNo, 0);
+        for (size_t i = 0; i < dimof(offsets) && current > 0; i++) {
+            // stop as soon as another page has been rendered
+            if (WasCancelRequested() || pageNo != 0)
+                break;
+            engine->PrefetchPageRun(current + offsets[i]);
+        }
+    }
+}
+
 PdfEngineImpl::PdfEngineImpl() : _fileName(nullptr), _doc(nullptr),
-    _pages(nullptr), _pageObjs(nullptr), _mediaboxes(nullptr), _info(nullptr),
+    _pages(nullptr), _pageObjs(nullptr), loadedAllPageObjs(false), _mediaboxes(nullptr), _info(nullptr),
     outline(nullptr), attachments(nullptr), _pagelabels(nullptr),
     _decryptionKey(nullptr), isProtected(false),
+    runFirst(nullptr), runLast(nullptr), runCount(0), runCacheSize(0), runPrefetcher(nullptr),
     pageAnnots(nullptr), imageRects(nullptr)
 {
+    ZeroMemory(runBuckets, sizeof(runBuckets));
     InitializeCriticalSection(&pagesAccess);
     InitializeCriticalSection(&ctxAccess);
 
-    fz_locks_ctx.user = &ctxAccess;
-    fz_locks_ctx.lock = fz_lock_context_cs;
-    fz_locks_ctx.unlock = fz_unlock_context_cs;
-    ctx = fz_new_context(nullptr, &fz_locks_ctx, MAX_CONTEXT_MEMORY);
+    ctx = fz_new_context(nullptr, &fz_locks_ctx.locks, MAX_CONTEXT_MEMORY);
+    ctxPool.SetContext(ctx);
 
     if (ctx)
         pdf_install_load_system_font_funcs(ctx);
@@ -1391,6 +1879,11 @@ PdfEngineImpl::PdfEngineImpl() : _fileName(nullptr), _doc(nullptr),
 
 PdfEngineImpl::~PdfEngineImpl()
 {
+    if (runPrefetcher) {
+        runPrefetcher->Stop();
+        delete runPrefetcher;
+    }
+
     EnterCriticalSection(&pagesAccess);
     EnterCriticalSection(&ctxAccess);
 
@@ -1424,13 +1917,14 @@ PdfEngineImpl::~PdfEngineImpl()
         free(imageRects);
     }
 
-    while (runCache.Count() > 0) {
-        assert(runCache.Last()->refs == 1);
-        DropPageRun(runCache.Last(), true);
+    while (runLast) {
+        assert(runLast->refs == 1);
+        DropPageRun(runLast, true);
     }
 
     pdf_close_document(_doc);
     _doc = nullptr;
+    ctxPool.Clear();
     fz_free_context(ctx);
     ctx = nullptr;
 
@@ -1685,14 +2179,14 @@ bool PdfEngineImpl::FinishLoading()
 
     ScopedCritSec scope(&ctxAccess);
 
-    fz_try(ctx) {
-        pdf_load_page_objs(_doc, _pageObjs);
-    }
-    fz_catch(ctx) {
-        fz_warn(ctx, "Couldn't load all page objects");
-    }
+    // page objects are only resolved when needed (see GetPdfPageObj)
     fz_try(ctx) {
         outline = pdf_load_outline(_doc);
+        if (LoadAllPageObjsAfterFailedLookup()) {
+            fz_free_outline(ctx, outline);
+            outline = nullptr;
+            outline = pdf_load_outline(_doc);
+        }
     }
     fz_catch(ctx) {
         // ignore errors from pdf_load_outline()
@@ -1815,6 +2309,8 @@ PageDestination *PdfEngineImpl::GetNamedDest(const WCHAR *name)
     fz_link_dest ld = { FZ_LINK_NONE, 0 };
     fz_try(ctx) {
         ld = pdf_parse_link_dest(_doc, FZ_LINK_GOTO, dest);
+        if (FZ_LINK_NONE == ld.kind && LoadAllPageObjsAfterFailedLookup())
+            ld = pdf_parse_link_dest(_doc, FZ_LINK_GOTO, dest);
     }
     fz_catch(ctx) {
         return nullptr;
@@ -1845,7 +2341,7 @@ pdf_page *PdfEngineImpl::GetPdfPage(int pageNo, bool failIfBusy)
         ScopedCritSec ctxScope(&ctxAccess);
         fz_var(page);
         fz_try(ctx) {
-            page = pdf_load_page_by_obj(_doc, pageNo - 1, _pageObjs[pageNo-1]);
+            page = LoadPdfPage(pageNo);
             _pages[pageNo-1] = page;
             LinkifyPageText(page);
             pageAnnots[pageNo-1] = ProcessPageAnnotations(page);
@@ -1856,6 +2352,69 @@ pdf_page *PdfEngineImpl::GetPdfPage(int pageNo, bool failIfBusy)
     return page;
 }
 
+// caller must hold ctxAccess
+pdf_obj *PdfEngineImpl::GetPdfPageObj(int pageNo)
+{
+    pdf_obj *obj = _pageObjs[pageNo - 1];
+    // after a complete walk of the page tree, missing page objects can't be found at all
+    // (if the walk failed, looking up individual pages might still succeed)
+    if (obj || (loadedAllPageObjs && _doc->page_objs))
+        return obj;
+
+    fz_try(ctx) {
+        obj = pdf_keep_obj(pdf_lookup_page_obj_cached(_doc, pageNo - 1, pageTreePath));
+        _pageObjs[pageNo - 1] = obj;
+    }
+    fz_catch(ctx) {
+        // fall back to walking the entire (broken) page tree
+        fz_warn(ctx, "Couldn't look up page object %d, loading all page objects", pageNo);
+        LoadAllPageObjs();
+        obj = _pageObjs[pageNo - 1];
+    }
+    return obj;
+}
+
+// caller must hold ctxAccess
+void PdfEngineImpl::LoadAllPageObjs()
+{
+    if (loadedAllPageObjs)
+        return;
+    pageTreePath.Reset();
+    loadedAllPageObjs = true;
+    // this also sets _doc->page_objs so that pdf_lookup_page_number
+    // no longer has to rely on the (possibly broken) /Parent chain
+    fz_try(ctx) {
+        pdf_load_page_objs(_doc, _pageObjs);
+    }
+    fz_catch(ctx) {
+        fz_warn(ctx, "Couldn't load all page objects");
+    }
+}
+
+// caller must hold ctxAccess
+// link destinations are resolved through the /Parent chain of their page objects.
+// returns true if that failed and all page objects have been loaded for a retry
+bool PdfEngineImpl::LoadAllPageObjsAfterFailedLookup()
+{
+    if (!_doc->page_lookup_failed || loadedAllPageObjs)
+        return false;
+    LoadAllPageObjs();
+    return _doc->page_objs != nullptr;
+}
+
+// caller must hold ctxAccess (throws on failure)
+pdf_page *PdfEngineImpl::LoadPdfPage(int pageNo)
+{
+    pdf_obj *pageObj = GetPdfPageObj(pageNo);
+    pdf_page *page = pdf_load_page_by_obj(_doc, pageNo - 1, pageObj);
+    // link destinations are resolved to page numbers while loading the page
+    if (LoadAllPageObjsAfterFailedLookup()) {
+        pdf_free_page(_doc, page);
+        page = pdf_load_page_by_obj(_doc, pageNo - 1, pageObj);
+    }
+    return page;
+}
+
 int PdfEngineImpl::GetPageNo(pdf_page *page)
 {
     for (int i = 0; i < PageCount(); i++)
@@ -1894,90 +2453,253 @@ PdfPageRun *PdfEngineImpl::CreatePageRun(pdf_page *page, fz_display_list *list)
     return new PdfPageRun(page, list, data);
 }
 
-PdfPageRun *PdfEngineImpl::GetPageRun(pdf_page *page, bool tryOnly)
+static inline size_t HashPageRun(pdf_page *page)
 {
-    PdfPageRun *result = nullptr;
+    return ((uintptr_t)page / sizeof(void *)) & (PAGE_RUN_CACHE_BUCKETS - 1);
+}
 
+// caller must hold pagesAccess
+PdfPageRun *PdfEngineImpl::FindCachedRun(pdf_page *page)
+{
+    PdfPageRun *run = runBuckets[HashPageRun(page)];
+    for (; run && run->page != page; run = run->nextInBucket);
+    return run;
+}
+
+// caller must hold pagesAccess
+void PdfEngineImpl::CacheRun(PdfPageRun *run, bool mostRecent)
+{
+    CrashIf(run->cached);
+    size_t bucket = HashPageRun(run->page);
+    run->nextInBucket = runBuckets[bucket];
+    runBuckets[bucket] = run;
+
+    if (mostRecent) {
+        run->mruPrev = nullptr;
+        run->mruNext = runFirst;
+        if (runFirst)
+            runFirst->mruPrev = run;
+        else
+            runLast = run;
+        runFirst = run;
+    }
+    else {
+        run->mruPrev = runLast;
+        run->mruNext = nullptr;
+        if (runLast)
+            runLast->mruNext = run;
+        else
+            runFirst = run;
+        runLast = run;
+    }
+
+    run->cached = true;
+    runCount++;
+    runCacheSize += run->size_est;
+}
+
+// caller must hold pagesAccess
+void PdfEngineImpl::UncacheRun(PdfPageRun *run)
+{
+    if (!run->cached)
+        return;
+
+    PdfPageRun **link = &runBuckets[HashPageRun(run->page)];
+    for (; *link != run; link = &(*link)->nextInBucket);
+    *link = run->nextInBucket;
+    run->nextInBucket = nullptr;
+
+    if (run->mruPrev)
+        run->mruPrev->mruNext = run->mruNext;
+    else
+        runFirst = run->mruNext;
+    if (run->mruNext)
+        run->mruNext->mruPrev = run->mruPrev;
+    else
+        runLast = run->mruPrev;
+    run->mruPrev = run->mruNext = nullptr;
+
+    run->cached = false;
+    runCount--;
+    runCacheSize -= run->size_est;
+}
+
+// drops the least recently used page runs until the cache fits into its memory
+// budget (except for the two most recently used ones, even if they contain huge images)
+void PdfEngineImpl::ShrinkRunCache()
+{
     ScopedCritSec scope(&pagesAccess);
+    while (runCacheSize > gPageRunCacheSize && runCount > 2) {
+        DropPageRun(runLast, true);
+    }
+}
 
-    for (size_t i = 0; i < runCache.Count(); i++) {
-        if (runCache.At(i)->page == page) {
-            result = runCache.At(i);
-            break;
-        }
+// caller must hold pagesAccess
+PdfRunBuild *PdfEngineImpl::FindRunBuild(pdf_page *page)
+{
+    for (size_t i = 0; i < runBuilds.Count(); i++) {
+        if (runBuilds.At(i)->page == page)
+            return runBuilds.At(i);
     }
-    if (!result && !tryOnly) {
-        size_t mem = 0;
-        for (size_t i = 0; i < runCache.Count(); i++) {
-            // drop page runs that take up too much memory due to huge images
-            // (except for the very recently used ones)
-            if (i >= 2 && mem + runCache.At(i)->size_est >= MAX_PAGE_RUN_MEMORY)
-                DropPageRun(runCache.At(i--), true);
-            else
-                mem += runCache.At(i)->size_est;
-        }
-        if (runCache.Count() >= MAX_PAGE_RUN_CACHE) {
-            assert(runCache.Count() == MAX_PAGE_RUN_CACHE);
-            DropPageRun(runCache.Last(), true);
-        }
+    return nullptr;
+}
 
-        ScopedCritSec scope2(&ctxAccess);
+// caller must hold pagesAccess
+void PdfEngineImpl::DropRunBuild(PdfRunBuild *build)
+{
+    if (--build->refs == 0)
+        delete build;
+}
 
-        fz_display_list *list = nullptr;
-        fz_device *dev = nullptr;
-        fz_var(list);
-        fz_var(dev);
-        fz_try(ctx) {
-            list = fz_new_display_list(ctx);
-            dev = fz_new_list_device(ctx, list);
-            pdf_run_page(_doc, page, dev, &fz_identity, nullptr);
-        }
-        fz_catch(ctx) {
-            fz_drop_display_list(ctx, list);
-            list = nullptr;
+// records a page into a new display list (caller must hold ctxAccess);
+// returns nullptr if recording failed or has been aborted
+fz_display_list *PdfEngineImpl::RecordPageList(pdf_page *page, RenderTarget target, FitzAbortCookie *cookie)
+{
+    char *targetName = target == Target_Print ? "Print" :
+                       target == Target_Export ? "Export" : "View";
+    fz_display_list *list = nullptr;
+    fz_device *dev = nullptr;
+    fz_var(list);
+    fz_var(dev);
+    fz_try(ctx) {
+        list = fz_new_display_list(ctx);
+        dev = fz_new_list_device(ctx, list);
+        pdf_run_page_with_usage(_doc, page, dev, &fz_identity, targetName, cookie ? &cookie->cookie : nullptr);
+    }
+    fz_catch(ctx) {
+        fz_drop_display_list(ctx, list);
+        list = nullptr;
+    }
+    fz_free_device(dev);
+
+    // an aborted list is incomplete
+    if (list && cookie && cookie->cookie.abort) {
+        fz_drop_display_list(ctx, list);
+        list = nullptr;
+    }
+    return list;
+}
+
+PdfPageRun *PdfEngineImpl::GetPageRun(pdf_page *page, bool tryOnly, bool speculative)
+{
+    ScopedCritSec scope(&pagesAccess);
+
+    PdfPageRun *result = FindCachedRun(page);
+    // a page needed right away takes precedence over prefetching
+    // (which would otherwise keep ctxAccess busy)
+    if (!result && !speculative) {
+        for (size_t i = 0; i < runBuilds.Count(); i++) {
+            if (runBuilds.At(i)->cookie)
+                runBuilds.At(i)->cookie->Abort();
         }
-        fz_free_device(dev);
+    }
+    // wait for another thread which is already recording this page
+    // instead of recording it a second time
+    for (PdfRunBuild *build; !result && (build = FindRunBuild(page)) != nullptr; ) {
+        build->refs++;
+        LeaveCriticalSection(&pagesAccess);
+        WaitForSingleObject(build->done, INFINITE);
+        EnterCriticalSection(&pagesAccess);
+        DropRunBuild(build);
+        result = FindCachedRun(page);
+    }
 
-        if (list) {
+    if (!result && !tryOnly) {
+        // interpreting the page only requires ctxAccess, so that other threads
+        // can meanwhile replay cached runs or record different pages
+        PdfRunBuild *build = new PdfRunBuild(page, speculative);
+        runBuilds.Append(build);
+        LeaveCriticalSection(&pagesAccess);
+
+        EnterCriticalSection(&ctxAccess);
+        fz_display_list *list = RecordPageList(page, Target_View, build->cookie);
+        if (list)
             result = CreatePageRun(page, list);
-            runCache.InsertAt(0, result);
+        LeaveCriticalSection(&ctxAccess);
+
+        EnterCriticalSection(&pagesAccess);
+        if (result) {
+            // speculatively created runs are the first to be dropped
+            // again in case the cache runs out of memory
+            CacheRun(result, !speculative);
         }
+        runBuilds.Remove(build);
+        SetEvent(build->done);
+        DropRunBuild(build);
     }
-    else if (result && result != runCache.At(0)) {
+    else if (result && !speculative && result != runFirst) {
         // keep the list Most Recently Used first
-        runCache.Remove(result);
-        runCache.InsertAt(0, result);
+        UncacheRun(result);
+        CacheRun(result, true);
     }
 
-    if (result)
+    if (result) {
         result->refs++;
+        ShrinkRunCache();
+    }
     return result;
 }
 
+// records a page into a display list which isn't cached (so that it can be replayed
+// on cloned contexts, e.g. for several bands at once, cf. RenderBitmap)
+PdfPageRun *PdfEngineImpl::GetTargetPageRun(pdf_page *page, RenderTarget target, FitzAbortCookie *cookie)
+{
+    ScopedCritSec scope(&ctxAccess);
+
+    fz_display_list *list = RecordPageList(page, target, cookie);
+    if (!list)
+        return nullptr;
+
+    // the image positions are only collected for cached runs (cf. CreatePageRun)
+    Vec<FitzImagePos> positions;
+    ListInspectionData data(positions);
+    return new PdfPageRun(page, list, data);
+}
+
+void PdfEngineImpl::PrefetchAdjacentRuns(int pageNo)
+{
+    ScopedCritSec scope(&pagesAccess);
+    if (!runPrefetcher) {
+        runPrefetcher = new PdfRunPrefetcher(this);
+        runPrefetcher->Start();
+    }
+    runPrefetcher->Request(pageNo);
+}
+
+// called on PdfRunPrefetcher's thread
+void PdfEngineImpl::PrefetchPageRun(int pageNo)
+{
+    if (pageNo < 1 || pageNo > PageCount())
+        return;
+
+    EnterCriticalSection(&pagesAccess);
+    // only use the memory that isn't needed for the pages currently being rendered
+    bool skip = runCacheSize >= gPageRunCacheSize ||
+                (_pages[pageNo-1] && FindCachedRun(_pages[pageNo-1]));
+    LeaveCriticalSection(&pagesAccess);
+    if (skip)
+        return;
+
+    pdf_page *page = GetPdfPage(pageNo);
+    if (!page || !pdf_is_dict(page->me))
+        return;
+    PdfPageRun *run = GetPageRun(page, false, true);
+    if (run)
+        DropPageRun(run);
+}
+
 bool PdfEngineImpl::RunPage(pdf_page *page, fz_device *dev, const fz_matrix *ctm, RenderTarget target, const fz_rect *cliprect, bool cacheRun, FitzAbortCookie *cookie)
 {
     bool ok = true;
 
     PdfPageRun *run;
     if (Target_View == target && (run = GetPageRun(page, !cacheRun)) != nullptr) {
-        EnterCriticalSection(&ctxAccess);
-        Vec<PageAnnotation> pageAnnots = fz_get_user_page_annots(userAnnots, GetPageNo(page));
-        fz_try(ctx) {
-            fz_rect pagerect;
-            fz_begin_page(dev, pdf_bound_page(_doc, page, &pagerect), ctm);
-            fz_run_page_transparency(pageAnnots, dev, cliprect, false, page->transparency);
-            fz_run_display_list(run->list, dev, ctm, cliprect, cookie ? &cookie->cookie : nullptr);
-            fz_run_page_transparency(pageAnnots, dev, cliprect, true, page->transparency);
-            fz_run_user_page_annots(pageAnnots, dev, ctm, cliprect, cookie ? &cookie->cookie : nullptr);
-            fz_end_page(dev);
-        }
-        fz_catch(ctx) {
-            ok = false;
-        }
-        LeaveCriticalSection(&ctxAccess);
+        ok = RunPageList(run, dev, ctm, cliprect, cookie);
         DropPageRun(run);
     }
     else {
+        // interpreting the page requires document access and thus ctx
+        CrashIf(dev->ctx != ctx);
         ScopedCritSec scope(&ctxAccess);
         char *targetName = target == Target_Print ? "Print" :
                            target == Target_Export ? "Export" : "View";
@@ -1996,20 +2718,144 @@ bool PdfEngineImpl::RunPage(pdf_page *page, fz_device *dev, const fz_matrix *ctm
         }
     }
 
-    EnterCriticalSection(&ctxAccess);
-    fz_free_device(dev);
-    LeaveCriticalSection(&ctxAccess);
+    if (dev->ctx != ctx) {
+        fz_free_device(dev);
+    }
+    else {
+        EnterCriticalSection(&ctxAccess);
+        fz_free_device(dev);
+        LeaveCriticalSection(&ctxAccess);
+    }
 
     return ok && !(cookie && cookie->cookie.abort);
 }
 
+// display lists are immutable once they've been created, so they can be
+// replayed without holding ctxAccess if dev has been created for a context
+// from ctxPool (the shared resource store is protected by fz_locks_ctx)
+bool PdfEngineImpl::RunPageList(PdfPageRun *run, fz_device *dev, const fz_matrix *ctm, const fz_rect *cliprect, FitzAbortCookie *cookie)
+{
+    bool ok = true;
+    pdf_page *page = run->page;
+    fz_context *runCtx = dev->ctx;
+    bool isClone = runCtx != ctx;
+
+    EnterCriticalSection(&ctxAccess);
+    Vec<PageAnnotation> pageAnnots = fz_get_user_page_annots(userAnnots, GetPageNo(page));
+    if (isClone)
+        LeaveCriticalSection(&ctxAccess);
+
+    fz_try(runCtx) {
+        fz_rect pagerect;
+        fz_begin_page(dev, pdf_bound_page(_doc, page, &pagerect), ctm);
+        fz_run_page_transparency(pageAnnots, dev, cliprect, false, page->transparency);
+        fz_run_display_list(run->list, dev, ctm, cliprect, cookie ? &cookie->cookie : nullptr);
+        fz_run_page_transparency(pageAnnots, dev, cliprect, true, page->transparency);
+        fz_run_user_page_annots(pageAnnots, dev, ctm, cliprect, cookie ? &cookie->cookie : nullptr);
+        fz_end_page(dev);
+    }
+    fz_catch(runCtx) {
+        ok = false;
+    }
+
+    if (!isClone)
+        LeaveCriticalSection(&ctxAccess);
+    return ok;
+}
+
+DWORD WINAPI PdfEngineImpl::RenderBandThread(LPVOID data)
+{
+    PdfRenderBand *band = (PdfRenderBand *)data;
+    band->ok = band->engine->RunPageList(band->run, band->dev, band->ctm, &band->cliprect, &band->cookie);
+    return 0;
+}
+
+// time between checks whether rendering the bands of a page has been aborted
+#define RENDER_BAND_ABORT_CHECK_MS 50
+
+// rasterizes run into image in bandCount horizontal bands at once, each of them
+// replaying the display list with its own context from ctxPool and its own draw device
+// writing straight into its rows of image; returns false if the bands couldn't
+// be set up (in which case nothing has been rendered and ok hasn't been set)
+bool PdfEngineImpl::RunPageListInBands(PdfPageRun *run, fz_pixmap *image, const fz_matrix *ctm, int bandCount, FitzAbortCookie *cookie, bool *ok)
+{
+    CrashIf(bandCount > MAX_RENDER_BANDS);
+    fz_context *bandCtxs[MAX_RENDER_BANDS] = { 0 };
+    fz_pixmap *bandPixmaps[MAX_RENDER_BANDS] = { 0 };
+    PdfRenderBand bands[MAX_RENDER_BANDS];
+
+    int count = 0;
+    while (count < bandCount && (bandCtxs[count] = ctxPool.Get()) != nullptr) {
+        count++;
+    }
+
+    bool setUp = count > 1;
+    for (int i = 0; i < count && setUp; i++) {
+        fz_context *bandCtx = bandCtxs[i];
+        fz_irect bbox;
+        fz_pixmap_bbox_no_ctx(image, &bbox);
+        bbox.y0 = image->y + image->h * i / count;
+        bbox.y1 = image->y + image->h * (i + 1) / count;
+        unsigned char *samples = image->samples + (size_t)(bbox.y0 - image->y) * image->w * image->n;
+
+        fz_var(bandPixmaps[i]);
+        fz_try(bandCtx) {
+            bandPixmaps[i] = fz_new_pixmap_with_bbox_and_data(bandCtx, image->colorspace, &bbox, samples);
+            bands[i].dev = fz_new_draw_device(bandCtx, bandPixmaps[i]);
+        }
+        fz_catch(bandCtx) {
+            setUp = false;
+        }
+        bands[i].engine = this;
+        bands[i].run = run;
+        bands[i].ctm = ctm;
+        fz_rect_from_irect(&bands[i].cliprect, &bbox);
+    }
+
+    if (setUp) {
+        HANDLE threads[MAX_RENDER_BANDS];
+        int threadCount = 0;
+        for (int i = 0; i < count; i++) {
+            bands[i].thread = CreateThread(nullptr, 0, RenderBandThread, &bands[i], 0, nullptr);
+            if (bands[i].thread)
+                threads[threadCount++] = bands[i].thread;
+            else
+                RenderBandThread(&bands[i]);
+        }
+        // the current thread forwards an abort request to all the bands' cookies
+        while (threadCount > 0 && WaitForMultipleObjects(threadCount, threads, TRUE, RENDER_BAND_ABORT_CHECK_MS) == WAIT_TIMEOUT) {
+            if (cookie && cookie->cookie.abort) {
+                for (int i = 0; i < count; i++) {
+                    bands[i].cookie.Abort();
+                }
+            }
+        }
+        *ok = true;
+        for (int i = 0; i < count; i++) {
+            if (bands[i].thread) {
+                WaitForSingleObject(bands[i].thread, INFINITE);
+                CloseHandle(bands[i].thread);
+            }
+            *ok = *ok && bands[i].ok;
+        }
+    }
+
+    // the band pixmaps don't own their samples, so image remains valid
+    for (int i = 0; i < count; i++) {
+        fz_free_device(bands[i].dev);
+        fz_drop_pixmap(bandCtxs[i], bandPixmaps[i]);
+        ctxPool.Release(bandCtxs[i]);
+    }
+    return setUp;
+}
+
 void PdfEngineImpl::DropPageRun(PdfPageRun *run, bool forceRemove)
 {
     ScopedCritSec scope(&pagesAccess);
     run->refs--;
 
     if (0 == run->refs || forceRemove)
-        runCache.Remove(run);
+        UncacheRun(run);
 
     if (0 == run->refs) {
         ScopedCritSec ctxScope(&ctxAccess);
@@ -2024,12 +2870,13 @@ RectD PdfEngineImpl::PageMediabox(int pageNo)
     if (!_mediaboxes[pageNo-1].IsEmpty())
         return _mediaboxes[pageNo-1];
 
-    pdf_obj *page = _pageObjs[pageNo - 1];
+    ScopedCritSec scope(&ctxAccess);
+
+    // only resolve inherited values when they're needed
+    pdf_obj *page = GetPdfPageObj(pageNo);
     if (!page)
         return RectD();
 
-    ScopedCritSec scope(&ctxAccess);
-
     // cf. pdf-page.c's pdf_load_page
     fz_rect mbox = fz_empty_rect, cbox = fz_empty_rect;
     int rotate = 0;
@@ -2131,41 +2978,108 @@ RenderedBitmap *PdfEngineImpl::RenderBitmap(int pageNo, float zoom, int rotation
     fz_irect bbox;
     fz_round_rect(&bbox, fz_transform_rect(&r, &ctm));
 
-    fz_pixmap *image = nullptr;
-    EnterCriticalSection(&ctxAccess);
-    fz_try(ctx) {
-        fz_colorspace *colorspace = fz_device_rgb(ctx);
-        image = fz_new_pixmap_with_bbox(ctx, colorspace, &bbox);
-        fz_clear_pixmap_with_value(ctx, image, 0xFF); // initialize white background
-    }
-    fz_catch(ctx) {
-        LeaveCriticalSection(&ctxAccess);
-        return nullptr;
-    }
+    // if the page's display list is (or can be) cached, rasterization
+    // happens on a cloned context in parallel to other threads
+    PdfPageRun *run = Target_View == target ? GetPageRun(page) : nullptr;
+    if (run && (int64)(bbox.x1 - bbox.x0) * (bbox.y1 - bbox.y0) >= PAGE_RUN_PREFETCH_MIN_PIXELS)
+        PrefetchAdjacentRuns(pageNo);
+    // large pages (e.g. posters or pages being printed) are rasterized in several
+    // bands at once, which requires a display list for Print and Export as well
+    int bandCount = GetRenderBandCount(bbox);
+    FitzAbortCookie *cookie = nullptr;
+    if (cookie_out)
+        *cookie_out = cookie = new FitzAbortCookie();
+    if (!run && bandCount > 1 && target != Target_View)
+        run = GetTargetPageRun(page, target, cookie);
+    // the bands are rendered with contexts of their own, so that
+    // there's no need to hold on to another one from ctxPool
+    bool inBands = run && bandCount > 1;
+    fz_context *renderCtx = run && !inBands ? ctxPool.Get() : nullptr;
+    if (!renderCtx)
+        renderCtx = ctx;
+    // ctxAccess is only needed when rendering with ctx itself
+    CRITICAL_SECTION *renderAccess = renderCtx == ctx ? &ctxAccess : nullptr;
 
+    fz_pixmap *image = nullptr;
     fz_device *dev = nullptr;
-    fz_try(ctx) {
-        dev = fz_new_draw_device(ctx, image);
-    }
-    fz_catch(ctx) {
-        fz_drop_pixmap(ctx, image);
-        LeaveCriticalSection(&ctxAccess);
+    HBITMAP hbmp = nullptr;
+    HANDLE hMap = nullptr;
+    fz_var(image);
+    fz_var(hbmp);
+    fz_var(hMap);
+    if (renderAccess)
+        EnterCriticalSection(renderAccess);
+    fz_try(renderCtx) {
+        // render straight into the resulting bitmap's memory, if possible
+        image = new_dib_section_pixmap(renderCtx, &bbox, &hbmp, &hMap);
+        if (!image)
+            image = fz_new_pixmap_with_bbox(renderCtx, fz_device_rgb(renderCtx), &bbox);
+        fz_clear_pixmap_with_value(renderCtx, image, 0xFF); // initialize white background
+        if (!inBands)
+            dev = fz_new_draw_device(renderCtx, image);
+    }
+    fz_catch(renderCtx) {
+        fz_drop_pixmap(renderCtx, image);
+        image = nullptr;
+        if (hbmp)
+            free_dib_section(hbmp, hMap);
+    }
+    if (renderAccess)
+        LeaveCriticalSection(renderAccess);
+
+    if (!image) {
+        if (renderCtx != ctx)
+            ctxPool.Release(renderCtx);
+        if (run)
+            DropPageRun(run);
         return nullptr;
     }
-    LeaveCriticalSection(&ctxAccess);
 
-    FitzAbortCookie *cookie = nullptr;
-    if (cookie_out)
-        *cookie_out = cookie = new FitzAbortCookie();
     fz_rect cliprect;
-    bool ok = RunPage(page, dev, &ctm, target, fz_rect_from_irect(&cliprect, &bbox), true, cookie);
-
-    ScopedCritSec scope(&ctxAccess);
+    fz_rect_from_irect(&cliprect, &bbox);
+    bool ok = false;
+    if (run) {
+        if (!inBands || !RunPageListInBands(run, image, &ctm, bandCount, cookie, &ok)) {
+            if (!dev) {
+                // fall back to rendering the whole page at once
+                if (renderAccess)
+                    EnterCriticalSection(renderAccess);
+                fz_try(renderCtx) {
+                    dev = fz_new_draw_device(renderCtx, image);
+                }
+                fz_catch(renderCtx) { }
+                if (renderAccess)
+                    LeaveCriticalSection(renderAccess);
+            }
+            ok = dev && RunPageList(run, dev, &ctm, &cliprect, cookie);
+        }
+        ok = ok && !(cookie && cookie->cookie.abort);
+        if (renderAccess)
+            EnterCriticalSection(renderAccess);
+        fz_free_device(dev);
+        if (renderAccess)
+            LeaveCriticalSection(renderAccess);
+        DropPageRun(run);
+    }
+    else {
+        ok = RunPage(page, dev, &ctm, target, &cliprect, true, cookie);
+    }
 
+    if (renderAccess)
+        EnterCriticalSection(renderAccess);
     RenderedBitmap *bitmap = nullptr;
-    if (ok)
-        bitmap = new_rendered_fz_pixmap(ctx, image);
-    fz_drop_pixmap(ctx, image);
+    if (ok && hbmp)
+        bitmap = new_rendered_dib_section(image, hbmp, hMap);
+    else if (ok)
+        bitmap = new_rendered_fz_pixmap(renderCtx, image);
+    else if (hbmp)
+        free_dib_section(hbmp, hMap);
+    fz_drop_pixmap(renderCtx, image);
+    if (renderAccess)
+        LeaveCriticalSection(renderAccess);
+
+    if (renderCtx != ctx)
+        ctxPool.Release(renderCtx);
     return bitmap;
 }
 
@@ -2376,25 +3290,47 @@ WCHAR *PdfEngineImpl::ExtractPageText(pdf_page *page, const WCHAR *lineSep, Rect
     if (!page)
         return nullptr;
 
+    // text extraction from a cached display list can happen on a cloned
+    // context in parallel to rendering (cf. RenderBitmap)
+    PdfPageRun *run = Target_View == target ? GetPageRun(page, !cacheRun) : nullptr;
+    // for uncached pages, only recording the page requires ctxAccess
+    // and the text is extracted from a temporary display list
+    if (!run)
+        run = GetTargetPageRun(page, target, nullptr);
+    fz_context *textCtx = run ? ctxPool.Get() : nullptr;
+    if (!textCtx)
+        textCtx = ctx;
+    CRITICAL_SECTION *textAccess = textCtx == ctx ? &ctxAccess : nullptr;
+
     fz_text_sheet *sheet = nullptr;
     fz_text_page *text = nullptr;
     fz_device *dev = nullptr;
     fz_var(sheet);
     fz_var(text);
+    fz_var(dev);
 
-    EnterCriticalSection(&ctxAccess);
-    fz_try(ctx) {
-        sheet = fz_new_text_sheet(ctx);
-        text = fz_new_text_page(ctx);
-        dev = fz_new_text_device(ctx, sheet, text);
-    }
-    fz_catch(ctx) {
-        fz_free_text_page(ctx, text);
-        fz_free_text_sheet(ctx, sheet);
-        LeaveCriticalSection(&ctxAccess);
+    if (textAccess)
+        EnterCriticalSection(textAccess);
+    fz_try(textCtx) {
+        sheet = fz_new_text_sheet(textCtx);
+        text = fz_new_text_page(textCtx);
+        dev = fz_new_text_device(textCtx, sheet, text);
+    }
+    fz_catch(textCtx) {
+        fz_free_text_page(textCtx, text);
+        fz_free_text_sheet(textCtx, sheet);
+        dev = nullptr;
+    }
+    if (textAccess)
+        LeaveCriticalSection(textAccess);
+
+    if (!dev) {
+        if (textCtx != ctx)
+            ctxPool.Release(textCtx);
+        if (run)
+            DropPageRun(run);
         return nullptr;
     }
-    LeaveCriticalSection(&ctxAccess);
 
     if (!cacheRun)
         fz_enable_device_hints(dev, FZ_NO_CACHE);
@@ -2402,16 +3338,32 @@ WCHAR *PdfEngineImpl::ExtractPageText(pdf_page *page, const WCHAR *lineSep, Rect
     // use an infinite rectangle as bounds (instead of pdf_bound_page) to ensure that
     // the extracted text is consistent between cached runs using a list device and
     // fresh runs (otherwise the list device omits text outside the mediabox bounds)
-    bool ok = RunPage(page, dev, &fz_identity, target, nullptr, cacheRun);
-
-    ScopedCritSec scope(&ctxAccess);
+    bool ok;
+    if (run) {
+        ok = RunPageList(run, dev, &fz_identity);
+        if (textAccess)
+            EnterCriticalSection(textAccess);
+        fz_free_device(dev);
+        if (textAccess)
+            LeaveCriticalSection(textAccess);
+        DropPageRun(run);
+    }
+    else {
+        ok = RunPage(page, dev, &fz_identity, target, nullptr, cacheRun);
+    }
 
+    if (textAccess)
+        EnterCriticalSection(textAccess);
     WCHAR *content = nullptr;
     if (ok)
         content = fz_text_page_to_str(text, lineSep, coordsOut);
-    fz_free_text_page(ctx, text);
-    fz_free_text_sheet(ctx, sheet);
+    fz_free_text_page(textCtx, text);
+    fz_free_text_sheet(textCtx, sheet);
+    if (textAccess)
+        LeaveCriticalSection(textAccess);
 
+    if (textCtx != ctx)
+        ctxPool.Release(textCtx);
     return content;
 }
 
@@ -2423,7 +3375,7 @@ WCHAR *PdfEngineImpl::ExtractPageText(int pageNo, const WCHAR *lineSep, RectI **
 
     EnterCriticalSection(&ctxAccess);
     fz_try(ctx) {
-        page = pdf_load_page_by_obj(_doc, pageNo - 1, _pageObjs[pageNo-1]);
+        page = LoadPdfPage(pageNo);
     }
     fz_catch(ctx) {
         LeaveCriticalSection(&ctxAccess);
@@ -2468,7 +3420,7 @@ bool PdfEngineImpl::IsLinearizedFile()
     if (pdf_to_int(pdf_dict_gets(obj, "L")) != _doc->file_size)
         return false;
     // /O must be the object number of the first page
-    if (pdf_to_int(pdf_dict_gets(obj, "O")) != pdf_to_num(_pageObjs[0]))
+    if (pdf_to_int(pdf_dict_gets(obj, "O")) != pdf_to_num(GetPdfPageObj(1)))
         return false;
     // /N must be the total number of pages
     if (pdf_to_int(pdf_dict_gets(obj, "N")) != PageCount())
@@ -2674,8 +3626,10 @@ bool PdfEngineImpl::SupportsAnnotation(bool forSaving) const
 {
     if (forSaving) {
         // TODO: support updating of documents where pages aren't all numbered objects?
-        for (int i = 0; i < PageCount(); i++) {
-            if (pdf_to_num(_pageObjs[i]) == 0)
+        PdfEngineImpl *engine = const_cast<PdfEngineImpl *>(this);
+        ScopedCritSec scope(&engine->ctxAccess);
+        for (int i = 1; i <= PageCount(); i++) {
+            if (pdf_to_num(engine->GetPdfPageObj(i)) == 0)
                 return false;
         }
     }
@@ -2898,7 +3852,8 @@ bool PdfEngineImpl::SaveUserAnnots(const WCHAR *fileName)
         for (int pageNo = 1; pageNo <= PageCount(); pageNo++) {
             pdf_page *page = GetPdfPage(pageNo);
             // TODO: this will skip annotations for broken documents
-            if (!page || !pdf_to_num(_pageObjs[pageNo - 1])) {
+            pdf_obj *pageObj = GetPdfPageObj(pageNo);
+            if (!page || !pdf_to_num(pageObj)) {
                 ok = false;
                 break;
             }
@@ -2906,18 +3861,18 @@ bool PdfEngineImpl::SaveUserAnnots(const WCHAR *fileName)
             if (pageAnnots.Count() == 0)
                 continue;
             // get the page's /Annots array for appending
-            pdf_obj *annots = pdf_dict_gets(_pageObjs[pageNo - 1], "Annots");
+            pdf_obj *annots = pdf_dict_gets(pageObj, "Annots");
             if (!pdf_is_array(annots)) {
-                pdf_dict_puts_drop(_pageObjs[pageNo - 1], "Annots", pdf_new_array(_doc, (int)pageAnnots.Count()));
-                annots = pdf_dict_gets(_pageObjs[pageNo - 1], "Annots");
+                pdf_dict_puts_drop(pageObj, "Annots", pdf_new_array(_doc, (int)pageAnnots.Count()));
+                annots = pdf_dict_gets(pageObj, "Annots");
             }
             if (!pdf_is_indirect(annots)) {
                 // make /Annots indirect for the current /Page
-                pdf_dict_puts_drop(_pageObjs[pageNo - 1], "Annots", pdf_new_ref(_doc, annots));
+                pdf_dict_puts_drop(pageObj, "Annots", pdf_new_ref(_doc, annots));
             }
             // append all annotations for the current page
             for (size_t i = 0; i < pageAnnots.Count(); i++) {
-                ok &= pdf_file_update_add_annotation(_doc, page, _pageObjs[pageNo - 1], pageAnnots.At(i), annots);
+                ok &= pdf_file_update_add_annotation(_doc, page, pageObj, pageAnnots.At(i), annots);
             }
         }
         if (ok) {
@@ -3211,6 +4166,11 @@ BaseEngine *CreateFromStream(IStream *stream, PasswordUI *pwdUI)
     return PdfEngineImpl::CreateFromStream(stream, pwdUI);
 }
 
+void SetPageRunCacheSize(size_t maxSize)
+{
+    gPageRunCacheSize = maxSize > 0 ? maxSize : MAX_PAGE_RUN_MEMORY;
+}
+
 }
 
 ///// XPS-specific extensions to Fitz/MuXPS /////
@@ -3441,7 +4401,7 @@ protected:
     // protected critical section in order to avoid deadlocks
     CRITICAL_SECTION ctxAccess;
     fz_context *    ctx;
-    fz_locks_context fz_locks_ctx;
+    FitzLocks       fz_locks_ctx;
     xps_document *  _doc;
     fz_stream *     _docStream;
 
@@ -3565,10 +4525,7 @@ XpsEngineImpl::XpsEngineImpl() : _fileName(nullptr), _doc(nullptr), _docStream(n
     InitializeCriticalSection(&_pagesAccess);
     InitializeCriticalSection(&ctxAccess);
 
-    fz_locks_ctx.user = &ctxAccess;
-    fz_locks_ctx.lock = fz_lock_context_cs;
-    fz_locks_ctx.unlock = fz_unlock_context_cs;
-    ctx = fz_new_context(nullptr, &fz_locks_ctx, MAX_CONTEXT_MEMORY);
+    ctx = fz_new_context(nullptr, &fz_locks_ctx.locks, MAX_CONTEXT_MEMORY);
 }
 
 XpsEngineImpl::~XpsEngineImpl()
@@ -4011,13 +4968,21 @@ RenderedBitmap *XpsEngineImpl::RenderBitmap(int pageNo, float zoom, int rotation
     fz_round_rect(&bbox, fz_transform_rect(&r, &ctm));
 
     fz_pixmap *image = nullptr;
+    HBITMAP hbmp = nullptr;
+    HANDLE hMap = nullptr;
+    fz_var(hbmp);
+    fz_var(hMap);
     EnterCriticalSection(&ctxAccess);
     fz_try(ctx) {
-        fz_colorspace *colorspace = fz_device_rgb(ctx);
-        image = fz_new_pixmap_with_bbox(ctx, colorspace, &bbox);
+        // render straight into the resulting bitmap's memory, if possible
+        image = new_dib_section_pixmap(ctx, &bbox, &hbmp, &hMap);
+        if (!image)
+            image = fz_new_pixmap_with_bbox(ctx, fz_device_rgb(ctx), &bbox);
         fz_clear_pixmap_with_value(ctx, image, 0xFF); // initialize white background
     }
     fz_catch(ctx) {
+        if (hbmp)
+            free_dib_section(hbmp, hMap);
         LeaveCriticalSection(&ctxAccess);
         return nullptr;
     }
@@ -4028,6 +4993,8 @@ RenderedBitmap *XpsEngineImpl::RenderBitmap(int pageNo, float zoom, int rotation
     }
     fz_catch(ctx) {
         fz_drop_pixmap(ctx, image);
+        if (hbmp)
+            free_dib_section(hbmp, hMap);
         LeaveCriticalSection(&ctxAccess);
         return nullptr;
     }
@@ -4042,8 +5009,12 @@ RenderedBitmap *XpsEngineImpl::RenderBitmap(int pageNo, float zoom, int rotation
     ScopedCritSec scope(&ctxAccess);
 
     RenderedBitmap *bitmap = nullptr;
-    if (ok)
+    if (ok && hbmp)
+        bitmap = new_rendered_dib_section(image, hbmp, hMap);
+    else if (ok)
         bitmap = new_rendered_fz_pixmap(ctx, image);
+    else if (hbmp)
+        free_dib_section(hbmp, hMap);
     fz_drop_pixmap(ctx, image);
     return bitmap;
 }
@@ -6,6 +6,9 @@ namespace PdfEngine {
 bool IsSupportedFile(const WCHAR *fileName, bool sniff=false);
 BaseEngine *CreateFromFile(const WCHAR *fileName, PasswordUI *pwdUI=nullptr);
 BaseEngine *CreateFromStream(IStream *stream, PasswordUI *pwdUI=nullptr);
+// maximum amount of memory used per document for caching display lists
+// (0 restores the default of 40 MB)
+void SetPageRunCacheSize(size_t maxSize);
 
 }
 
@@ -26,8 +26,17 @@
 // define to view the tile boundaries
 #undef SHOW_TILE_LAYOUT
 
+// use all but one core (which is left for the UI thread) for rendering
+static int GetRenderThreadCount()
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return limitValue((int)si.dwNumberOfProcessors - 1, 1, MAX_RENDER_THREADS);
+}
+
 RenderCache::RenderCache()
-    : cacheCount(0), requestCount(0),
+    : lruFirst(nullptr), lruLast(nullptr), cacheCount(0), cacheSize(0),
+      maxCacheSize(DEFAULT_CACHE_SIZE), requestCount(0),
       maxTileSize(GetSystemMetrics(SM_CXSCREEN), GetSystemMetrics(SM_CYSCREEN)),
       isRemoteSession(GetSystemMetrics(SM_REMOTESESSION))
 {
@@ -37,9 +46,21 @@ RenderCache::RenderCache()
     InitializeCriticalSection(&cacheAccess);
     InitializeCriticalSection(&requestAccess);
 
+    ZeroMemory(buckets, sizeof(buckets));
+    ZeroMemory(&stats, sizeof(stats));
+    for (int i = 0; i < MAX_RENDER_THREADS; i++) {
+        curReqs[i] = nullptr;
+        renderThreads[i] = nullptr;
+    }
+
     startRendering = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-    renderThread = CreateThread(nullptr, 0, RenderCacheThread, this, 0, 0);
-    assert(nullptr != renderThread);
+    renderThreadCount = GetRenderThreadCount();
+    for (int i = 0; i < renderThreadCount; i++) {
+        threadData[i].cache = this;
+        threadData[i].threadIdx = i;
+        renderThreads[i] = CreateThread(nullptr, 0, RenderCacheThread, &threadData[i], 0, 0);
+        assert(nullptr != renderThreads[i]);
+    }
 }
 
 RenderCache::~RenderCache()
@@ -47,9 +68,12 @@ RenderCache::~RenderCache()
     EnterCriticalSection(&requestAccess);
     EnterCriticalSection(&cacheAccess);
 
-    CloseHandle(renderThread);
+    for (int i = 0; i < renderThreadCount; i++) {
+        CloseHandle(renderThreads[i]);
+        assert(!curReqs[i]);
+    }
     CloseHandle(startRendering);
-    assert(!curReq && 0 == requestCount && 0 == cacheCount);
+    assert(0 == requestCount && 0 == cacheCount);
 
     LeaveCriticalSection(&cacheAccess);
     DeleteCriticalSection(&cacheAccess);
@@ -57,6 +81,30 @@ RenderCache::~RenderCache()
     DeleteCriticalSection(&requestAccess);
 }
 
+// rotation and zoom aren't part of the hash, since there's at most one
+// cached bitmap per tile (cf. Add) and zoom changes on invalidation
+static size_t GetBucketIdx(DisplayModel *dm, int pageNo, TilePosition tile)
+{
+    uint32_t hash = (uint32_t)((uintptr_t)dm >> 4);
+    hash = hash * 31 + pageNo;
+    hash = hash * 31 + tile.res;
+    hash = hash * 31 + tile.row;
+    hash = hash * 31 + tile.col;
+    return hash & (BITMAP_CACHE_BUCKETS - 1);
+}
+
+// estimate the memory used by a (possibly palettized) bitmap
+static size_t GetBitmapSize(RenderedBitmap *bmp)
+{
+    if (!bmp)
+        return 0;
+    BITMAP info;
+    if (bmp->GetBitmap() && GetObject(bmp->GetBitmap(), sizeof(info), &info))
+        return (size_t)info.bmWidthBytes * abs(info.bmHeight);
+    SizeI size = bmp->Size();
+    return (size_t)size.dx * size.dy * 4;
+}
+
 /* Find a bitmap for a page defined by <dm> and <pageNo> and optionally also
    <rotation> and <zoom> in the cache - call DropCacheEntry when you
    no longer need a found entry. */
@@ -64,10 +112,17 @@ BitmapCacheEntry *RenderCache::Find(DisplayModel *dm, int pageNo, int rotation,
 {
     ScopedCritSec scope(&cacheAccess);
     rotation = NormalizeRotation(rotation);
-    for (int i = 0; i < cacheCount; i++) {
-        BitmapCacheEntry *entry = cache[i];
+    BitmapCacheEntry *entry;
+    if (tile)
+        entry = buckets[GetBucketIdx(dm, pageNo, *tile)];
+    else
+        entry = lruLast;
+    for (; entry; entry = tile ? entry->nextInBucket : entry->lruPrev) {
         if ((dm == entry->dm) && (pageNo == entry->pageNo) && (rotation == entry->rotation) &&
             (INVALID_ZOOM == zoom || zoom == entry->zoom) && (!tile || entry->tile == *tile)) {
+            // mark the entry as most recently used
+            RemoveEntry(entry);
+            InsertEntry(entry);
             entry->refs++;
             return entry;
         }
@@ -93,6 +148,79 @@ void RenderCache::DropCacheEntry(BitmapCacheEntry *entry)
     }
 }
 
+void RenderCache::HashEntry(BitmapCacheEntry *entry)
+{
+    size_t idx = GetBucketIdx(entry->dm, entry->pageNo, entry->tile);
+    entry->nextInBucket = buckets[idx];
+    buckets[idx] = entry;
+}
+
+void RenderCache::UnhashEntry(BitmapCacheEntry *entry)
+{
+    BitmapCacheEntry **link = &buckets[GetBucketIdx(entry->dm, entry->pageNo, entry->tile)];
+    for (; *link && *link != entry; link = &(*link)->nextInBucket);
+    CrashIf(!*link);
+    if (*link)
+        *link = entry->nextInBucket;
+    entry->nextInBucket = nullptr;
+}
+
+// adds an entry to the hash table and as most recently used to the LRU list
+void RenderCache::InsertEntry(BitmapCacheEntry *entry)
+{
+    HashEntry(entry);
+    entry->lruPrev = lruLast;
+    entry->lruNext = nullptr;
+    if (lruLast)
+        lruLast->lruNext = entry;
+    else
+        lruFirst = entry;
+    lruLast = entry;
+    cacheCount++;
+    cacheSize += entry->size;
+}
+
+// removes an entry from the hash table and the LRU list (without dropping it)
+void RenderCache::RemoveEntry(BitmapCacheEntry *entry)
+{
+    UnhashEntry(entry);
+    if (entry->lruPrev)
+        entry->lruPrev->lruNext = entry->lruNext;
+    else
+        lruFirst = entry->lruNext;
+    if (entry->lruNext)
+        entry->lruNext->lruPrev = entry->lruPrev;
+    else
+        lruLast = entry->lruPrev;
+    entry->lruPrev = entry->lruNext = nullptr;
+    cacheCount--;
+    cacheSize -= entry->size;
+}
+
+// evict the least recently used bitmaps until one of the given size fits into the cache
+void RenderCache::MakeRoomFor(DisplayModel *dm, size_t size)
+{
+    ScopedCritSec scope(&cacheAccess);
+    // first free invisible pages of the same DisplayModel ...
+    for (BitmapCacheEntry *entry = lruFirst, *next; entry; entry = next) {
+        if (cacheCount < MAX_BITMAPS_CACHED && cacheSize + size <= maxCacheSize)
+            return;
+        next = entry->lruNext;
+        if (entry->dm == dm && !dm->PageVisibleNearby(entry->pageNo)) {
+            RemoveEntry(entry);
+            DropCacheEntry(entry);
+            stats.evictions++;
+        }
+    }
+    // ... then just the least recently used ones
+    while (lruFirst && (cacheCount >= MAX_BITMAPS_CACHED || cacheSize + size > maxCacheSize)) {
+        BitmapCacheEntry *entry = lruFirst;
+        RemoveEntry(entry);
+        DropCacheEntry(entry);
+        stats.evictions++;
+    }
+}
+
 void RenderCache::Add(PageRenderRequest &req, RenderedBitmap *bitmap)
 {
     ScopedCritSec scope(&cacheAccess);
@@ -104,31 +232,30 @@ void RenderCache::Add(PageRenderRequest &req, RenderedBitmap *bitmap)
     /* It's possible there still is a cached bitmap with different zoom/rotation */
     FreePage(req.dm, req.pageNo, &req.tile);
 
-    if (cacheCount >= MAX_BITMAPS_CACHED) {
-        // free an invisible page of the same DisplayModel ...
-        for (int i = 0; i < cacheCount; i++) {
-            if (cache[i]->dm == req.dm && !req.dm->PageVisibleNearby(cache[i]->pageNo)) {
-                DropCacheEntry(cache[i]);
-                cacheCount--;
-                memmove(&cache[i], &cache[i + 1], (cacheCount - i) * sizeof(cache[0]));
-                break;
-            }
-        }
-        // ... or just the oldest cached page
-        if (cacheCount >= MAX_BITMAPS_CACHED) {
-            DropCacheEntry(cache[0]);
-            cacheCount--;
-            memmove(&cache[0], &cache[1], cacheCount * sizeof(cache[0]));
-        }
-    }
+    size_t size = GetBitmapSize(bitmap);
+    MakeRoomFor(req.dm, size);
 
     // Copy the PageRenderRequest as it will be reused
-    cache[cacheCount] = new BitmapCacheEntry(req.dm, req.pageNo, req.rotation, req.zoom, req.tile, bitmap);
-    CrashIf(!cache[cacheCount]);
-    if (!cache[cacheCount])
+    BitmapCacheEntry *entry = new BitmapCacheEntry(req.dm, req.pageNo, req.rotation, req.zoom, req.tile, bitmap, size);
+    CrashIf(!entry);
+    if (!entry)
         delete bitmap;
     else
-        cacheCount++;
+        InsertEntry(entry);
+}
+
+void RenderCache::SetMaxCacheSize(size_t maxSize)
+{
+    ScopedCritSec scope(&cacheAccess);
+    maxCacheSize = maxSize > 0 ? maxSize : DEFAULT_CACHE_SIZE;
+    if (cacheSize > maxCacheSize)
+        MakeRoomFor(nullptr, 0);
+}
+
+RenderCacheStats RenderCache::GetStats()
+{
+    ScopedCritSec scope(&cacheAccess);
+    return stats;
 }
 
 static RectD GetTileRect(RectD pagerect, TilePosition tile)
@@ -185,11 +312,9 @@ static bool IsTileVisible(DisplayModel *dm, int pageNo, TilePosition tile, float
 void RenderCache::FreePage(DisplayModel *dm, int pageNo, TilePosition *tile)
 {
     ScopedCritSec scope(&cacheAccess);
-    int cacheCountTmp = cacheCount;
-    int curPos = 0;
 
-    for (int i = 0; i < cacheCountTmp; i++) {
-        BitmapCacheEntry* entry = cache[i];
+    for (BitmapCacheEntry *entry = lruFirst, *next; entry; entry = next) {
+        next = entry->lruNext;
         bool shouldFree;
         if (dm && pageNo != INVALID_PAGE_NO) {
             // a specific page
@@ -203,7 +328,7 @@ void RenderCache::FreePage(DisplayModel *dm, int pageNo, TilePosition *tile)
             }
         } else if (dm) {
             // all pages of this DisplayModel
-            shouldFree = (cache[i]->dm == dm);
+            shouldFree = (entry->dm == dm);
         } else {
             // all invisible pages resp. page tiles
             shouldFree = !entry->dm->PageVisibleNearby(entry->pageNo);
@@ -212,15 +337,9 @@ void RenderCache::FreePage(DisplayModel *dm, int pageNo, TilePosition *tile)
         }
 
         if (shouldFree) {
+            RemoveEntry(entry);
             DropCacheEntry(entry);
-            cache[i] = nullptr;
-            cacheCount--;
         }
-
-        if (curPos != i)
-            cache[curPos] = cache[i];
-        if (!shouldFree)
-            curPos++;
     }
 }
 
@@ -229,13 +348,17 @@ void RenderCache::FreePage(DisplayModel *dm, int pageNo, TilePosition *tile)
 void RenderCache::KeepForDisplayModel(DisplayModel *oldDm, DisplayModel *newDm)
 {
     ScopedCritSec scope(&cacheAccess);
-    for (int i = 0; i < cacheCount; i++) {
-        if (cache[i]->dm == oldDm) {
-            if (oldDm->PageVisible(cache[i]->pageNo))
-                cache[i]->dm = newDm;
+    for (BitmapCacheEntry *entry = lruFirst; entry; entry = entry->lruNext) {
+        if (entry->dm == oldDm) {
+            if (oldDm->PageVisible(entry->pageNo)) {
+                // dm is part of the hash key
+                UnhashEntry(entry);
+                entry->dm = newDm;
+                HashEntry(entry);
+            }
             // make sure that the page is rerendered eventually
-            cache[i]->zoom = INVALID_ZOOM;
-            cache[i]->outOfDate = true;
+            entry->zoom = INVALID_ZOOM;
+            entry->outOfDate = true;
         }
     }
 }
@@ -246,17 +369,16 @@ void RenderCache::Invalidate(DisplayModel *dm, int pageNo, RectD rect)
     ScopedCritSec scopeReq(&requestAccess);
 
     ClearQueueForDisplayModel(dm, pageNo);
-    if (curReq && curReq->dm == dm && curReq->pageNo == pageNo)
-        AbortCurrentRequest();
+    AbortCurrentRequests(dm, pageNo);
 
     ScopedCritSec scopeCache(&cacheAccess);
 
     RectD mediabox = dm->GetEngine()->PageMediabox(pageNo);
-    for (int i = 0; i < cacheCount; i++) {
-        if (cache[i]->dm == dm && cache[i]->pageNo == pageNo &&
-            !GetTileRect(mediabox, cache[i]->tile).Intersect(rect).IsEmpty()) {
-            cache[i]->zoom = INVALID_ZOOM;
-            cache[i]->outOfDate = true;
+    for (BitmapCacheEntry *entry = lruFirst; entry; entry = entry->lruNext) {
+        if (entry->dm == dm && entry->pageNo == pageNo &&
+            !GetTileRect(mediabox, entry->tile).Intersect(rect).IsEmpty()) {
+            entry->zoom = INVALID_ZOOM;
+            entry->outOfDate = true;
         }
     }
 }
@@ -295,10 +417,10 @@ USHORT RenderCache::GetMaxTileRes(DisplayModel *dm, int pageNo, int rotation)
 {
     ScopedCritSec scope(&cacheAccess);
     USHORT maxRes = 0;
-    for (int i = 0; i < cacheCount; i++) {
-        if (cache[i]->dm == dm && cache[i]->pageNo == pageNo &&
-            cache[i]->rotation == rotation) {
-            maxRes = std::max(cache[i]->tile.res, maxRes);
+    for (BitmapCacheEntry *entry = lruFirst; entry; entry = entry->lruNext) {
+        if (entry->dm == dm && entry->pageNo == pageNo &&
+            entry->rotation == rotation) {
+            maxRes = std::max(entry->tile.res, maxRes);
         }
     }
     return maxRes;
@@ -320,11 +442,11 @@ bool RenderCache::ReduceTileSize()
         maxTileSize.dy /= 2;
 
     // invalidate all rendered bitmaps and all requests
-    while (cacheCount > 0)
-        FreeForDisplayModel(cache[0]->dm);
+    while (lruFirst)
+        FreeForDisplayModel(lruFirst->dm);
     while (requestCount > 0)
         ClearQueueForDisplayModel(requests[0].dm);
-    AbortCurrentRequest();
+    AbortCurrentRequests();
 
     return true;
 }
@@ -357,14 +479,17 @@ void RenderCache::RequestRendering(DisplayModel *dm, int pageNo, TilePosition ti
     int rotation = NormalizeRotation(dm->GetRotation());
     float zoom = dm->GetZoomReal(pageNo);
 
-    if (curReq && (curReq->pageNo == pageNo) && (curReq->dm == dm) && (curReq->tile == tile)) {
-        if ((curReq->zoom == zoom) && (curReq->rotation == rotation)) {
-            /* we're already rendering exactly the same page */
-            return;
+    for (int i = 0; i < renderThreadCount; i++) {
+        PageRenderRequest *curReq = curReqs[i];
+        if (curReq && (curReq->pageNo == pageNo) && (curReq->dm == dm) && (curReq->tile == tile)) {
+            if ((curReq->zoom == zoom) && (curReq->rotation == rotation) && !curReq->abort) {
+                /* we're already rendering exactly the same page */
+                return;
+            }
+            /* Currently rendered page is for the same page but with different zoom
+            or rotation, so abort it */
+            AbortCurrentRequests(dm, pageNo, &tile);
         }
-        /* Currently rendered page is for the same page but with different zoom
-        or rotation, so abort it */
-        AbortCurrentRequest();
     }
 
     // clear requests for tiles of different resolution and invisible tiles
@@ -377,7 +502,7 @@ void RenderCache::RequestRendering(DisplayModel *dm, int pageNo, TilePosition ti
             if ((req->zoom == zoom) && (req->rotation == rotation)) {
                 /* Request with exactly the same parameters already queued for
                    rendering. Move it to the top of the queue so that it'll
-                   be rendered faster. */
+                   be rendered before other requests of the same priority. */
                 PageRenderRequest tmp;
                 tmp = requests[requestCount-1];
                 requests[requestCount-1] = *req;
@@ -424,10 +549,15 @@ bool RenderCache::Render(DisplayModel *dm, int pageNo, int rotation, float zoom,
 
     /* add request to the queue */
     if (requestCount == MAX_PAGE_REQUESTS) {
-        /* queue is full -> remove the oldest items on the queue */
-        if (requests[0].renderCb)
-            requests[0].renderCb->Callback();
-        memmove(&(requests[0]), &(requests[1]), sizeof(PageRenderRequest) * (MAX_PAGE_REQUESTS - 1));
+        /* queue is full -> remove the oldest item of the lowest priority */
+        int dropIdx = 0;
+        for (int i = 1; i < requestCount; i++) {
+            if (GetRenderPriority(&requests[i]) > GetRenderPriority(&requests[dropIdx]))
+                dropIdx = i;
+        }
+        if (requests[dropIdx].renderCb)
+            requests[dropIdx].renderCb->Callback();
+        memmove(&(requests[dropIdx]), &(requests[dropIdx + 1]), sizeof(PageRenderRequest) * (MAX_PAGE_REQUESTS - dropIdx - 1));
         newRequest = &(requests[MAX_PAGE_REQUESTS-1]);
     } else {
         newRequest = &(requests[requestCount]);
@@ -464,8 +594,11 @@ UINT RenderCache::GetRenderDelay(DisplayModel *dm, int pageNo, TilePosition tile
 {
     ScopedCritSec scope(&requestAccess);
 
-    if (curReq && curReq->pageNo == pageNo && curReq->dm == dm && curReq->tile == tile)
-        return GetTickCount() - curReq->timestamp;
+    for (int i = 0; i < renderThreadCount; i++) {
+        PageRenderRequest *curReq = curReqs[i];
+        if (curReq && curReq->pageNo == pageNo && curReq->dm == dm && curReq->tile == tile)
+            return GetTickCount() - curReq->timestamp;
+    }
 
     for (int i = 0; i < requestCount; i++)
         if (requests[i].pageNo == pageNo && requests[i].dm == dm && requests[i].tile == tile)
@@ -474,7 +607,18 @@ UINT RenderCache::GetRenderDelay(DisplayModel *dm, int pageNo, TilePosition tile
     return RENDER_DELAY_UNDEFINED;
 }
 
-bool RenderCache::GetNextRequest(PageRenderRequest *req)
+// the priority is determined anew for every call, so that
+// it always reflects the current state of the view port
+RenderPriority RenderCache::GetRenderPriority(PageRenderRequest *req)
+{
+    if (req->renderCb)
+        return Priority_Thumbnail;
+    if (req->dm->PageVisible(req->pageNo) && IsTileVisible(req->dm, req->pageNo, req->tile))
+        return Priority_Visible;
+    return Priority_Prefetch;
+}
+
+bool RenderCache::GetNextRequest(PageRenderRequest *req, int threadIdx)
 {
     ScopedCritSec scope(&requestAccess);
 
@@ -483,21 +627,36 @@ bool RenderCache::GetNextRequest(PageRenderRequest *req)
 
     assert(requestCount > 0);
     assert(requestCount <= MAX_PAGE_REQUESTS);
+    // pick the most recent request of the highest priority
+    int nextIdx = requestCount - 1;
+    RenderPriority nextPriority = GetRenderPriority(&requests[nextIdx]);
+    for (int i = requestCount - 2; i >= 0 && nextPriority != Priority_Visible; i--) {
+        RenderPriority priority = GetRenderPriority(&requests[i]);
+        if (priority < nextPriority) {
+            nextIdx = i;
+            nextPriority = priority;
+        }
+    }
+    *req = requests[nextIdx];
     requestCount--;
-    *req = requests[requestCount];
-    curReq = req;
+    memmove(&(requests[nextIdx]), &(requests[nextIdx + 1]), sizeof(PageRenderRequest) * (requestCount - nextIdx));
+    curReqs[threadIdx] = req;
     assert(requestCount >= 0);
     assert(!req->abort);
 
+    // wake up another rendering thread for the remaining requests
+    if (requestCount > 0)
+        SetEvent(startRendering);
+
     return true;
 }
 
-bool RenderCache::ClearCurrentRequest()
+bool RenderCache::ClearCurrentRequest(int threadIdx)
 {
     ScopedCritSec scope(&requestAccess);
-    if (curReq)
-        delete curReq->abortCookie;
-    curReq = nullptr;
+    if (curReqs[threadIdx])
+        delete curReqs[threadIdx]->abortCookie;
+    curReqs[threadIdx] = nullptr;
 
     bool isQueueEmpty = requestCount == 0;
     return isQueueEmpty;
@@ -512,14 +671,18 @@ void RenderCache::CancelRendering(DisplayModel *dm)
 
     for (;;) {
         EnterCriticalSection(&requestAccess);
-        if (!curReq || (curReq->dm != dm)) {
+        bool isRendering = false;
+        for (int i = 0; i < renderThreadCount && !isRendering; i++) {
+            isRendering = curReqs[i] && curReqs[i]->dm == dm;
+        }
+        if (!isRendering) {
             // to be on the safe side
             ClearQueueForDisplayModel(dm);
             LeaveCriticalSection(&requestAccess);
             return;
         }
 
-        AbortCurrentRequest();
+        AbortCurrentRequests(dm);
         LeaveCriticalSection(&requestAccess);
 
         /* TODO: busy loop is not good, but I don't have a better idea */
@@ -547,31 +710,61 @@ void RenderCache::ClearQueueForDisplayModel(DisplayModel *dm, int pageNo, TilePo
     }
 }
 
-void RenderCache::AbortCurrentRequest()
+/* Abort all requests currently being rendered for <dm> (or all requests
+   if <dm> is nullptr) and optionally only those of <pageNo> and <tile>. */
+void RenderCache::AbortCurrentRequests(DisplayModel *dm, int pageNo, TilePosition *tile)
 {
     ScopedCritSec scope(&requestAccess);
-    if (!curReq)
-        return;
-    if (curReq->abortCookie)
-        curReq->abortCookie->Abort();
-    curReq->abort = true;
+    for (int i = 0; i < renderThreadCount; i++) {
+        PageRenderRequest *curReq = curReqs[i];
+        if (!curReq)
+            continue;
+        if (dm && (curReq->dm != dm || pageNo != INVALID_PAGE_NO && curReq->pageNo != pageNo ||
+                   tile && !(curReq->tile == *tile)))
+            continue;
+        if (curReq->abortCookie)
+            curReq->abortCookie->Abort();
+        curReq->abort = true;
+    }
+}
+
+// abort rendering tiles that have left the view port while they were being
+// rendered (uses the same criteria as FreeNotVisible for discarding bitmaps)
+void RenderCache::AbortInvisibleRequests(DisplayModel *dm)
+{
+    ScopedCritSec scope(&requestAccess);
+    for (int i = 0; i < renderThreadCount; i++) {
+        PageRenderRequest *curReq = curReqs[i];
+        if (!curReq || curReq->dm != dm || curReq->renderCb || curReq->abort)
+            continue;
+        bool isVisible = dm->PageVisibleNearby(curReq->pageNo);
+        if (isVisible && curReq->tile.res > 1)
+            isVisible = IsTileVisible(dm, curReq->pageNo, curReq->tile, 2.0);
+        if (!isVisible) {
+            if (curReq->abortCookie)
+                curReq->abortCookie->Abort();
+            curReq->abort = true;
+        }
+    }
 }
 
 DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data)
 {
-    RenderCache *cache = (RenderCache *)data;
+    RenderThreadData *threadData = (RenderThreadData *)data;
+    RenderCache *cache = threadData->cache;
+    int threadIdx = threadData->threadIdx;
     PageRenderRequest   req;
     RenderedBitmap *    bmp;
 
     for (;;) {
-        if (cache->ClearCurrentRequest()) {
+        if (cache->ClearCurrentRequest(threadIdx)) {
             DWORD waitResult = WaitForSingleObject(cache->startRendering, INFINITE);
             // Is it not a page render request?
             if (WAIT_OBJECT_0 != waitResult)
                 continue;
         }
 
-        if (!cache->GetNextRequest(&req))
+        if (!cache->GetNextRequest(&req, threadIdx))
             continue;
         if (!req.dm->PageVisibleNearby(req.pageNo) && !req.renderCb)
             continue;
@@ -620,6 +813,13 @@ UINT RenderCache::PaintTile(HDC hdc, RectI bounds, DisplayModel *dm, int pageNo,
     BitmapCacheEntry *entry = Find(dm, pageNo, dm->GetRotation(), dm->GetZoomReal(), &tile);
     UINT renderDelay = 0;
 
+    EnterCriticalSection(&cacheAccess);
+    if (entry)
+        stats.hits++;
+    else
+        stats.misses++;
+    LeaveCriticalSection(&cacheAccess);
+
     if (!entry) {
         if (!isRemoteSession) {
             if (renderedReplacement)
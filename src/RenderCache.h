@@ -5,10 +5,18 @@
 #define RENDER_DELAY_FAILED    ((UINT)-2)
 #define INVALID_TILE_RES       ((USHORT)-1)
 
-#define MAX_PAGE_REQUESTS 8
-// keep this value reasonably low, else we'll run out of
-// GDI resources/memory when caching many larger bitmaps
-#define MAX_BITMAPS_CACHED 64
+#define MAX_PAGE_REQUESTS 32
+// upper limit for the number of threads rendering in parallel
+#define MAX_RENDER_THREADS 4
+// the cache is limited by the memory used for all bitmaps (cf. SetMaxCacheSize);
+// since every cached bitmap holds a GDI handle (and a process gets at most
+// 10000 of them by default, shared with the UI), the number of bitmaps is
+// limited as well (allowing for a few screens' worth of tiles)
+#define MAX_BITMAPS_CACHED 256
+// default value for the amount of memory used for cached bitmaps
+#define DEFAULT_CACHE_SIZE (256 * 1024 * 1024)
+// number of buckets of the cache's hash table (should be a power of 2)
+#define BITMAP_CACHE_BUCKETS 1024
 
 class RenderingCallback {
 public:
@@ -40,14 +48,37 @@ struct BitmapCacheEntry {
 
     // owned by the BitmapCacheEntry
     RenderedBitmap * bitmap;
+    // estimated amount of memory used by bitmap
+    size_t           size;
     bool             outOfDate;
     int              refs;
 
-    BitmapCacheEntry(DisplayModel *dm, int pageNo, int rotation, float zoom, TilePosition tile, RenderedBitmap *bitmap) :
-        dm(dm), pageNo(pageNo), rotation(rotation), zoom(zoom), tile(tile), bitmap(bitmap), outOfDate(false), refs(1) { }
+    // links for RenderCache's hash table and its list
+    // of entries in least recently used order
+    BitmapCacheEntry *nextInBucket;
+    BitmapCacheEntry *lruPrev, *lruNext;
+
+    BitmapCacheEntry(DisplayModel *dm, int pageNo, int rotation, float zoom, TilePosition tile, RenderedBitmap *bitmap, size_t size) :
+        dm(dm), pageNo(pageNo), rotation(rotation), zoom(zoom), tile(tile), bitmap(bitmap), size(size),
+        outOfDate(false), refs(1), nextInBucket(nullptr), lruPrev(nullptr), lruNext(nullptr) { }
     ~BitmapCacheEntry() { delete bitmap; }
 };
 
+// counters for measuring the cache's effectiveness
+struct RenderCacheStats {
+    size_t hits;      // a tile could be painted from the cache
+    size_t misses;    // a tile had to be (re)rendered
+    size_t evictions; // a bitmap was dropped to stay within the memory budget
+};
+
+/* Rendering requests are handled in this order, independent of
+   the order in which they were queued (cf. GetRenderPriority) */
+enum RenderPriority {
+    Priority_Visible,   // tiles intersecting the view port
+    Priority_Prefetch,  // tiles of nearby pages and tiles just outside the view port
+    Priority_Thumbnail, // requests with a RenderingCallback
+};
+
 /* Even though this looks a lot like a BitmapCacheEntry, we keep it
    separate for clarity in the code (PageRenderRequests are reused,
    while BitmapCacheEntries are ref-counted) */
@@ -70,17 +101,32 @@ struct PageRenderRequest {
 class RenderCache
 {
 private:
-    BitmapCacheEntry *  cache[MAX_BITMAPS_CACHED];
+    // all cached bitmaps hashed by dm, pageNo and tile
+    BitmapCacheEntry *  buckets[BITMAP_CACHE_BUCKETS];
+    // all cached bitmaps, least recently used first
+    BitmapCacheEntry *  lruFirst;
+    BitmapCacheEntry *  lruLast;
     int                 cacheCount;
+    size_t              cacheSize;
+    size_t              maxCacheSize;
+    RenderCacheStats    stats;
     // make sure to never ask for requestAccess in a cacheAccess
     // protected critical section in order to avoid deadlocks
     CRITICAL_SECTION    cacheAccess;
 
     PageRenderRequest   requests[MAX_PAGE_REQUESTS];
     int                 requestCount;
-    PageRenderRequest * curReq;
+    // the requests currently being rendered (one per rendering thread)
+    PageRenderRequest * curReqs[MAX_RENDER_THREADS];
     CRITICAL_SECTION    requestAccess;
-    HANDLE              renderThread;
+
+    struct RenderThreadData {
+        RenderCache *   cache;
+        int             threadIdx;
+    };
+    HANDLE              renderThreads[MAX_RENDER_THREADS];
+    RenderThreadData    threadData[MAX_RENDER_THREADS];
+    int                 renderThreadCount;
 
     SizeI               maxTileSize;
     bool                isRemoteSession;
@@ -93,6 +139,8 @@ public:
     ~RenderCache();
 
     void    RequestRendering(DisplayModel *dm, int pageNo);
+    // stops rendering tiles which are no longer needed for the current view port
+    void    AbortInvisibleRequests(DisplayModel *dm);
     void    Render(DisplayModel *dm, int pageNo, int rotation, float zoom,
                    RectD pageRect, RenderingCallback& callback);
     void    CancelRendering(DisplayModel *dm);
@@ -107,12 +155,16 @@ public:
     UINT    Paint(HDC hdc, RectI bounds, DisplayModel *dm, int pageNo,
                   PageInfo *pageInfo, bool *renderOutOfDateCue);
 
+    // limits the amount of memory used for cached bitmaps
+    void    SetMaxCacheSize(size_t maxSize);
+    RenderCacheStats GetStats();
+
 protected:
     /* Interface for page rendering thread */
     HANDLE  startRendering;
 
-    bool    ClearCurrentRequest();
-    bool    GetNextRequest(PageRenderRequest *req);
+    bool    ClearCurrentRequest(int threadIdx);
+    bool    GetNextRequest(PageRenderRequest *req, int threadIdx);
     void    Add(PageRenderRequest &req, RenderedBitmap *bitmap);
 
 private:
@@ -128,13 +180,20 @@ private:
                    RenderingCallback *callback=nullptr);
     void    ClearQueueForDisplayModel(DisplayModel *dm, int pageNo=INVALID_PAGE_NO,
                                       TilePosition *tile=nullptr);
-    void    AbortCurrentRequest();
+    void    AbortCurrentRequests(DisplayModel *dm=nullptr, int pageNo=INVALID_PAGE_NO,
+                                 TilePosition *tile=nullptr);
+    RenderPriority GetRenderPriority(PageRenderRequest *req);
 
     static DWORD WINAPI RenderCacheThread(LPVOID data);
 
     BitmapCacheEntry *  Find(DisplayModel *dm, int pageNo, int rotation,
                              float zoom=INVALID_ZOOM, TilePosition *tile=nullptr);
     void    DropCacheEntry(BitmapCacheEntry *entry);
+    void    InsertEntry(BitmapCacheEntry *entry);
+    void    RemoveEntry(BitmapCacheEntry *entry);
+    void    HashEntry(BitmapCacheEntry *entry);
+    void    UnhashEntry(BitmapCacheEntry *entry);
+    void    MakeRoomFor(DisplayModel *dm, size_t size);
     void    FreePage(DisplayModel *dm=nullptr, int pageNo=-1, TilePosition *tile=nullptr);
     void    FreeNotVisible() { FreePage(); }
 
@@ -188,6 +188,14 @@ static void UpdateFindStatusTask(WindowInfo *win, NotificationWnd *wnd, int curr
     }
 }
 
+static void EnableFindButtons(WindowInfo *win, bool enable)
+{
+    LPARAM state = (LPARAM)MAKELONG(enable ? 1 : 0, 0);
+    SendMessage(win->hwndToolbar, TB_ENABLEBUTTON, IDM_FIND_PREV, state);
+    SendMessage(win->hwndToolbar, TB_ENABLEBUTTON, IDM_FIND_NEXT, state);
+    SendMessage(win->hwndToolbar, TB_ENABLEBUTTON, IDM_FIND_MATCH, state);
+}
+
 struct FindThreadData : public ProgressUpdateUI {
     WindowInfo *win;
     TextSearchDirection direction;
@@ -204,25 +212,17 @@ struct FindThreadData : public ProgressUpdateUI {
     ~FindThreadData() { CloseHandle(thread); }
 
     void ShowUI(bool showProgress) {
-        const LPARAM disable = (LPARAM)MAKELONG(0, 0);
-
         if (showProgress) {
             wnd = new NotificationWnd(win->hwndCanvas, L"",
                                       _TR("Searching %d of %d..."), win->notifications);
             win->notifications->Add(wnd, NG_FIND_PROGRESS);
         }
 
-        SendMessage(win->hwndToolbar, TB_ENABLEBUTTON, IDM_FIND_PREV, disable);
-        SendMessage(win->hwndToolbar, TB_ENABLEBUTTON, IDM_FIND_NEXT, disable);
-        SendMessage(win->hwndToolbar, TB_ENABLEBUTTON, IDM_FIND_MATCH, disable);
+        EnableFindButtons(win, false);
     }
 
     void HideUI(bool success, bool loopedAround) {
-        LPARAM enable = (LPARAM)MAKELONG(1, 0);
-
-        SendMessage(win->hwndToolbar, TB_ENABLEBUTTON, IDM_FIND_PREV, enable);
-        SendMessage(win->hwndToolbar, TB_ENABLEBUTTON, IDM_FIND_NEXT, enable);
-        SendMessage(win->hwndToolbar, TB_ENABLEBUTTON, IDM_FIND_MATCH, enable);
+        EnableFindButtons(win, true);
 
         if (!win->notifications->Contains(wnd))
             /* our notification has been replaced or closed (or never created) */;
@@ -327,6 +327,244 @@ static DWORD WINAPI FindThread(LPVOID data)
     return 0;
 }
 
+#define MAX_FIND_ALL_THREADS 8
+
+// "find all" searches all pages on several threads at once and hands the
+// matches over to the UI in page order as soon as all preceding pages have
+// been searched
+struct FindAllThreadData {
+    WindowInfo *win;
+    DisplayModel *dm;
+    // dm might already have been deleted when this is deleted
+    int pageCount;
+    ScopedMem<WCHAR> text;
+    bool caseSensitive;
+    // PdfEngine and XpsEngine interpret pages while holding their document's
+    // lock, so each worker thread extracts text from its own engine clone
+    bool cloneEngine;
+    // owned by win->notifications
+    NotificationWnd *wnd;
+    HANDLE thread;
+
+    CRITICAL_SECTION access;
+    // the last page handed out to a worker thread
+    LONG lastPage;
+    // the first page whose matches haven't been handed to the UI yet
+    int nextReportPage;
+    // matches per page (-1 for pages not yet searched)
+    int *pageMatches;
+    Vec<RectI> **pageRects;
+
+    FindAllThreadData(WindowInfo *win, WCHAR *text, bool caseSensitive) :
+        win(win), dm(win->AsFixed()), pageCount(dm->PageCount()), text(text), caseSensitive(caseSensitive),
+        cloneEngine(Engine_PDF == dm->engineType || Engine_XPS == dm->engineType),
+        wnd(nullptr), thread(nullptr), lastPage(0), nextReportPage(1) {
+        InitializeCriticalSection(&access);
+        pageMatches = AllocArray<int>(pageCount);
+        pageRects = AllocArray<Vec<RectI> *>(pageCount);
+        for (int i = 0; i < pageCount; i++) {
+            pageMatches[i] = -1;
+        }
+    }
+    ~FindAllThreadData() {
+        for (int i = 0; i < pageCount; i++) {
+            delete pageRects[i];
+        }
+        free(pageRects);
+        free(pageMatches);
+        DeleteCriticalSection(&access);
+        CloseHandle(thread);
+    }
+
+    bool WasCanceled() {
+        return !WindowInfoStillValid(win) || win->findCanceled;
+    }
+
+    void PageDone(int pageNo, Vec<RectI> *rects, int matches);
+};
+
+// matches for a range of pages, to be added to win->findAllMarks
+struct FindAllBatch {
+    Vec<int> pages;
+    Vec<RectI> rects;
+    int matches;
+    int lastPage;
+
+    FindAllBatch() : matches(0), lastPage(0) { }
+};
+
+static void FindAllBatchTask(FindAllThreadData *fatd, FindAllBatch *batch)
+{
+    ScopedPtr<FindAllBatch> scope(batch);
+    WindowInfo *win = fatd->win;
+    if (!WindowInfoStillValid(win) || win->findAllMarks.search != fatd || win->AsFixed() != fatd->dm)
+        return;
+
+    bool isFirstMatch = 0 == win->findAllMarks.rects.Count() && batch->rects.Count() > 0;
+    win->findAllMarks.pages.Append(batch->pages.LendData(), batch->pages.Count());
+    win->findAllMarks.rects.Append(batch->rects.LendData(), batch->rects.Count());
+    win->findAllMarks.matches += batch->matches;
+
+    if (fatd->wnd)
+        UpdateFindStatusTask(win, fatd->wnd, batch->lastPage, fatd->pageCount);
+
+    // show the first match as soon as it's been found
+    if (isFirstMatch) {
+        int pageNo = batch->pages.At(0);
+        TextSel sel = { 1, &pageNo, &batch->rects.At(0) };
+        if (!fatd->dm->PageShown(pageNo))
+            win->ctrl->GoToPage(pageNo, true);
+        fatd->dm->ShowResultRectToScreen(&sel);
+    }
+    win->RepaintAsync();
+}
+
+void FindAllThreadData::PageDone(int pageNo, Vec<RectI> *rects, int matches)
+{
+    ScopedCritSec scope(&access);
+    pageRects[pageNo - 1] = rects;
+    pageMatches[pageNo - 1] = matches;
+    if (pageNo != nextReportPage)
+        return;
+
+    FindAllBatch *batch = new FindAllBatch();
+    for (; nextReportPage <= pageCount && pageMatches[nextReportPage - 1] >= 0; nextReportPage++) {
+        Vec<RectI> *pr = pageRects[nextReportPage - 1];
+        for (size_t i = 0; i < pr->Count(); i++) {
+            batch->pages.Append(nextReportPage);
+            batch->rects.Append(pr->At(i));
+        }
+        batch->matches += pageMatches[nextReportPage - 1];
+        delete pr;
+        pageRects[nextReportPage - 1] = nullptr;
+    }
+    batch->lastPage = nextReportPage - 1;
+
+    FindAllThreadData *fatd = this;
+    uitask::Post([=] {
+        FindAllBatchTask(fatd, batch);
+    });
+}
+
+static void FindAllInPages(FindAllThreadData *fatd, BaseEngine *engine, PageTextCache *textCache)
+{
+    TextSearch search(engine, textCache);
+    search.SetSensitive(fatd->caseSensitive);
+
+    for (;;) {
+        int pageNo = (int)InterlockedIncrement(&fatd->lastPage);
+        if (pageNo > fatd->pageCount || fatd->WasCanceled())
+            break;
+        Vec<RectI> *rects = new Vec<RectI>();
+        int matches = search.FindAllInPage(pageNo, fatd->text, *rects);
+        fatd->PageDone(pageNo, rects, matches);
+    }
+}
+
+static DWORD WINAPI FindAllWorker(LPVOID data)
+{
+    FindAllThreadData *fatd = (FindAllThreadData *)data;
+    DisplayModel *dm = fatd->dm;
+    // the search state is always per thread; the text is cached per engine
+    BaseEngine *clone = fatd->cloneEngine ? dm->GetEngine()->Clone() : nullptr;
+    if (clone) {
+        PageTextCache textCache(clone);
+        FindAllInPages(fatd, clone, &textCache);
+    }
+    else {
+        FindAllInPages(fatd, dm->GetEngine(), dm->textCache);
+    }
+    delete clone;
+
+    return 0;
+}
+
+static void FindAllEndTask(FindAllThreadData *fatd)
+{
+    WindowInfo *win = fatd->win;
+    if (!WindowInfoStillValid(win) || win->findThread != fatd->thread) {
+        // see FindEndTask
+        delete fatd;
+        return;
+    }
+
+    if (win->IsDocLoaded())
+        EnableFindButtons(win, true);
+    if (!win->notifications->Contains(fatd->wnd))
+        /* our notification has been replaced or closed */;
+    else if (win->findAllMarks.search != fatd) // i.e. canceled
+        win->notifications->RemoveNotification(fatd->wnd);
+    else if (0 == win->findAllMarks.matches)
+        fatd->wnd->UpdateMessage(_TR("No matches were found"), 3000);
+    else {
+        ScopedMem<WCHAR> buf(str::Format(_TR("Found %d matches"), win->findAllMarks.matches));
+        fatd->wnd->UpdateMessage(buf, 3000);
+    }
+    if (win->findAllMarks.search == fatd)
+        win->findAllMarks.search = nullptr;
+
+    win->findThread = nullptr;
+    delete fatd;
+}
+
+static DWORD WINAPI FindAllThread(LPVOID data)
+{
+    FindAllThreadData *fatd = (FindAllThreadData *)data;
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int threadCount = limitValue((int)si.dwNumberOfProcessors, 1, std::min(fatd->pageCount, MAX_FIND_ALL_THREADS));
+
+    HANDLE workers[MAX_FIND_ALL_THREADS];
+    DWORD workerCount = 0;
+    for (int i = 0; i < threadCount; i++) {
+        HANDLE worker = CreateThread(nullptr, 0, FindAllWorker, fatd, 0, 0);
+        if (worker)
+            workers[workerCount++] = worker;
+    }
+    if (workerCount > 0)
+        WaitForMultipleObjects(workerCount, workers, TRUE, INFINITE);
+    else
+        FindAllWorker(fatd);
+    for (DWORD i = 0; i < workerCount; i++) {
+        CloseHandle(workers[i]);
+    }
+
+    uitask::Post([=] {
+        FindAllEndTask(fatd);
+    });
+
+    return 0;
+}
+
+void OnMenuFindAll(WindowInfo *win)
+{
+    if (!win->IsDocLoaded() || !NeedsFindUI(win))
+        return;
+
+    AbortFinding(win, true);
+
+    ScopedMem<WCHAR> text(win::GetText(win->hwndFindBox));
+    if (str::IsEmpty(text.Get()))
+        return;
+    WORD state = (WORD)SendMessage(win->hwndToolbar, TB_GETSTATE, IDM_FIND_MATCH, 0);
+    bool matchCase = (state & TBSTATE_CHECKED) != 0;
+
+    FindAllThreadData *fatd = new FindAllThreadData(win, text.StealData(), matchCase);
+    Edit_SetModify(win->hwndFindBox, FALSE);
+    win->findAllMarks.search = fatd;
+    win->findAllMarks.dm = win->AsFixed();
+
+    fatd->wnd = new NotificationWnd(win->hwndCanvas, L"", _TR("Searching %d of %d..."), win->notifications);
+    win->notifications->Add(fatd->wnd, NG_FIND_PROGRESS);
+    EnableFindButtons(win, false);
+
+    // the thread only starts once FindAllEndTask can identify it
+    win->findThread = CreateThread(nullptr, 0, FindAllThread, fatd, CREATE_SUSPENDED, 0);
+    fatd->thread = win->findThread;
+    ResumeThread(win->findThread);
+}
+
 void AbortFinding(WindowInfo *win, bool hideMessage)
 {
     if (win->findThread) {
@@ -337,6 +575,15 @@ void AbortFinding(WindowInfo *win, bool hideMessage)
 
     if (hideMessage)
         win->notifications->RemoveForGroup(NG_FIND_PROGRESS);
+
+    if (win->findAllMarks.search || win->findAllMarks.rects.Count() > 0) {
+        win->findAllMarks.search = nullptr;
+        win->findAllMarks.dm = nullptr;
+        win->findAllMarks.pages.Reset();
+        win->findAllMarks.rects.Reset();
+        win->findAllMarks.matches = 0;
+        win->RepaintAsync();
+    }
 }
 
 void FindTextOnThread(WindowInfo* win, TextSearchDirection direction, bool showProgress)
@@ -383,6 +630,42 @@ void PaintForwardSearchMark(WindowInfo *win, HDC hdc)
     PaintTransparentRectangles(hdc, win->canvasRc, rects, gGlobalPrefs->forwardSearch.highlightColor, alpha, 0);
 }
 
+void PaintFindAllMarks(WindowInfo *win, HDC hdc)
+{
+    CrashIf(!win->AsFixed());
+    DisplayModel *dm = win->AsFixed();
+    if (dm != win->findAllMarks.dm)
+        return;
+
+    int firstPage = dm->FirstVisiblePageNo();
+    if (INVALID_PAGE_NO == firstPage)
+        return;
+
+    // matches are added in page order (and visible pages are consecutive),
+    // so only the visible pages' matches have to be looked at
+    Vec<int>& pages = win->findAllMarks.pages;
+    size_t lo = 0, hi = pages.Count();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (pages.At(mid) < firstPage)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    Vec<RectI> rects;
+    for (size_t i = lo; i < pages.Count(); i++) {
+        int pageNo = pages.At(i);
+        PageInfo *pageInfo = dm->GetPageInfo(pageNo);
+        if (!pageInfo || 0.0 == pageInfo->visibleRatio)
+            break;
+        RectI rect = win->findAllMarks.rects.At(i);
+        rects.Append(dm->CvtToScreen(pageNo, rect.Convert<double>()));
+    }
+
+    PaintTransparentRectangles(hdc, win->canvasRc, rects, gGlobalPrefs->fixedPageUI.selectionColor);
+}
+
 // returns true if the double-click was handled and false if it wasn't
 bool OnInverseSearch(WindowInfo *win, int x, int y)
 {
@@ -50,10 +50,12 @@ void ClearSearchResult(WindowInfo *win);
 bool OnInverseSearch(WindowInfo *win, int x, int y);
 void ShowForwardSearchResult(WindowInfo *win, const WCHAR *fileName, UINT line, UINT col, UINT ret, UINT page, Vec<RectI> &rects);
 void PaintForwardSearchMark(WindowInfo *win, HDC hdc);
+void PaintFindAllMarks(WindowInfo *win, HDC hdc);
 void OnMenuFindPrev(WindowInfo *win);
 void OnMenuFindNext(WindowInfo *win);
 void OnMenuFind(WindowInfo *win);
 void OnMenuFindMatchCase(WindowInfo *win);
 void OnMenuFindSel(WindowInfo *win, TextSearchDirection direction);
+void OnMenuFindAll(WindowInfo *win);
 void AbortFinding(WindowInfo *win, bool hideMessage);
 void FindTextOnThread(WindowInfo* win, TextSearchDirection direction, bool showProgress);
@@ -40,7 +40,7 @@ Vec<SelectionOnPage> *SelectionOnPage::FromRectangle(DisplayModel *dm, RectI rec
 {
     Vec<SelectionOnPage> *sel = new Vec<SelectionOnPage>();
 
-    for (int pageNo = dm->GetEngine()->PageCount(); pageNo >= 1; --pageNo) {
+    for (int pageNo = dm->PageCount(); pageNo >= 1; --pageNo) {
         PageInfo *pageInfo = dm->GetPageInfo(pageNo);
         assert(!pageInfo || 0.0 == pageInfo->visibleRatio || pageInfo->shown);
         if (!pageInfo || !pageInfo->shown)
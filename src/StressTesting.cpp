@@ -85,12 +85,11 @@ static void BenchLoadRender(BaseEngine *engine, int pagenum)
     logbench(L"pagerender %3d: %.2f ms", pagenum, timeMs);
 }
 
-static int FormatWholeDoc(Doc& doc) {
-    int PAGE_DX = 640;
+static int FormatWholeDoc(Doc& doc, int pageDx=640) {
     int PAGE_DY = 520;
 
     PoolAllocator textAllocator;
-    HtmlFormatterArgs *formatterArgs = CreateFormatterArgsDoc(doc, PAGE_DX, PAGE_DY, &textAllocator);
+    HtmlFormatterArgs *formatterArgs = CreateFormatterArgsDoc(doc, pageDx, PAGE_DY, &textAllocator);
 
     HtmlFormatter *formatter = doc.CreateFormatter(formatterArgs);
     int nPages = 0;
@@ -109,6 +108,16 @@ static int TimeOneMethod(Doc&doc, TextRenderMethod method, const WCHAR *methodNa
     int nPages = FormatWholeDoc(doc);
     double timesms = t.Stop();
     logbench(L"%s: %.2f ms", methodName, timesms);
+
+    // layouting again at a different width should mostly hit the measurement cache
+    TextMeasureStats before = GetTextMeasureStats();
+    t.Start();
+    FormatWholeDoc(doc, 480);
+    timesms = t.Stop();
+    TextMeasureStats after = GetTextMeasureStats();
+    size_t hits = after.hits - before.hits, misses = after.misses - before.misses;
+    logbench(L"%s relayout: %.2f ms, %d%% cached measurements", methodName, timesms,
+             hits + misses > 0 ? (int)(hits * 100 / (hits + misses)) : 0);
     return nPages;
 }
 
@@ -590,6 +599,10 @@ void StressTest::Finished(bool success)
         ScopedMem<WCHAR> tm(FormatTime(secs));
         ScopedMem<WCHAR> s(str::Format(L"Stress test complete, rendered %d files in %s", filesCount, tm));
         win->ShowNotification(s, NOS_PERSIST, NG_STRESS_TEST_SUMMARY);
+        RenderCacheStats stats = gRenderCache.GetStats();
+        wprintf(L"render cache: %d hits, %d misses, %d evictions\n",
+                (int)stats.hits, (int)stats.misses, (int)stats.evictions);
+        fflush(stdout);
     }
 
     CloseWindow(win, exitWhenDone && MayCloseWindow(win));
@@ -652,8 +652,10 @@ public:
     virtual void PageNoChanged(Controller *ctrl, int pageNo);
     virtual void UpdateScrollbars(SizeI canvas);
     virtual void RequestRendering(int pageNo);
+    virtual void AbortInvisibleRendering(DisplayModel *dm) { gRenderCache.AbortInvisibleRequests(dm); }
     virtual void CleanUp(DisplayModel *dm);
     virtual void RenderThumbnail(DisplayModel *dm, SizeI size, const std::function<void(RenderedBitmap*)>&);
+    virtual void PageCountChanged(DisplayModel *dm);
     virtual void GotoLink(PageDestination *dest) { win->linkHandler->GotoLink(dest); }
     virtual void FocusFrame(bool always);
     virtual void SaveDownload(const WCHAR *url, const unsigned char *data, size_t len);
@@ -752,6 +754,30 @@ void ControllerCallbackHandler::HandleLayoutedPages(EbookController *ctrl, Ebook
     });
 }
 
+void ControllerCallbackHandler::PageCountChanged(DisplayModel *dm)
+{
+    uitask::Post([=]{
+        WindowInfo *win = FindWindowInfoByController(dm);
+        if (!win)
+            return;
+        // search results and selections might refer to pages which no longer exist
+        if (win->ctrl == dm || win->findAllMarks.dm == dm)
+            AbortFinding(win, true);
+        if (win->ctrl == dm)
+            DeleteOldSelectionInfo(win, true);
+        TabInfo *tab = win->tabs.FindEl([&](TabInfo *tab) { return tab->ctrl == dm; });
+        if (tab) {
+            delete tab->selectionOnPage;
+            tab->selectionOnPage = nullptr;
+        }
+        dm->UpdatePageCount();
+        if (win->ctrl == dm) {
+            UpdateToolbarPageText(win, dm->PageCount(), true);
+            ToolbarUpdateStateForWindow(win, false);
+        }
+    });
+}
+
 void ControllerCallbackHandler::RequestDelayedLayout(int delay)
 {
     SetTimer(win->hwndCanvas, EBOOK_LAYOUT_TIMER_ID, delay, nullptr);
@@ -853,6 +879,10 @@ static Controller *CreateControllerForFile(const WCHAR *filePath, PasswordUI *pw
 LoadEngineInFixedPageUI:
         ctrl = new DisplayModel(engine, engineType, win->cbHandler);
         CrashIf(!ctrl || !ctrl->AsFixed() || ctrl->AsChm() || ctrl->AsEbook());
+        if (gGlobalPrefs->cacheExtractedText && !gPluginMode) {
+            ScopedMem<WCHAR> cachePath(GetTextCachePath(filePath));
+            ctrl->AsFixed()->textCache->EnableDiskCache(cachePath);
+        }
     }
     else if (ChmModel::IsSupportedFile(filePath) && !gGlobalPrefs->chmUI.useFixedPageUI) {
         ChmModel *chmModel = ChmModel::Create(filePath, win->cbHandler);
@@ -3411,6 +3441,8 @@ static void FrameOnChar(WindowInfo& win, WPARAM key, LPARAM info=0)
             win.notifications->RemoveForGroup(NG_CURSOR_POS_HELPER);
         else if (win.showSelection)
             ClearSearchResult(&win);
+        else if (win.findAllMarks.rects.Count() > 0)
+            AbortFinding(&win, true);
         else if (gGlobalPrefs->escToExit && MayCloseWindow(&win))
             CloseWindow(&win, true);
         else if (win.presentation || win.isFullScreen)
@@ -3941,6 +3973,10 @@ static LRESULT FrameOnCommand(WindowInfo *win, HWND hwnd, UINT msg, WPARAM wPara
             OnMenuFindSel(win, FIND_BACKWARD);
             break;
 
+        case IDM_FIND_ALL:
+            OnMenuFindAll(win);
+            break;
+
         case IDM_VISIT_WEBSITE:
             LaunchBrowser(WEBSITE_MAIN_URL);
             break;
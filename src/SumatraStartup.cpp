@@ -4,6 +4,7 @@
 // utils
 #include "BaseUtil.h"
 #include "WinDynCalls.h"
+#include "ArchUtil.h"
 #include "CmdLineParser.h"
 #include "DbgHelpDyn.h"
 #include "Dpi.h"
@@ -687,6 +688,7 @@ int APIENTRY WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
     gCrashOnOpen = i.crashOnOpen;
 
     GetFixedPageUiColors(gRenderCache.textColor, gRenderCache.backgroundColor);
+    gRenderCache.SetMaxCacheSize((size_t)std::max(gGlobalPrefs->renderCacheSize, 0) * 1024 * 1024);
 
     if (!RegisterWinClass())
         goto Exit;
@@ -699,6 +701,9 @@ int APIENTRY WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
         if (!SetupPluginMode(i))
             goto Exit;
     }
+    // the plugin only ever opens temporary files
+    if (!gPluginMode && HasPermission(Perm_SavePreferences | Perm_DiskAccess))
+        SetArchiveIndexCachePathFn(GetArchiveIndexCachePath);
 
     if (i.printerName) {
         // note: this prints all PDF files. Another option would be to
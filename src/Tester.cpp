@@ -5,6 +5,10 @@
    executable and related makefile additions for each test, we have one test
    driver which dispatches desired test based on cmd-line arguments. */
 
+extern "C" {
+#include <mupdf/fitz.h>
+}
+
 // utils
 #include "BaseUtil.h"
 #include "CmdLineParser.h"
@@ -15,6 +19,7 @@
 #include "HtmlParserLookup.h"
 #include "HtmlPrettyPrint.h"
 #include "Mui.h"
+#include "ArchUtil.h"
 #include "Timer.h"
 #include "WinUtil.h"
 #include "ZipUtil.h"
@@ -24,6 +29,11 @@
 #include "MobiDoc.h"
 #include "HtmlFormatter.h"
 #include "EbookFormatter.h"
+#include "ImagesEngine.h"
+// ui
+#include "SettingsStructs.h"
+#include "FileHistory.h"
+#include "FileThumbnails.h"
 
 // if true, we'll save html content of a mobi ebook as well
 // as pretty-printed html to MOBI_SAVE_DIR. The name will be
@@ -47,6 +57,11 @@ static int Usage()
     printf("  -save-images - will save images extracted from mobi files\n");
     printf("  -zip-create - creates a sample zip file that needs to be manually checked that it worked\n");
     printf("  -bench-md5 - compare Window's md5 vs. our code\n");
+    printf("  -arcidx-test rarFile - check that a cached archive listing survives a restart\n");
+    printf("  -bench-cbx [pageCount] - open a comic book with many (by default 100000) pages and verify their order\n");
+    printf("  -bench-huffdic dirOrFile - compare table-driven vs. bit-by-bit HuffDic decompression\n");
+    printf("  -bench-paint [iterations] - compare fitz' SIMD span painters against the plain C ones\n");
+    printf("  -bench-scale - compare SIMD and multi-threaded image scaling on a 600 dpi scan\n");
     system("pause");
     return 1;
 }
@@ -225,6 +240,280 @@ static void MobiTest(WCHAR *dirOrFile)
         MobiTestDir(dirOrFile);
 }
 
+static void BenchHuffDicFile(const WCHAR *filePath)
+{
+    double fastMs, referenceMs;
+    bool sameResult;
+    if (!MobiDoc::BenchHuffDic(filePath, fastMs, referenceMs, sameResult))
+        return;
+    wprintf(L"%s\n  table-driven: %.2f ms\n  bit-by-bit  : %.2f ms\n", filePath, fastMs, referenceMs);
+    if (!sameResult)
+        printf("  error: decompressed text differs\n");
+}
+
+// decompression of HuffDic compressed files (most Kindle books)
+static void BenchHuffDic(WCHAR *dirOrFile)
+{
+    if (file::Exists(dirOrFile) && IsMobiFile(dirOrFile)) {
+        BenchHuffDicFile(dirOrFile);
+        return;
+    }
+    DirIter di(dirOrFile, true);
+    for (const WCHAR *p = di.First(); p; p = di.Next()) {
+        if (IsMobiFile(p))
+            BenchHuffDicFile(p);
+    }
+}
+
+#define TAR_BLOCK_SIZE 512
+
+// creates an in-memory .cbt file with pageCount tiny pages stored in random order
+// (every tenth page name twice) and measures how long it takes to open it (which
+// includes sorting the pages). Each page is a bare BMP header whose width is the
+// page's number and whose height is its position in the archive, so that the
+// resulting page order can be verified through the pages' mediaboxes.
+static void BenchCbxPageOrder(int pageCount)
+{
+    Vec<int> pageNos;
+    for (int i = 1; i <= pageCount; i++) {
+        pageNos.Append(i);
+        if (i % 10 == 0)
+            pageNos.Append(i);
+    }
+    int fileCount = (int)pageNos.Count();
+    srand(pageCount);
+    for (int i = fileCount - 1; i > 0; i--) {
+        int j = ((rand() << 15) | rand()) % (i + 1);
+        std::swap(pageNos.At(i), pageNos.At(j));
+    }
+
+    str::Str<char> tar;
+    for (int i = 0; i < fileCount; i++) {
+        BITMAPFILEHEADER bmf = { 0 };
+        BITMAPINFOHEADER bmi = { 0 };
+        bmf.bfType = 0x4D42; // "BM"
+        bmf.bfSize = sizeof(bmf) + sizeof(bmi);
+        bmf.bfOffBits = sizeof(bmf) + sizeof(bmi);
+        bmi.biSize = sizeof(bmi);
+        bmi.biWidth = pageNos.At(i);
+        bmi.biHeight = i + 1;
+        bmi.biPlanes = 1;
+        bmi.biBitCount = 24;
+
+        char *header = tar.AppendBlanks(TAR_BLOCK_SIZE);
+        ScopedMem<char> name(str::Format("scan/page%d.bmp", pageNos.At(i)));
+        str::BufSet(header, 100, name);
+        memcpy(header + 100, "0000644", 7);
+        ScopedMem<char> sizeStr(str::Format("%011o", (unsigned int)bmf.bfSize));
+        memcpy(header + 124, sizeStr, 11);
+        memcpy(header + 136, "00000000000", 11);
+        header[156] = '0';
+        memset(header + 148, ' ', 8);
+        unsigned int checksum = 0;
+        for (int k = 0; k < TAR_BLOCK_SIZE; k++) {
+            checksum += (unsigned char)header[k];
+        }
+        ScopedMem<char> checksumStr(str::Format("%06o", checksum));
+        str::BufSet(header + 148, 8, checksumStr);
+
+        char *data = tar.AppendBlanks(TAR_BLOCK_SIZE);
+        memcpy(data, &bmf, sizeof(bmf));
+        memcpy(data + sizeof(bmf), &bmi, sizeof(bmi));
+    }
+    tar.AppendBlanks(2 * TAR_BLOCK_SIZE);
+
+    ScopedComPtr<IStream> stream(CreateStreamFromData(tar.Get(), tar.Size()));
+    if (!stream) {
+        printf("BenchCbxPageOrder(): failed to create stream\n");
+        return;
+    }
+    Timer t;
+    BaseEngine *engine = CbxEngine::CreateFromStream(stream);
+    double ms = t.Stop();
+    if (!engine || engine->PageCount() != fileCount) {
+        printf("BenchCbxPageOrder(): expected %d pages, got %d\n", fileCount, engine ? engine->PageCount() : 0);
+        delete engine;
+        return;
+    }
+
+    // pages must be sorted by number (not alphabetically) and
+    // pages with the same name must remain in archive order
+    int expectedPageNo = 1;
+    bool isDuplicate = false;
+    RectD prev;
+    for (int pageNo = 1; pageNo <= fileCount; pageNo++) {
+        RectD mbox = engine->PageMediabox(pageNo);
+        if ((int)mbox.dx != expectedPageNo || isDuplicate && mbox.dy <= prev.dy) {
+            printf("BenchCbxPageOrder(): page %d is page%d.bmp (archive file %d), expected page%d.bmp\n",
+                   pageNo, (int)mbox.dx, (int)mbox.dy, expectedPageNo);
+            delete engine;
+            return;
+        }
+        prev = mbox;
+        if (expectedPageNo % 10 == 0 && !isDuplicate) {
+            isDuplicate = true;
+        }
+        else {
+            isDuplicate = false;
+            expectedPageNo++;
+        }
+    }
+    printf("opened comic book with %d pages in %.2f ms\n", fileCount, ms);
+    delete engine;
+}
+
+// favor fully transparent and fully opaque values, as the span painters special-case them
+static unsigned char RandomPaintByte()
+{
+    switch (rand() % 4) {
+    case 0:
+        return 0;
+    case 1:
+        return 255;
+    default:
+        return (unsigned char)rand();
+    }
+}
+
+// The SIMD versions of fitz' span painters must produce exactly the same
+// pixels as the plain C versions. Compare them on random spans of varying
+// widths and (unaligned) offsets and then measure how long each version
+// takes to paint a 1024 pixel span iterations times.
+static void BenchPaintKernels(int iterations)
+{
+    const int maxWidth = 1024, maxOffset = 16;
+    const size_t size = (maxWidth + maxOffset) * 4;
+    ScopedMem<unsigned char> src(AllocArray<unsigned char>(size));
+    ScopedMem<unsigned char> mask(AllocArray<unsigned char>(size));
+    ScopedMem<unsigned char> dstInit(AllocArray<unsigned char>(size));
+    ScopedMem<unsigned char> dstRef(AllocArray<unsigned char>(size));
+    ScopedMem<unsigned char> dst(AllocArray<unsigned char>(size));
+    unsigned char color[4];
+
+    int simdLevel = fz_paint_simd_level();
+    printf("SIMD level: %d (0 = plain C, 1 = SSE2, 2 = AVX2)\n", simdLevel);
+    int count;
+    const fz_paint_kernel *kernels = fz_paint_kernels(&count);
+
+    srand(iterations);
+    for (int k = 0; k < count; k++) {
+        for (int n = 2; n <= 4; n += 2) {
+            int mismatches = 0;
+            for (int round = 0; round < 10000; round++) {
+                int w = rand() % 130, offset = rand() % maxOffset, alpha = rand() % 256;
+                for (size_t i = 0; i < size; i++) {
+                    src[i] = RandomPaintByte();
+                    dstInit[i] = RandomPaintByte();
+                    // also cover spans with uniformly empty or full masks
+                    mask[i] = round % 3 == 0 ? 0 : round % 3 == 1 ? 255 : RandomPaintByte();
+                }
+                for (int i = 0; i < n; i++) {
+                    color[i] = RandomPaintByte();
+                }
+                memcpy(dstRef, dstInit, size);
+                kernels[k].paint(dstRef + offset, src + offset, mask + offset, n, w, color, alpha, 0);
+                for (int simd = 1; simd <= simdLevel; simd++) {
+                    memcpy(dst, dstInit, size);
+                    kernels[k].paint(dst + offset, src + offset, mask + offset, n, w, color, alpha, simd);
+                    if (!memeq(dst, dstRef, size))
+                        mismatches++;
+                }
+            }
+            if (mismatches > 0)
+                printf("%s (n=%d): %d mismatches against plain C\n", kernels[k].name, n, mismatches);
+
+            for (size_t i = 0; i < size; i++) {
+                src[i] = (unsigned char)rand();
+                mask[i] = (unsigned char)rand();
+                dst[i] = (unsigned char)rand();
+            }
+            memcpy(color, "\x40\x80\xC0\xC8", 4);
+            double plainMs = 0;
+            for (int simd = 0; simd <= simdLevel; simd++) {
+                Timer t;
+                for (int i = 0; i < iterations; i++) {
+                    kernels[k].paint(dst, src, mask, n, maxWidth, color, 128, simd);
+                }
+                double ms = t.Stop();
+                if (0 == simd)
+                    plainMs = ms;
+                printf("%-16s n=%d %-7s: %8.2f ms (%.2fx)\n", kernels[k].name, n,
+                       0 == simd ? "plain C" : 1 == simd ? "SSE2" : "AVX2", ms, ms > 0 ? plainMs / ms : 0);
+            }
+        }
+    }
+}
+
+// Scales a synthetic 600 dpi letter-sized scan (5100 x 6600 pixels) to the
+// sizes of typical zoom levels, once the way fitz used to (plain C on a single
+// thread) and then with SIMD and/or multiple threads, verifying that all
+// results are identical.
+static void BenchScalePixmap()
+{
+    fz_context *ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    if (!ctx)
+        return;
+    const float zoomLevels[] = { 0.1f, 0.25f, 0.5f, 0.9f };
+    const struct {
+        int simd, maxBands;
+        const char *desc;
+    } variants[] = {
+        { 0, 1, "plain C" }, { 1, 1, "SSE2" }, { 0, 0, "threads" }, { 1, 0, "SSE2 + threads" },
+    };
+    fz_colorspace *colorspaces[] = { fz_device_gray(ctx), fz_device_rgb(ctx) };
+
+    for (fz_colorspace *cs : colorspaces) {
+        fz_pixmap *src = nullptr;
+        fz_try(ctx) {
+            src = fz_new_pixmap(ctx, cs, 5100, 6600);
+        }
+        fz_catch(ctx) {
+            printf("BenchScalePixmap(): failed to allocate the source image\n");
+            continue;
+        }
+        // something between a smooth gradient and noise
+        unsigned char *samples = fz_pixmap_samples(ctx, src);
+        size_t size = (size_t)src->w * src->h * src->n;
+        for (size_t i = 0; i < size; i++) {
+            samples[i] = (i + 1) % src->n == 0 ? 255 : (unsigned char)((i / 97) ^ (rand() & 0x0F));
+        }
+
+        for (float zoom : zoomLevels) {
+            float w = src->w * zoom, h = src->h * zoom;
+            fz_pixmap *reference = nullptr;
+            double referenceMs = 0;
+            for (size_t i = 0; i < dimof(variants); i++) {
+                fz_pixmap *dst = nullptr;
+                Timer t;
+                fz_try(ctx) {
+                    dst = fz_scale_pixmap_tuned(ctx, src, 0, 0, w, h, nullptr, nullptr, nullptr, variants[i].simd, variants[i].maxBands);
+                }
+                fz_catch(ctx) {
+                    dst = nullptr;
+                }
+                double ms = t.Stop();
+                if (!dst) {
+                    printf("%s at %g%%: failed\n", variants[i].desc, zoom * 100);
+                    continue;
+                }
+                if (!reference) {
+                    reference = dst;
+                    referenceMs = ms;
+                }
+                bool same = dst->w == reference->w && dst->h == reference->h &&
+                            memeq(dst->samples, reference->samples, (size_t)dst->w * dst->h * dst->n);
+                printf("n=%d %3g%% %-15s: %8.2f ms (%.2fx)%s\n", src->n, zoom * 100, variants[i].desc, ms,
+                       ms > 0 ? referenceMs / ms : 0, same ? "" : " - DIFFERENT RESULT");
+                if (dst != reference)
+                    fz_drop_pixmap(ctx, dst);
+            }
+            fz_drop_pixmap(ctx, reference);
+        }
+        fz_drop_pixmap(ctx, src);
+    }
+    fz_free_context(ctx);
+}
+
 // we assume this is called from main sumatradirectory, e.g. as:
 // ./obj-dbg/tester.exe, so we use the known files
 void ZipCreateTest()
@@ -248,6 +537,49 @@ void ZipCreateTest()
     }
 }
 
+// opens a RAR archive twice with the on-disk index cache cleaned up in between
+// (as it is at exit) and checks that the second time the cached listing is used
+static void ArchiveIndexCacheTest(const WCHAR *rarPath)
+{
+    SetArchiveIndexCachePathFn(GetArchiveIndexCachePath);
+    ScopedMem<WCHAR> cachePath(GetArchiveIndexCachePath(rarPath));
+    if (!cachePath) {
+        printf("ArchiveIndexCacheTest(): no cache path\n");
+        return;
+    }
+    file::Delete(cachePath);
+
+    WStrVec names;
+    {
+        RarFile archive(rarPath);
+        for (size_t i = 0; i < archive.GetFileCount(); i++) {
+            const WCHAR *name = archive.GetFileName(i);
+            names.Append(str::Dup(name ? name : L""));
+        }
+        if (archive.IsIndexCached() || !file::Exists(cachePath)) {
+            wprintf(L"ArchiveIndexCacheTest(): listing of '%s' wasn't cached\n", rarPath);
+            return;
+        }
+    }
+
+    CleanUpArchiveIndexCache();
+
+    RarFile archive(rarPath);
+    if (!archive.IsIndexCached()) {
+        wprintf(L"ArchiveIndexCacheTest(): cached listing of '%s' didn't survive a restart\n", rarPath);
+        return;
+    }
+    bool sameNames = archive.GetFileCount() == names.Count();
+    for (size_t i = 0; i < names.Count() && sameNames; i++) {
+        const WCHAR *name = archive.GetFileName(i);
+        sameNames = str::Eq(name ? name : L"", names.At(i));
+    }
+    if (!sameNames)
+        wprintf(L"ArchiveIndexCacheTest(): cached listing of '%s' differs\n", rarPath);
+    else
+        printf("ArchiveIndexCacheTest(): ok (%d files)\n", (int)names.Count());
+}
+
 int TesterMain()
 {
     RedirectIOToConsole();
@@ -285,9 +617,36 @@ int TesterMain()
         } else if (str::Eq(argv[i], L"-zip-create")) {
             ZipCreateTest();
             ++i;
+        } else if (str::Eq(argv[i], L"-arcidx-test")) {
+            ++i;
+            if (i == argv.Count())
+                return Usage();
+            ArchiveIndexCacheTest(argv[i]);
+            ++i;
         } else if (str::Eq(argv[i], L"-bench-md5")) {
             BenchMD5();
             ++i;
+        } else if (str::Eq(argv[i], L"-bench-cbx")) {
+            ++i;
+            int pageCount = 100000;
+            if (i < argv.Count() && str::Parse(argv[i], L"%d%$", &pageCount))
+                ++i;
+            BenchCbxPageOrder(pageCount);
+        } else if (str::Eq(argv[i], L"-bench-huffdic")) {
+            ++i;
+            if (i == argv.Count())
+                return Usage();
+            BenchHuffDic(argv[i]);
+            ++i;
+        } else if (str::Eq(argv[i], L"-bench-paint")) {
+            ++i;
+            int iterations = 100000;
+            if (i < argv.Count() && str::Parse(argv[i], L"%d%$", &iterations))
+                ++i;
+            BenchPaintKernels(iterations);
+        } else if (str::Eq(argv[i], L"-bench-scale")) {
+            BenchScalePixmap();
+            ++i;
         } else {
             // unknown argument
             return Usage();
@@ -3,6 +3,7 @@
 
 // utils
 #include "BaseUtil.h"
+#include "ThreadUtil.h"
 // layout controllers
 #include "BaseEngine.h"
 #include "TextSelection.h"
@@ -15,20 +16,242 @@ enum { SEARCH_PAGE, SKIP_PAGE };
 // cf. http://code.google.com/p/sumatrapdf/issues/detail?id=959
 #define isnoncjkwordchar(c) (isWordChar(c) && (unsigned short)(c) < 0x2E80)
 
+// CharLower is comparatively slow, so handle plain ASCII inline
+inline WCHAR FoldCase(WCHAR c)
+{
+    if (c < 0x80)
+        return 'A' <= c && c <= 'Z' ? c + 'a' - 'A' : c;
+    return LOWORD(CharLower((LPWSTR)LOWORD(c)));
+}
+
+// inverted index mapping case-folded terms to the pages containing them
+// (and the offset of each term's first occurrence on those pages), so that
+// pages which can't contain a search's anchor needn't be scanned at all.
+// terms are runs of non-CJK word characters (as for the anchor) and
+// single glyphs otherwise, so that an anchor is always a part of a term
+class TextSearchIndex : public ThreadBase {
+    struct Posting {
+        int pageNo;
+        int glyphIx;
+        int next; // index of the term's next posting (or -1)
+    };
+    struct Term {
+        size_t offset; // of the zero-terminated term in termChars
+        int first, last; // indices into postings
+    };
+    // a term containing the anchor at the given offset
+    struct Match {
+        int termIx;
+        int offset;
+    };
+
+    BaseEngine *engine;
+    PageTextCache *textCache;
+
+    // open addressing hash table of term indices + 1 (0 for empty slots),
+    // so that the terms' characters are only stored in termChars
+    Vec<int> termSlots;
+    Vec<Term> terms;
+    str::Str<WCHAR> termChars;
+    Vec<Posting> postings;
+    int indexedPages;
+
+    // terms matching the most recently searched anchor, so that only terms
+    // added since the previous call have to be compared in FindCandidates
+    ScopedMem<WCHAR> matchAnchor;
+    Vec<Match> matches;
+    size_t matchedTerms;
+
+    CRITICAL_SECTION access;
+
+    size_t FindSlot(const WCHAR *term, size_t len);
+    void AddTerm(const WCHAR *term, size_t len, int pageNo, int glyphIx);
+    void IndexPage(int pageNo, const WCHAR *text);
+
+public:
+    TextSearchIndex(BaseEngine *engine, PageTextCache *textCache);
+    virtual ~TextSearchIndex();
+
+    int IndexedPages();
+    int FindCandidates(const WCHAR *anchor, BYTE *findCache, int *findStart);
+
+    // ThreadBase
+    virtual void Run();
+};
+
+TextSearchIndex::TextSearchIndex(BaseEngine *engine, PageTextCache *textCache) :
+    ThreadBase("TextSearchIndex"), engine(engine), textCache(textCache),
+    indexedPages(0), matchedTerms(0)
+{
+    termSlots.AppendBlanks(4096);
+    InitializeCriticalSection(&access);
+}
+
+TextSearchIndex::~TextSearchIndex()
+{
+    DeleteCriticalSection(&access);
+}
+
+// returns the slot containing term or the empty slot where it belongs
+size_t TextSearchIndex::FindSlot(const WCHAR *term, size_t len)
+{
+    size_t mask = termSlots.Count() - 1;
+    size_t slot = MurmurHash2(term, len * sizeof(WCHAR)) & mask;
+    for (; termSlots.At(slot) != 0; slot = (slot + 1) & mask) {
+        const WCHAR *other = termChars.Get() + terms.At(termSlots.At(slot) - 1).offset;
+        if (str::Eq(other, term))
+            break;
+    }
+    return slot;
+}
+
+void TextSearchIndex::AddTerm(const WCHAR *term, size_t len, int pageNo, int glyphIx)
+{
+    size_t slot = FindSlot(term, len);
+    int id = termSlots.At(slot) - 1;
+    if (-1 == id) {
+        Term t = { termChars.Size(), -1, -1 };
+        // include the terminating zero
+        termChars.Append(term, len + 1);
+        id = (int)terms.Count();
+        terms.Append(t);
+        termSlots.At(slot) = id + 1;
+        // keep the hash table at most half full
+        if (terms.Count() * 2 > termSlots.Count()) {
+            size_t count = termSlots.Count() * 2;
+            termSlots.Reset();
+            termSlots.AppendBlanks(count);
+            for (size_t i = 0; i < terms.Count(); i++) {
+                const WCHAR *s = termChars.Get() + terms.At(i).offset;
+                termSlots.At(FindSlot(s, str::Len(s))) = (int)i + 1;
+            }
+        }
+    }
+    Term& t = terms.At(id);
+    // only a term's first occurrence on a page is recorded
+    if (t.last != -1 && postings.At(t.last).pageNo == pageNo)
+        return;
+    Posting p = { pageNo, glyphIx, -1 };
+    if (t.last != -1)
+        postings.At(t.last).next = (int)postings.Count();
+    else
+        t.first = (int)postings.Count();
+    t.last = (int)postings.Count();
+    postings.Append(p);
+}
+
+void TextSearchIndex::IndexPage(int pageNo, const WCHAR *text)
+{
+    str::Str<WCHAR> term;
+    for (const WCHAR *c = text; *c; ) {
+        if (str::IsWs(*c)) {
+            c++;
+            continue;
+        }
+        const WCHAR *start = c;
+        if (isnoncjkwordchar(*c)) {
+            for (c++; isnoncjkwordchar(*c); c++)
+                ;
+        }
+        else
+            c++;
+        term.Reset();
+        for (const WCHAR *s = start; s < c; s++) {
+            term.Append(FoldCase(*s));
+        }
+        AddTerm(term.Get(), term.Size(), pageNo, (int)(start - text));
+    }
+}
+
+int TextSearchIndex::IndexedPages()
+{
+    ScopedCritSec scope(&access);
+    return indexedPages;
+}
+
+// marks all indexed pages which can't contain anchor as SKIP_PAGE and sets
+// findStart to the offset of the first potential match for all others;
+// returns the number of indexed pages (which are always the first ones)
+int TextSearchIndex::FindCandidates(const WCHAR *anchor, BYTE *findCache, int *findStart)
+{
+    ScopedMem<WCHAR> folded(str::Dup(anchor));
+    for (WCHAR *c = folded; *c; c++) {
+        *c = FoldCase(*c);
+    }
+
+    ScopedCritSec scope(&access);
+    if (!str::Eq(matchAnchor, folded)) {
+        matchAnchor.Set(folded.StealData());
+        matches.Reset();
+        matchedTerms = 0;
+    }
+    for (; matchedTerms < terms.Count(); matchedTerms++) {
+        const WCHAR *term = termChars.Get() + terms.At(matchedTerms).offset;
+        const WCHAR *found = str::Find(term, matchAnchor);
+        if (found) {
+            Match m = { (int)matchedTerms, (int)(found - term) };
+            matches.Append(m);
+        }
+    }
+
+    for (int i = 0; i < indexedPages; i++) {
+        findStart[i] = INT_MAX;
+    }
+    for (size_t i = 0; i < matches.Count(); i++) {
+        Match& m = matches.At(i);
+        for (int ix = terms.At(m.termIx).first; ix != -1; ix = postings.At(ix).next) {
+            Posting& p = postings.At(ix);
+            int start = p.glyphIx + m.offset;
+            if (start < findStart[p.pageNo - 1])
+                findStart[p.pageNo - 1] = start;
+        }
+    }
+    for (int i = 0; i < indexedPages; i++) {
+        if (INT_MAX == findStart[i]) {
+            findCache[i] = SKIP_PAGE;
+            findStart[i] = 0;
+        }
+    }
+    return indexedPages;
+}
+
+void TextSearchIndex::Run()
+{
+    int count = textCache->PageCount();
+    for (int pageNo = 1; pageNo <= count && !WasCancelRequested(); pageNo++) {
+        // the glyph coordinates are only needed for pages with potential
+        // matches, so don't fill textCache with them for all pages
+        const WCHAR *cached = textCache->HasData(pageNo) ? textCache->GetData(pageNo) : nullptr;
+        ScopedMem<WCHAR> text(cached ? nullptr : engine->ExtractPageText(pageNo, L"\n"));
+        ScopedCritSec scope(&access);
+        if (cached || text)
+            IndexPage(pageNo, cached ? cached : text.Get());
+        indexedPages = pageNo;
+    }
+}
+
 TextSearch::TextSearch(BaseEngine *engine, PageTextCache *textCache) :
     TextSelection(engine, textCache),
     findText(nullptr), anchor(nullptr), pageText(nullptr),
     caseSensitive(false), forward(true),
     matchWordStart(false), matchWordEnd(false),
-    findPage(0), findIndex(0), lastText(nullptr)
+    findPage(0), findIndex(0), lastText(nullptr),
+    index(nullptr), indexedPages(0)
 {
-    findCache = AllocArray<BYTE>(this->engine->PageCount());
+    findCache = AllocArray<BYTE>(textCache->PageCount());
+    findStart = AllocArray<int>(textCache->PageCount());
 }
 
 TextSearch::~TextSearch()
 {
+    if (index) {
+        index->RequestCancel();
+        index->Join();
+        delete index;
+    }
     Clear();
     free(findCache);
+    free(findStart);
 }
 
 void TextSearch::Reset()
@@ -77,7 +300,8 @@ void TextSearch::SetText(const WCHAR *text)
     if (str::EndsWith(this->findText, L" "))
         this->findText[str::Len(this->findText) - 1] = '\0';
 
-    memset(this->findCache, SEARCH_PAGE, this->engine->PageCount());
+    memset(this->findCache, SEARCH_PAGE, this->textCache->PageCount());
+    this->indexedPages = 0;
 }
 
 void TextSearch::SetSensitive(bool sensitive)
@@ -86,7 +310,8 @@ void TextSearch::SetSensitive(bool sensitive)
         return;
     this->caseSensitive = sensitive;
 
-    memset(this->findCache, SEARCH_PAGE, this->engine->PageCount());
+    memset(this->findCache, SEARCH_PAGE, this->textCache->PageCount());
+    this->indexedPages = 0;
 }
 
 void TextSearch::SetDirection(TextSearchDirection direction)
@@ -128,7 +353,7 @@ int TextSearch::MatchLen(const WCHAR *start) const
     while (*match) {
         if (!*end)
             return -1;
-        if (caseSensitive ? *match == *end : CharLower((LPWSTR)LOWORD(*match)) == CharLower((LPWSTR)LOWORD(*end)))
+        if (caseSensitive ? *match == *end : FoldCase(*match) == FoldCase(*end))
             /* characters are identical */;
         else if (str::IsWs(*match) && str::IsWs(*end))
             /* treat all whitespace as identical */;
@@ -204,12 +429,23 @@ bool TextSearch::FindTextInPage(int pageNo)
     return true;
 }
 
+// fill in findCache for all pages indexed since the last call
+void TextSearch::UpdateFromIndex()
+{
+    if (!index || !anchor)
+        return;
+    if (index->IndexedPages() > indexedPages)
+        indexedPages = index->FindCandidates(anchor, findCache, findStart);
+}
+
 bool TextSearch::FindStartingAtPage(int pageNo, ProgressUpdateUI *tracker)
 {
     if (str::IsEmpty(findText))
         return false;
 
-    int total = engine->PageCount();
+    UpdateFromIndex();
+
+    int total = textCache->PageCount();
     while (1 <= pageNo && pageNo <= total && (!tracker || !tracker->WasCanceled())) {
         if (tracker)
             tracker->UpdateProgress(pageNo, total);
@@ -224,7 +460,7 @@ bool TextSearch::FindStartingAtPage(int pageNo, ProgressUpdateUI *tracker)
         pageText = textCache->GetData(pageNo, &findIndex);
         if (pageText) {
             if (forward)
-                findIndex = 0;
+                findIndex = pageNo <= indexedPages ? findStart[pageNo - 1] : 0;
             if (FindTextInPage(pageNo))
                 return true;
             findCache[pageNo - 1] = SKIP_PAGE;
@@ -243,11 +479,33 @@ TextSel *TextSearch::FindFirst(int page, const WCHAR *text, ProgressUpdateUI *tr
 {
     SetText(text);
 
+    if (!index) {
+        index = new TextSearchIndex(engine, textCache);
+        index->Start();
+    }
+
     if (FindStartingAtPage(page, tracker))
         return &result;
     return nullptr;
 }
 
+int TextSearch::FindAllInPage(int pageNo, const WCHAR *text, Vec<RectI>& rects)
+{
+    SetText(text);
+    forward = true;
+
+    Reset();
+    pageText = textCache->GetData(pageNo);
+    findIndex = 0;
+
+    int matches = 0;
+    while (pageText && FindTextInPage(pageNo)) {
+        rects.Append(result.rects, result.len);
+        matches++;
+    }
+    return matches;
+}
+
 TextSel *TextSearch::FindNext(ProgressUpdateUI *tracker)
 {
     CrashIf(!findText);
@@ -257,7 +515,7 @@ TextSel *TextSearch::FindNext(ProgressUpdateUI *tracker)
     if (tracker) {
         if (tracker->WasCanceled())
             return nullptr;
-        tracker->UpdateProgress(findPage, engine->PageCount());
+        tracker->UpdateProgress(findPage, textCache->PageCount());
     }
 
     if (FindTextInPage())
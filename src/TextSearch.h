@@ -14,6 +14,8 @@ public:
     virtual ~ProgressUpdateUI() { }
 };
 
+class TextSearchIndex;
+
 class TextSearch : public TextSelection
 {
 public:
@@ -25,6 +27,9 @@ public:
     void SetLastResult(TextSelection *sel);
     TextSel *FindFirst(int page, const WCHAR *text, ProgressUpdateUI *tracker=nullptr);
     TextSel *FindNext(ProgressUpdateUI *tracker=nullptr);
+    // appends the coordinates of all matches on a single page to rects
+    // and returns the number of matches (used for "find all")
+    int FindAllInPage(int pageNo, const WCHAR *text, Vec<RectI>& rects);
 
     // note: the result might not be a valid page number!
     int GetCurrentPageNo() const { return findPage; }
@@ -45,6 +50,7 @@ protected:
     bool FindTextInPage(int pageNo = 0);
     bool FindStartingAtPage(int pageNo, ProgressUpdateUI *tracker);
     int MatchLen(const WCHAR *start) const;
+    void UpdateFromIndex();
 
     void Clear()
     {
@@ -61,4 +67,11 @@ private:
 
     WCHAR *lastText;
     BYTE *findCache;
+
+    // inverted index built in the background on the first search
+    TextSearchIndex *index;
+    // number of pages for which findCache has been filled in from the index
+    int indexedPages;
+    // offset of the first potential match for each indexed page
+    int *findStart;
 };
@@ -3,13 +3,52 @@
 
 // utils
 #include "BaseUtil.h"
+#include "CryptoUtil.h"
+#include "FileUtil.h"
+#include "ThreadUtil.h"
+#include "VarintGob.h"
 // layout controllers
 #include "BaseEngine.h"
 #include "TextSelection.h"
 
-PageTextCache::PageTextCache(BaseEngine *engine) : engine(engine)
+#define TEXT_CACHE_MAGIC    "SuTC"
+#define TEXT_CACHE_VERSION  2
+// only the beginning of a document is hashed for identifying it
+// (in addition to its size and modification time)
+#define TEXT_CACHE_DIGEST_SIZE (1024 * 1024)
+
+static void AppendUVarint(str::Str<char>& data, uint64_t val)
 {
-    int count = engine->PageCount();
+    uint8_t buf[9];
+    int n = UVarintGobEncode(val, buf, dimof(buf));
+    data.Append((const char *)buf, n);
+}
+
+static void AppendVarint(str::Str<char>& data, int64_t val)
+{
+    uint8_t buf[9];
+    int n = VarintGobEncode(val, buf, dimof(buf));
+    data.Append((const char *)buf, n);
+}
+
+static void SaveDiskCache(const WCHAR *cachePath, str::Str<char>& data, int count,
+                          WCHAR **text, int *lens, RectI **coords);
+
+static void FreePageData(int count, WCHAR **text, RectI **coords, int *lens)
+{
+    for (int i = 0; i < count; i++) {
+        free(coords[i]);
+        free(text[i]);
+    }
+    free(coords);
+    free(text);
+    free(lens);
+}
+
+PageTextCache::PageTextCache(BaseEngine *engine) : engine(engine),
+    diskCachePath(nullptr), diskCacheLoaded(false), diskCacheDirty(false), fileSize(0)
+{
+    int count = pageCount = engine->PageCount();
     coords = AllocArray<RectI *>(count);
     text = AllocArray<WCHAR *>(count);
     lens = AllocArray<int>(count);
@@ -24,14 +63,34 @@ PageTextCache::~PageTextCache()
 {
     EnterCriticalSection(&access);
 
-    for (int i = 0; i < engine->PageCount(); i++) {
-        free(coords[i]);
-        free(text[i]);
+    int count = pageCount;
+    if (diskCachePath && diskCacheDirty) {
+        // serializing and writing the cache happens in the background (which
+        // then also frees the text), so that closing a document doesn't block
+        str::Str<char> *data = new str::Str<char>();
+        data->Append(TEXT_CACHE_MAGIC, 4);
+        AppendUVarint(*data, TEXT_CACHE_VERSION);
+        data->Append((const char *)fileDigest, sizeof(fileDigest));
+        AppendUVarint(*data, (uint64_t)fileSize);
+        AppendUVarint(*data, fileTime.dwHighDateTime);
+        AppendUVarint(*data, fileTime.dwLowDateTime);
+        AppendUVarint(*data, count);
+
+        WCHAR *cachePath = diskCachePath;
+        WCHAR **text = this->text;
+        RectI **coords = this->coords;
+        int *lens = this->lens;
+        RunAsync([=] {
+            SaveDiskCache(cachePath, *data, count, text, lens, coords);
+            FreePageData(count, text, coords, lens);
+            delete data;
+            free(cachePath);
+        });
+    }
+    else {
+        free(diskCachePath);
+        FreePageData(count, text, coords, lens);
     }
-
-    free(coords);
-    free(text);
-    free(lens);
 
     LeaveCriticalSection(&access);
     DeleteCriticalSection(&access);
@@ -39,26 +98,82 @@ PageTextCache::~PageTextCache()
 
 bool PageTextCache::HasData(int pageNo)
 {
-    CrashIf(pageNo < 1 || pageNo > engine->PageCount());
+    CrashIf(pageNo < 1 || pageNo > pageCount);
     return text[pageNo - 1] != nullptr;
 }
 
+void PageTextCache::UpdatePageCount()
+{
+    ScopedCritSec scope(&access);
+
+    int count = engine->PageCount();
+    if (count == pageCount)
+        return;
+
+    RectI **newCoords = AllocArray<RectI *>(count);
+    WCHAR **newText = AllocArray<WCHAR *>(count);
+    int *newLens = AllocArray<int>(count);
+    for (int i = 0; i < std::min(count, pageCount); i++) {
+        newCoords[i] = coords[i];
+        newText[i] = text[i];
+        newLens[i] = lens[i];
+    }
+    for (int i = count; i < pageCount; i++) {
+#ifdef DEBUG
+        if (text[i])
+            debug_size -= (lens[i] + 1) * (sizeof(WCHAR) + sizeof(RectI));
+#endif
+        free(coords[i]);
+        free(text[i]);
+    }
+    free(coords);
+    free(text);
+    free(lens);
+    coords = newCoords;
+    text = newText;
+    lens = newLens;
+#ifdef DEBUG
+    debug_size += (count - pageCount) * (sizeof(RectI *) + sizeof(WCHAR *) + sizeof(int));
+#endif
+    pageCount = count;
+}
+
 const WCHAR *PageTextCache::GetData(int pageNo, int *lenOut, RectI **coordsOut)
 {
     ScopedCritSec scope(&access);
 
+    if (diskCachePath && !diskCacheLoaded) {
+        diskCacheLoaded = true;
+        LoadDiskCache();
+    }
+
     if (!text[pageNo - 1]) {
-        text[pageNo - 1] = engine->ExtractPageText(pageNo, L"\n", &coords[pageNo - 1]);
-        if (!text[pageNo - 1]) {
-            text[pageNo - 1] = str::Dup(L"");
-            lens[pageNo - 1] = 0;
+        // don't block access to other pages while extracting text,
+        // so that several pages can be extracted in parallel
+        LeaveCriticalSection(&access);
+        RectI *pageCoords = nullptr;
+        WCHAR *pageText = engine->ExtractPageText(pageNo, L"\n", &pageCoords);
+        EnterCriticalSection(&access);
+        if (text[pageNo - 1]) {
+            // another thread has been quicker
+            free(pageText);
+            free(pageCoords);
         }
         else {
-            lens[pageNo - 1] = (int)str::Len(text[pageNo - 1]);
-        }
+            diskCacheDirty = true;
+            coords[pageNo - 1] = pageCoords;
+            if (!pageText) {
+                text[pageNo - 1] = str::Dup(L"");
+                lens[pageNo - 1] = 0;
+            }
+            else {
+                text[pageNo - 1] = pageText;
+                lens[pageNo - 1] = (int)str::Len(pageText);
+            }
 #ifdef DEBUG
-        debug_size += (lens[pageNo - 1] + 1) * (sizeof(WCHAR) + sizeof(RectI));
+            debug_size += (lens[pageNo - 1] + 1) * (sizeof(WCHAR) + sizeof(RectI));
 #endif
+        }
     }
 
     if (lenOut)
@@ -68,6 +183,175 @@ const WCHAR *PageTextCache::GetData(int pageNo, int *lenOut, RectI **coordsOut)
     return text[pageNo - 1];
 }
 
+void PageTextCache::EnableDiskCache(const WCHAR *cachePath)
+{
+    ScopedCritSec scope(&access);
+    // don't leak the content of encrypted documents to disk
+    ScopedMem<char> decryptionKey(engine->GetDecryptionKey());
+    if (decryptionKey || !engine->FileName() || !cachePath)
+        return;
+    str::ReplacePtr(&diskCachePath, cachePath);
+    diskCacheLoaded = false;
+}
+
+class TextCacheReader {
+    const uint8_t *data;
+    size_t left;
+
+public:
+    bool ok;
+
+    TextCacheReader(const char *data, size_t len) : data((const uint8_t *)data), left(len), ok(true) { }
+
+    uint64_t UVarint() {
+        uint64_t val = 0;
+        int n = ok ? UVarintGobDecode(data, (int)std::min(left, (size_t)16), &val) : 0;
+        ok = n > 0;
+        data += n;
+        left -= n;
+        return val;
+    }
+    int64_t Varint() {
+        int64_t val = 0;
+        int n = ok ? VarintGobDecode(data, (int)std::min(left, (size_t)16), &val) : 0;
+        ok = n > 0;
+        data += n;
+        left -= n;
+        return val;
+    }
+    const char *Bytes(size_t len) {
+        ok = ok && len <= left;
+        if (!ok)
+            return nullptr;
+        const char *res = (const char *)data;
+        data += len;
+        left -= len;
+        return res;
+    }
+};
+
+// the cache consists of a header (magic, version, the MD5 digest of the
+// document's first TEXT_CACHE_DIGEST_SIZE bytes, the document's size and
+// modification time, page count) followed by each page's text length
+// (plus one, zero for pages not extracted), its text as UTF-8 and the
+// coordinates of all glyphs (delta-encoded against the previous glyph)
+void PageTextCache::LoadDiskCache()
+{
+    // the document's identity is also needed for saving the cache
+    const WCHAR *filePath = engine->FileName();
+    fileSize = file::GetSize(filePath);
+    size_t prefixLen = fileSize < 0 ? 0 : (size_t)std::min(fileSize, (int64)TEXT_CACHE_DIGEST_SIZE);
+    ScopedMem<char> prefix(AllocArray<char>(prefixLen + 1));
+    if (fileSize < 0 || !prefix || !file::ReadN(filePath, prefix, prefixLen)) {
+        str::ReplacePtr(&diskCachePath, nullptr);
+        return;
+    }
+    CalcMD5Digest((unsigned char *)prefix.Get(), prefixLen, fileDigest);
+    fileTime = file::GetModificationTime(filePath);
+
+    size_t len;
+    ScopedMem<char> data(file::ReadAll(diskCachePath, &len));
+    if (!data)
+        return;
+
+    TextCacheReader r(data, len);
+    const char *magic = r.Bytes(4);
+    if (!magic || !str::EqN(magic, TEXT_CACHE_MAGIC, 4) || r.UVarint() != TEXT_CACHE_VERSION)
+        return;
+    const char *digest = r.Bytes(sizeof(fileDigest));
+    if (!digest || memcmp(digest, fileDigest, sizeof(fileDigest)) != 0)
+        return;
+    if (r.UVarint() != (uint64_t)fileSize)
+        return;
+    FILETIME ft;
+    ft.dwHighDateTime = (DWORD)r.UVarint();
+    ft.dwLowDateTime = (DWORD)r.UVarint();
+    if (!r.ok || !FileTimeEq(ft, fileTime))
+        return;
+    if (r.UVarint() != (uint64_t)pageCount)
+        return;
+
+    for (int i = 0; i < pageCount && r.ok; i++) {
+        uint64_t textLen = r.UVarint();
+        if (0 == textLen || textLen > INT_MAX)
+            continue;
+        int pageLen = (int)(textLen - 1);
+        WCHAR *pageText = nullptr;
+        RectI *pageCoords = nullptr;
+        if (0 == pageLen) {
+            pageText = str::Dup(L"");
+        }
+        else {
+            size_t utf8Len = (size_t)r.UVarint();
+            const char *utf8 = r.Bytes(utf8Len);
+            if (utf8)
+                pageText = str::conv::FromUtf8(utf8, utf8Len);
+            if (!pageText || str::Len(pageText) != (size_t)pageLen) {
+                free(pageText);
+                break;
+            }
+            pageCoords = AllocArray<RectI>(pageLen);
+            RectI prev;
+            for (int j = 0; j < pageLen; j++) {
+                RectI& rc = pageCoords[j];
+                rc.x = prev.x + (int)r.Varint();
+                rc.y = prev.y + (int)r.Varint();
+                rc.dx = (int)r.Varint();
+                rc.dy = (int)r.Varint();
+                prev = rc;
+            }
+            if (!r.ok) {
+                free(pageText);
+                free(pageCoords);
+                break;
+            }
+        }
+        if (text[i]) {
+            free(pageText);
+            free(pageCoords);
+            continue;
+        }
+        text[i] = pageText;
+        coords[i] = pageCoords;
+        lens[i] = pageLen;
+#ifdef DEBUG
+        debug_size += (pageLen + 1) * (sizeof(WCHAR) + sizeof(RectI));
+#endif
+    }
+}
+
+// appends the pages' text to data (which already contains the header)
+// and writes it to cachePath
+static void SaveDiskCache(const WCHAR *cachePath, str::Str<char>& data, int count,
+                          WCHAR **text, int *lens, RectI **coords)
+{
+    for (int i = 0; i < count; i++) {
+        ScopedMem<char> utf8(text[i] && lens[i] > 0 ? str::conv::ToUtf8(text[i], lens[i]) : nullptr);
+        if (!text[i] || (lens[i] > 0 && (!coords[i] || !utf8))) {
+            AppendUVarint(data, 0);
+            continue;
+        }
+        AppendUVarint(data, lens[i] + 1);
+        if (0 == lens[i])
+            continue;
+        AppendUVarint(data, str::Len(utf8));
+        data.Append(utf8, str::Len(utf8));
+        RectI prev;
+        for (int j = 0; j < lens[i]; j++) {
+            RectI& rc = coords[i][j];
+            AppendVarint(data, rc.x - prev.x);
+            AppendVarint(data, rc.y - prev.y);
+            AppendVarint(data, rc.dx);
+            AppendVarint(data, rc.dy);
+            prev = rc;
+        }
+    }
+
+    ScopedMem<WCHAR> dir(path::GetDir(cachePath));
+    if (dir::Create(dir))
+        file::WriteAll(cachePath, data.Get(), data.Size());
+}
+
 TextSelection::TextSelection(BaseEngine *engine, PageTextCache *textCache) :
     engine(engine), textCache(textCache), startPage(-1),
     endPage(-1), startGlyph(-1), endGlyph(-1)
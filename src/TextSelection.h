@@ -7,6 +7,8 @@ inline bool isWordChar(WCHAR c) { return IsCharAlphaNumeric(c) || c == '_'; }
 
 class PageTextCache {
     BaseEngine* engine;
+    // engine->PageCount() might only be an estimate (cf. UpdatePageCount)
+    int         pageCount;
     RectI    ** coords;
     WCHAR    ** text;
     int       * lens;
@@ -16,10 +18,28 @@ class PageTextCache {
 
     CRITICAL_SECTION access;
 
+    // optional on-disk cache (see EnableDiskCache)
+    WCHAR     * diskCachePath;
+    bool        diskCacheLoaded;
+    bool        diskCacheDirty;
+    unsigned char fileDigest[16];
+    int64       fileSize;
+    FILETIME    fileTime;
+
+    void        LoadDiskCache();
+
 public:
     explicit PageTextCache(BaseEngine *engine);
     ~PageTextCache();
 
+    // loads previously extracted text from and saves it to cachePath, as long
+    // as the document's size, modification time and the MD5 digest of its
+    // beginning match
+    void EnableDiskCache(const WCHAR *cachePath);
+    // keeps the text of all pages remaining after the engine's page count has changed
+    void UpdatePageCount();
+    int PageCount() const { return pageCount; }
+
     bool HasData(int pageNo);
     const WCHAR *GetData(int pageNo, int *lenOut=nullptr, RectI **coordsOut=nullptr);
 };
@@ -60,6 +60,9 @@ WindowInfo::WindowInfo(HWND hwnd) :
     linkHandler = new LinkHandler(*this);
     notifications = new Notifications();
     fwdSearchMark.show = false;
+    findAllMarks.search = nullptr;
+    findAllMarks.dm = nullptr;
+    findAllMarks.matches = 0;
 }
 
 WindowInfo::~WindowInfo()
@@ -214,6 +214,15 @@ public:
         int hideStep;       // value used to gradually hide the markers
     } fwdSearchMark;
 
+    /* after a "find all" search, all matches are highlighted in the document */
+    struct {
+        void *search;       // the search currently adding matches
+        DisplayModel *dm;   // the document the matches belong to
+        Vec<int> pages;     // page of each marker
+        Vec<RectI> rects;   // location of the markers in user coordinates
+        int matches;
+    } findAllMarks;
+
     StressTest *    stressTest;
 
     TouchState      touchState;
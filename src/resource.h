@@ -96,6 +96,7 @@
 #define IDM_RENAME_FILE                 580
 #define IDM_FIND_NEXT_SEL               581
 #define IDM_FIND_PREV_SEL               582
+#define IDM_FIND_ALL                    583
 #define IDM_DEBUG_SHOW_LINKS            590
 #define IDM_DEBUG_CRASH_ME              592
 #define IDM_LOAD_MOBI_SAMPLE            593
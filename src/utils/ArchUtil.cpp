@@ -3,6 +3,9 @@
 
 #include "BaseUtil.h"
 #include "ArchUtil.h"
+#include "ByteReader.h"
+#include "ByteWriter.h"
+#include "FileUtil.h"
 
 extern "C" {
 #include <unarr.h>
@@ -13,14 +16,39 @@ extern "C" {
 // fails to open or extract and uses that as a fallback
 #define ENABLE_UNRARDLL_FALLBACK
 
-#ifdef ENABLE_UNRARDLL_FALLBACK
-#include "FileUtil.h"
-#endif
+// index cache layout (all values little-endian):
+// 'AIX1', archive size (64-bit), archive modification time (64-bit), entry count (32-bit)
+// followed by entry count times:
+// filepos (64-bit), solidpos (64-bit), name length (32-bit, -1 for no name), UTF-8 name
+#define INDEX_CACHE_MAGIC       0x31584941
+#define INDEX_CACHE_HEADER_SIZE 24
+#define INDEX_CACHE_ENTRY_SIZE  20
+
+static ArchIndexCachePathFn gIndexCachePathFn = nullptr;
 
-ArchFile::ArchFile(ar_stream *data, ar_archive *(* openFormat)(ar_stream *)) : data(data), ar(nullptr)
+void SetArchiveIndexCachePathFn(ArchIndexCachePathFn fn)
+{
+    gIndexCachePathFn = fn;
+}
+
+ArchFile::ArchFile(ar_stream *data, ar_archive *(* openFormat)(ar_stream *), const WCHAR *archivePath) :
+    data(data), ar(nullptr), isSolid(-1), archiveSize(0), archiveTime(0), isIndexCached(false)
 {
     if (data && openFormat)
         ar = openFormat(data);
+    if (archivePath && gIndexCachePathFn) {
+        int64 size = file::GetSize(archivePath);
+        FILETIME ft = file::GetModificationTime(archivePath);
+        if (size >= 0) {
+            indexCachePath.Set(gIndexCachePathFn(archivePath));
+            archiveSize = (uint64_t)size;
+            archiveTime = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+        }
+        if (indexCachePath && LoadIndexCache()) {
+            isIndexCached = true;
+            return;
+        }
+    }
     if (!ar)
         return;
     while (ar_parse_entry(ar)) {
@@ -30,7 +58,10 @@ ArchFile::ArchFile(ar_stream *data, ar_archive *(* openFormat)(ar_stream *)) : d
         else
             filenames.Append(nullptr);
         filepos.Append(ar_entry_get_offset(ar));
+        solidpos.Append(ar_entry_get_solid_offset(ar));
     }
+    if (ar_at_eof(ar))
+        SaveIndexCache();
     // extract (further) filenames with fallback in derived class constructor
     // once GetFileFromFallback has been correctly set in the vtable
 }
@@ -41,6 +72,98 @@ ArchFile::~ArchFile()
     ar_close(data);
 }
 
+bool ArchFile::ParseEntryAt(size_t fileindex)
+{
+    CrashIf(fileindex >= filepos.Count() || filepos.Count() != solidpos.Count());
+    return ar && ar_parse_entry_at_solid(ar, filepos.At(fileindex), solidpos.At(fileindex));
+}
+
+// entries of a solid block can only be decompressed one after the other
+bool ArchFile::IsSolid()
+{
+    if (-1 == isSolid) {
+        isSolid = 0;
+        for (size_t i = 0; i < solidpos.Count() && !isSolid; i++) {
+            if (solidpos.At(i) != 0 && solidpos.At(i) != filepos.At(i))
+                isSolid = 1;
+        }
+    }
+    return isSolid != 0;
+}
+
+bool ArchFile::LoadIndexCache()
+{
+    size_t len;
+    ScopedMem<char> cache(file::ReadAll(indexCachePath, &len));
+    if (!cache || len < INDEX_CACHE_HEADER_SIZE)
+        return false;
+    ByteReader r(cache, len);
+    if (r.DWordLE(0) != INDEX_CACHE_MAGIC || r.QWordLE(4) != archiveSize || r.QWordLE(12) != archiveTime)
+        return false;
+    uint32_t count = r.DWordLE(20);
+
+    // make sure that the whole cache is well-formed before using any of it
+    size_t off = INDEX_CACHE_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        if (len - off < INDEX_CACHE_ENTRY_SIZE)
+            return false;
+        uint32_t nameLen = r.DWordLE(off + 16);
+        off += INDEX_CACHE_ENTRY_SIZE;
+        if (nameLen != (uint32_t)-1 && len - off < nameLen)
+            return false;
+        if (nameLen != (uint32_t)-1)
+            off += nameLen;
+    }
+    if (off != len)
+        return false;
+
+    off = INDEX_CACHE_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        filepos.Append((int64_t)r.QWordLE(off));
+        solidpos.Append((int64_t)r.QWordLE(off + 8));
+        uint32_t nameLen = r.DWordLE(off + 16);
+        off += INDEX_CACHE_ENTRY_SIZE;
+        if (nameLen != (uint32_t)-1) {
+            filenames.Append(str::conv::FromUtf8(cache + off, nameLen));
+            off += nameLen;
+        }
+        else
+            filenames.Append(nullptr);
+    }
+
+    // the modification time tells when the listing was last used
+    // (so that the least recently used listings can be removed first)
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    file::SetModificationTime(indexCachePath, now);
+    return true;
+}
+
+void ArchFile::SaveIndexCache()
+{
+    if (!indexCachePath)
+        return;
+
+    str::Str<char> cache;
+    ByteWriterLE header(cache.AppendBlanks(INDEX_CACHE_HEADER_SIZE), INDEX_CACHE_HEADER_SIZE);
+    header.Write32(INDEX_CACHE_MAGIC);
+    header.Write64(archiveSize);
+    header.Write64(archiveTime);
+    header.Write32((uint32_t)filenames.Count());
+    for (size_t i = 0; i < filenames.Count(); i++) {
+        ScopedMem<char> name(filenames.At(i) ? str::conv::ToUtf8(filenames.At(i)) : nullptr);
+        ByteWriterLE entry(cache.AppendBlanks(INDEX_CACHE_ENTRY_SIZE), INDEX_CACHE_ENTRY_SIZE);
+        entry.Write64((uint64_t)filepos.At(i));
+        entry.Write64((uint64_t)solidpos.At(i));
+        entry.Write32(name ? (uint32_t)str::Len(name) : (uint32_t)-1);
+        if (name)
+            cache.Append(name);
+    }
+    ScopedMem<WCHAR> dir(path::GetDir(indexCachePath));
+    if (dir::Create(dir))
+        file::WriteAll(indexCachePath, cache.Get(), cache.Size());
+}
+
 size_t ArchFile::GetFileIndex(const WCHAR *fileName)
 {
     return filenames.FindI(fileName);
@@ -69,7 +192,7 @@ char *ArchFile::GetFileDataByIdx(size_t fileindex, size_t *len)
     if (fileindex >= filenames.Count())
         return nullptr;
 
-    if (!ar || !ar_parse_entry_at(ar, filepos.At(fileindex)))
+    if (!ParseEntryAt(fileindex))
         return GetFileFromFallback(fileindex, len);
 
     size_t size = ar_entry_get_size(ar);
@@ -88,6 +211,59 @@ char *ArchFile::GetFileDataByIdx(size_t fileindex, size_t *len)
     return data.StealData();
 }
 
+char *ArchFile::GetFileDataStartByIdx(size_t fileindex, size_t maxLen, size_t *len)
+{
+    if (fileindex >= filenames.Count())
+        return nullptr;
+
+    // extracting only part of an entry leaves a solid block's decompression state
+    // incomplete, so that the following entry would have to be decompressed
+    // from the block's start again (making header sniffing quadratic)
+    if (IsSolid())
+        return nullptr;
+    if (!ParseEntryAt(fileindex))
+        return nullptr;
+
+    size_t size = std::min(ar_entry_get_size(ar), maxLen);
+    if (size > SIZE_MAX - 3)
+        return nullptr;
+    ScopedMem<char> data((char *)malloc(size + 3));
+    if (!data)
+        return nullptr;
+    if (!ar_entry_uncompress(ar, data, size))
+        return nullptr;
+    // zero-terminate for convenience
+    data[size] = data[size + 1] = data[size + 2] = '\0';
+
+    if (len)
+        *len = size;
+    return data.StealData();
+}
+
+ArchFileStream::ArchFileStream(ArchFile *arch, size_t fileindex) :
+    arch(arch), fileindex(fileindex), size(0), pos(0), valid(false)
+{
+    if (fileindex >= arch->filepos.Count() || -1 == arch->filepos.At(fileindex))
+        return;
+    if (!arch->ParseEntryAt(fileindex))
+        return;
+    size = ar_entry_get_size(arch->ar);
+    valid = true;
+}
+
+size_t ArchFileStream::Read(char *buf, size_t len)
+{
+    if (!valid)
+        return 0;
+    len = std::min(len, size - pos);
+    if (len > 0 && !ar_entry_uncompress(arch->ar, buf, len)) {
+        valid = false;
+        return 0;
+    }
+    pos += len;
+    return len;
+}
+
 FILETIME ArchFile::GetFileTime(const WCHAR *fileName)
 {
     return GetFileTime(GetFileIndex(fileName));
@@ -96,7 +272,7 @@ FILETIME ArchFile::GetFileTime(const WCHAR *fileName)
 FILETIME ArchFile::GetFileTime(size_t fileindex)
 {
     FILETIME ft = { (DWORD)-1, (DWORD)-1 };
-    if (ar && fileindex < filepos.Count() && ar_parse_entry_at(ar, filepos.At(fileindex))) {
+    if (fileindex < filepos.Count() && ParseEntryAt(fileindex)) {
         time64_t filetime = ar_entry_get_filetime(ar);
         LocalFileTimeToFileTime((FILETIME *)&filetime, &ft);
     }
@@ -130,11 +306,12 @@ static ar_archive *ar_open_zip_archive_deflated(ar_stream *stream) { return ar_o
 
 ZipFile::ZipFile(const WCHAR *path, bool deflatedOnly) : ArchFile(ar_open_file_w(path), GetZipOpener(deflatedOnly)) { }
 ZipFile::ZipFile(IStream *stream, bool deflatedOnly) : ArchFile(ar_open_istream(stream), GetZipOpener(deflatedOnly)) { }
+ZipFile::ZipFile(const char *data, size_t len, bool deflatedOnly) : ArchFile(ar_open_memory(data, len), GetZipOpener(deflatedOnly)) { }
 
 _7zFile::_7zFile(const WCHAR *path) : ArchFile(ar_open_file_w(path), ar_open_7z_archive) { }
 _7zFile::_7zFile(IStream *stream) : ArchFile(ar_open_istream(stream), ar_open_7z_archive) { }
 
-TarFile::TarFile(const WCHAR *path) : ArchFile(ar_open_file_w(path), ar_open_tar_archive) { }
+TarFile::TarFile(const WCHAR *path) : ArchFile(ar_open_file_w(path), ar_open_tar_archive, path) { }
 TarFile::TarFile(IStream *stream) : ArchFile(ar_open_istream(stream), ar_open_tar_archive) { }
 
 #ifdef ENABLE_UNRARDLL_FALLBACK
@@ -149,7 +326,7 @@ public:
 class UnRarDll { };
 #endif
 
-RarFile::RarFile(const WCHAR *path) : ArchFile(ar_open_file_w(path), ar_open_rar_archive),
+RarFile::RarFile(const WCHAR *path) : ArchFile(ar_open_file_w(path), ar_open_rar_archive, path),
     path(str::Dup(path)), fallback(nullptr) { ExtractFilenamesWithFallback(); }
 RarFile::RarFile(IStream *stream) : ArchFile(ar_open_istream(stream), ar_open_rar_archive),
     path(nullptr), fallback(nullptr) { ExtractFilenamesWithFallback(); }
@@ -157,8 +334,12 @@ RarFile::~RarFile() { delete fallback; }
 
 void RarFile::ExtractFilenamesWithFallback()
 {
-    if (!ar || !ar_at_eof(ar))
+    if (isIndexCached)
+        return;
+    if (!ar || !ar_at_eof(ar)) {
         (void)GetFileFromFallback((size_t)-1);
+        SaveIndexCache();
+    }
 }
 
 char *RarFile::GetFileFromFallback(size_t fileindex, size_t *len)
@@ -177,6 +358,7 @@ char *RarFile::GetFileFromFallback(size_t fileindex, size_t *len)
         // always use the fallback for all additionally found files
         while (filepos.Count() < filenames.Count()) {
             filepos.Append(-1);
+            solidpos.Append(0);
         }
     }
 #endif
@@ -6,19 +6,46 @@ typedef struct ar_stream_s ar_stream;
 typedef struct ar_archive_s ar_archive;
 }
 
+// returns the path at which the listing of the archive at archivePath may be cached
+// (or nullptr for no caching); caller needs to free() the result
+typedef WCHAR *(* ArchIndexCachePathFn)(const WCHAR *archivePath);
+// enables caching archive listings on disk so that reopening large (solid) archives
+// doesn't require parsing all their entries again
+void SetArchiveIndexCachePathFn(ArchIndexCachePathFn fn);
+
+class ArchFileStream;
+
 class ArchFile {
+    friend class ArchFileStream;
+
 protected:
     WStrList filenames;
     Vec<int64_t> filepos;
+    // where decompression has to (re)start for solid archives (0 if unknown)
+    Vec<int64_t> solidpos;
+    // -1 until determined from solidpos (cf. IsSolid)
+    int isSolid;
 
     ar_stream *data;
     ar_archive *ar;
 
+    // on-disk cache for filenames, filepos and solidpos
+    ScopedMem<WCHAR> indexCachePath;
+    uint64_t archiveSize;
+    uint64_t archiveTime;
+    bool isIndexCached;
+
+    bool ParseEntryAt(size_t fileindex);
+    bool IsSolid();
+    bool LoadIndexCache();
+    void SaveIndexCache();
+
     // call with fileindex = -1 for filename extraction using the fallback
     virtual char *GetFileFromFallback(size_t fileIndex, size_t *len = nullptr) { UNUSED(fileIndex); UNUSED(len); return nullptr; }
 
 public:
-    ArchFile(ar_stream *data, ar_archive *(* openFormat)(ar_stream *));
+    // archivePath is only needed for caching the archive's listing
+    ArchFile(ar_stream *data, ar_archive *(* openFormat)(ar_stream *), const WCHAR *archivePath=nullptr);
     virtual ~ArchFile();
 
     size_t GetFileCount() const;
@@ -26,10 +53,16 @@ public:
     const WCHAR *GetFileName(size_t fileindex);
     // reverts GetFileName
     size_t GetFileIndex(const WCHAR *filename);
+    // true if the listing has been read from the on-disk cache
+    bool IsIndexCached() const { return isIndexCached; }
 
     // caller must free() the result
     char *GetFileDataByName(const WCHAR *filename, size_t *len=nullptr);
     char *GetFileDataByIdx(size_t fileindex, size_t *len=nullptr);
+    // extracts at most the first maxLen bytes (e.g. for sniffing file headers);
+    // returns nullptr if the file can only be extracted as a whole (e.g. in solid archives)
+    // caller must free() the result
+    char *GetFileDataStartByIdx(size_t fileindex, size_t maxLen, size_t *len=nullptr);
 
     FILETIME GetFileTime(const WCHAR *filename);
     FILETIME GetFileTime(size_t fileindex);
@@ -38,10 +71,33 @@ public:
     char *GetComment(size_t *len=nullptr);
 };
 
+// reads a single file from an archive sequentially, decompressing only as
+// much data as is requested instead of extracting the whole file at once
+// note: the ArchFile must not be used for anything else while a stream is being read
+class ArchFileStream {
+    ArchFile *arch;
+    size_t fileindex;
+    size_t size;
+    size_t pos;
+    bool valid;
+
+public:
+    // the stream is invalid for files which can only be extracted as a whole
+    ArchFileStream(ArchFile *arch, size_t fileindex);
+
+    bool IsValid() const { return valid; }
+    size_t GetSize() const { return size; }
+
+    // returns the number of bytes read (less than len at the end of the file)
+    size_t Read(char *buf, size_t len);
+};
+
 class ZipFile : public ArchFile {
 public:
     explicit ZipFile(const WCHAR *path, bool deflatedOnly=false);
     explicit ZipFile(IStream *stream, bool deflatedOnly=false);
+    // data must remain valid for as long as the ZipFile is used
+    ZipFile(const char *data, size_t len, bool deflatedOnly=false);
 };
 
 class _7zFile : public ArchFile {
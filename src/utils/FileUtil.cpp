@@ -354,12 +354,20 @@ char *ReadAllUtf(const char *filePath, size_t *fileSizeOut, Allocator *allocator
     return ReadAll(buf, fileSizeOut, allocator);
 }
 
+// reads toRead bytes starting at offset
 // buf must be at least toRead in size (note: it won't be zero-terminated)
-bool ReadN(const WCHAR *filePath, char *buf, size_t toRead) {
+bool ReadN(const WCHAR *filePath, char *buf, size_t toRead, int64 offset) {
     ScopedHandle h(OpenReadOnly(filePath));
     if (h == INVALID_HANDLE_VALUE)
         return false;
 
+    if (offset != 0) {
+        LARGE_INTEGER off;
+        off.QuadPart = offset;
+        if (!SetFilePointerEx(h, off, nullptr, FILE_BEGIN))
+            return false;
+    }
+
     DWORD nRead;
     BOOL ok = ReadFile(h, buf, (DWORD)toRead, &nRead, nullptr);
     return ok && nRead == toRead;
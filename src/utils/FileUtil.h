@@ -30,7 +30,7 @@ namespace file {
 bool Exists(const WCHAR *filePath);
 char *ReadAll(const WCHAR *filePath, size_t *fileSizeOut, Allocator *allocator = nullptr);
 char *ReadAllUtf(const char *filePath, size_t *fileSizeOut, Allocator *allocator = nullptr);
-bool ReadN(const WCHAR *filePath, char *buf, size_t toRead);
+bool ReadN(const WCHAR *filePath, char *buf, size_t toRead, int64 offset = 0);
 bool WriteAll(const WCHAR *filePath, const void *data, size_t dataLen);
 bool WriteAllUtf(const char *filePath, const void *data, size_t dataLen);
 int64 GetSize(const WCHAR *filePath);
@@ -3,6 +3,7 @@
 
 namespace fitz {
 
-Gdiplus::Bitmap *ImageFromData(const char *data, size_t len);
+// reduce > 0 decodes the image at 1/2^reduce of its resolution (reduce <= 3)
+Gdiplus::Bitmap *ImageFromData(const char *data, size_t len, int reduce=0);
 
 }
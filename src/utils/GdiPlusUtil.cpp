@@ -331,9 +331,15 @@ bool IsGdiPlusNativeFormat(const char *data, size_t len)
 }
 
 // cf. http://stackoverflow.com/questions/4598872/creating-hbitmap-from-memory-buffer/4616394#4616394
-Bitmap *BitmapFromData(const char *data, size_t len)
+Bitmap *BitmapFromData(const char *data, size_t len, int reduce)
 {
     ImgFormat format = GfxFormatFromData(data, len);
+    if (reduce > 0 && (Img_JPEG == format || Img_JP2 == format)) {
+        // GDI+ can't decode at a reduced resolution, libjpeg and openjpeg can
+        Bitmap *bmp = fitz::ImageFromData(data, len, reduce);
+        if (bmp)
+            return bmp;
+    }
     if (Img_TGA == format)
         return tga::ImageFromData(data, len);
     if (Img_WebP == format)
@@ -365,7 +371,9 @@ Bitmap *BitmapFromData(const char *data, size_t len)
 }
 
 // adapted from http://cpansearch.perl.org/src/RJRAY/Image-Size-3.230/lib/Image/Size.pm
-Size BitmapSizeFromData(const char *data, size_t len)
+// only parses the image's header, so data may be truncated after the first few KB
+// (returns an empty size if the dimensions couldn't be determined)
+Size ImageSizeFromHeader(const char *data, size_t len)
 {
     Size result;
     ByteReader r(data, len);
@@ -496,6 +504,12 @@ Size BitmapSizeFromData(const char *data, size_t len)
         break;
     }
 
+    return result;
+}
+
+Size BitmapSizeFromData(const char *data, size_t len)
+{
+    Size result = ImageSizeFromHeader(data, len);
     if (result.Empty()) {
         // let GDI+ extract the image size if we've failed
         // (currently happens for animated GIF)
@@ -21,6 +21,9 @@ void     GetBaseTransform(Matrix& m, RectF pageRect, float zoom, int rotation);
 
 const WCHAR * GfxFileExtFromData(const char *data, size_t len);
 bool          IsGdiPlusNativeFormat(const char *data, size_t len);
-Bitmap *      BitmapFromData(const char *data, size_t len);
+// reduce > 0 decodes JPEG and JPEG 2000 images at 1/2^reduce of their resolution
+// (reduce <= 3), other images are always decoded at their full resolution
+Bitmap *      BitmapFromData(const char *data, size_t len, int reduce=0);
+Size          ImageSizeFromHeader(const char *data, size_t len);
 Size          BitmapSizeFromData(const char *data, size_t len);
 CLSID         GetEncoderClsid(const WCHAR *format);
@@ -40,27 +40,75 @@ static_assert(sizeof(PdbHeader) == kPdbHeaderLen, "wrong size of PdbHeader struc
 static_assert(sizeof(PdbRecordHeader) == 8, "wrong size of PdbRecordHeader structure");
 
 PdbReader::PdbReader(const WCHAR *filePath) :
-    data(file::ReadAll(filePath, &dataSize))
+    filePath(str::Dup(filePath)), dataSize(0)
 {
-    if (!ParseHeader())
+    InitializeCriticalSection(&recordsAccess);
+    if (!ReadHeader())
         recOffsets.Reset();
+    else
+        records.AppendBlanks(GetRecordCount());
 }
 
 PdbReader::PdbReader(IStream *stream) :
     data((char *)GetDataFromStream(stream, &dataSize))
 {
-    if (!ParseHeader())
+    InitializeCriticalSection(&recordsAccess);
+    if (!data || !ParseHeader(data, dataSize))
         recOffsets.Reset();
 }
 
-bool PdbReader::ParseHeader()
+PdbReader::~PdbReader()
+{
+    records.FreeMembers();
+    DeleteCriticalSection(&recordsAccess);
+}
+
+bool PdbReader::SniffDbType(const WCHAR *filePath, char dbType[9])
+{
+    char header[kPdbHeaderLen];
+    if (!file::ReadN(filePath, header, sizeof(header)))
+        return false;
+    ByteReader r(header, sizeof(header));
+    PdbHeader pdbHeader;
+    bool ok = r.UnpackBE(&pdbHeader, sizeof(pdbHeader), "32b2w6d8b2dw");
+    CrashIf(!ok);
+    if (0 == pdbHeader.numRecords)
+        return false;
+    str::BufSet(dbType, 9, pdbHeader.typeCreator);
+    return true;
+}
+
+// reads the header and the record list but none of the records
+bool PdbReader::ReadHeader()
+{
+    int64 fileSize = file::GetSize(filePath);
+    if (fileSize < kPdbHeaderLen)
+        return false;
+    dataSize = (size_t)std::min(fileSize, (int64)(uint32_t)-1);
+
+    char header[kPdbHeaderLen];
+    if (!file::ReadN(filePath, header, sizeof(header)))
+        return false;
+    ByteReader r(header, sizeof(header));
+    size_t numRecords = r.WordBE(offsetof(PdbHeader, numRecords));
+    size_t hdrLen = sizeof(PdbHeader) + numRecords * sizeof(PdbRecordHeader);
+    if (hdrLen > dataSize)
+        return false;
+
+    ScopedMem<char> hdr(AllocArray<char>(hdrLen));
+    if (!hdr || !file::ReadN(filePath, hdr, hdrLen))
+        return false;
+    return ParseHeader(hdr, hdrLen);
+}
+
+bool PdbReader::ParseHeader(const char *hdr, size_t hdrLen)
 {
     CrashIf(recOffsets.Count() > 0);
 
     PdbHeader pdbHeader;
-    if (!data || dataSize < sizeof(pdbHeader))
+    if (hdrLen < sizeof(pdbHeader))
         return false;
-    ByteReader r(data, dataSize);
+    ByteReader r(hdr, hdrLen);
 
     bool ok = r.UnpackBE(&pdbHeader, sizeof(pdbHeader), "32b2w6d8b2dw");
     CrashIf(!ok);
@@ -109,5 +157,30 @@ const char *PdbReader::GetRecord(size_t recNo, size_t *sizeOut)
     size_t offset = recOffsets.At(recNo);
     if (sizeOut)
         *sizeOut = recOffsets.At(recNo + 1) - offset;
-    return data + offset;
+    if (data)
+        return data + offset;
+
+    ScopedCritSec scope(&recordsAccess);
+    if (!records.At(recNo))
+        records.At(recNo) = ReadRecord(recNo, nullptr);
+    return records.At(recNo);
+}
+
+char *PdbReader::ReadRecord(size_t recNo, size_t *sizeOut)
+{
+    if (recNo + 1 >= recOffsets.Count())
+        return nullptr;
+    size_t offset = recOffsets.At(recNo);
+    size_t size = recOffsets.At(recNo + 1) - offset;
+    // zero-terminate for convenience
+    ScopedMem<char> rec(AllocArray<char>(size + 1));
+    if (!rec)
+        return nullptr;
+    if (data)
+        memcpy(rec, data + offset, size);
+    else if (!file::ReadN(filePath, rec, size, offset))
+        return nullptr;
+    if (sizeOut)
+        *sizeOut = size;
+    return rec.StealData();
 }
@@ -5,21 +5,36 @@
 #define kPdbHeaderLen 78
 
 class PdbReader {
+    // for files, only the header is read at construction and records
+    // are read from filePath when they're first accessed.
+    // streams are read into data completely
+    ScopedMem<WCHAR> filePath;
     ScopedMem<char> data;
     size_t          dataSize;
     // offset of each pdb record within the file + a sentinel
     // value equal to file size to simplify use
     Vec<uint32_t>   recOffsets;
+    // records read from filePath so far (nullptr if not read yet)
+    Vec<char *>     records;
+    CRITICAL_SECTION recordsAccess;
     // cache so that we can compare with str::Eq
     char            dbType[9];
 
-    bool ParseHeader();
+    bool ReadHeader();
+    bool ParseHeader(const char *hdr, size_t hdrLen);
 
 public:
     explicit PdbReader(const WCHAR *filePath);
     explicit PdbReader(IStream *stream);
+    ~PdbReader();
+
+    // only reads the file's header (e.g. for sniffing the file type)
+    static bool SniffDbType(const WCHAR *filePath, char dbType[9]);
 
     const char *GetDbType();
     size_t GetRecordCount();
+    // the returned data is owned by PdbReader and remains valid for its lifetime
     const char *GetRecord(size_t recNo, size_t *sizeOut);
+    // reads a record without keeping it around (caller must free the result)
+    char *ReadRecord(size_t recNo, size_t *sizeOut);
 };
@@ -39,8 +39,9 @@ int UVarintGobDecode(const uint8_t *d, int dLen, uint64_t *resOut)
         return 0;
     char numLenEncoded = (char)b;
     int numLen = -numLenEncoded;
-    CrashIf(numLen < 1);
-    CrashIf(numLen > 8);
+    // the data might come from a corrupted file
+    if (numLen < 1 || numLen > 8)
+        return 0;
     if (numLen > dLen)
         return 0;
     uint64_t res = 0;
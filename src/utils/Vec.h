@@ -187,6 +187,11 @@ public:
         return MakeSpaceAt(len, count);
     }
 
+    // returns nullptr on allocation failure instead of crashing
+    T* AppendBlanksChecked(size_t count) {
+        return MakeSpaceAt(len, count, true);
+    }
+
     void RemoveAt(size_t idx, size_t count=1) {
         if (len > idx + count) {
             T *dst = els + idx;